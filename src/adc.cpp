@@ -0,0 +1,351 @@
+#include "adc.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+const uint16_t SampleSource::FULL_SCALE;
+const int Adc::CHANNELS;
+const uint32_t Adc::REGISTER_WINDOW;
+const uint32_t Adc::CR_START;
+const uint32_t Adc::CR_STOP;
+const uint32_t Adc::CR_CONT;
+const uint32_t Adc::CR_EOCIE;
+const uint32_t Adc::SR_EOC;
+const uint32_t Adc::SR_OVR;
+const uint32_t Adc::SR_BUSY;
+const uint32_t Adc::FDR_CHANNEL_SHIFT;
+const uint32_t Adc::FDR_VALID;
+const size_t Adc::RESULT_RING;
+const size_t Adc::BLOCK;
+
+static uint16_t clampSample(double value)
+{
+    if (value <= 0.0) {
+        return 0;
+    }
+    if (value >= SampleSource::FULL_SCALE) {
+        return SampleSource::FULL_SCALE;
+    }
+    return static_cast<uint16_t>(value + 0.5);
+}
+
+bool FileSampleSource::open(const std::string& path, std::string& error)
+{
+    if (!file.open(path, error)) {
+        return false;
+    }
+
+    sampleCount = file.getSize() / sizeof(uint16_t);
+    position = 0;
+    if (sampleCount == 0) {
+        error = path + ": no samples";
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+void FileSampleSource::read(uint16_t* samples, size_t count)
+{
+    const unsigned char* data = file.getData();
+    size_t filled = 0;
+
+    // Straight copies from the mapping, wrapping at the end of the file
+    while (filled < count) {
+        size_t run = std::min(count - filled, sampleCount - position);
+        std::memcpy(samples + filled, data + position * sizeof(uint16_t), run * sizeof(uint16_t));
+        filled += run;
+        position += run;
+        if (position == sampleCount) {
+            position = 0;
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = std::min(samples[i], FULL_SCALE);
+    }
+}
+
+std::string FileSampleSource::describe() const
+{
+    return "file " + file.getPath() + " (" + std::to_string(sampleCount) + " samples)";
+}
+
+SineSampleSource::SineSampleSource(double periodSamples, double amplitude, double offset)
+    : period(periodSamples > 1.0 ? periodSamples : 2.0), amplitude(amplitude), offset(offset) {}
+
+void SineSampleSource::read(uint16_t* samples, size_t count)
+{
+    const double step = 2.0 * 3.14159265358979323846 / period;
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = clampSample(offset + amplitude * std::sin(phase * step));
+        phase += 1.0;
+        if (phase >= period) {
+            phase -= period;
+        }
+    }
+}
+
+std::string SineSampleSource::describe() const
+{
+    std::ostringstream oss;
+    oss << "sine, period " << period << " samples, " << offset << " +/- " << amplitude;
+    return oss.str();
+}
+
+NoiseSampleSource::NoiseSampleSource(double mean, double amplitude, uint32_t seed)
+    : mean(mean), amplitude(amplitude), state(seed != 0 ? seed : 1) {}
+
+void NoiseSampleSource::read(uint16_t* samples, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        double unit = static_cast<double>(state) / 4294967295.0;
+        samples[i] = clampSample(mean + amplitude * (2.0 * unit - 1.0));
+    }
+}
+
+std::string NoiseSampleSource::describe() const
+{
+    std::ostringstream oss;
+    oss << "noise, " << mean << " +/- " << amplitude;
+    return oss.str();
+}
+
+RampSampleSource::RampSampleSource(uint16_t step) : step(step > 0 ? step : 1) {}
+
+void RampSampleSource::read(uint16_t* samples, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = value;
+        value = (value > FULL_SCALE - step) ? 0 : static_cast<uint16_t>(value + step);
+    }
+}
+
+std::string RampSampleSource::describe() const
+{
+    return "ramp, step " + std::to_string(step);
+}
+
+Adc::Adc() : Adc("ADC") {}
+
+Adc::Adc(const std::string& name) : name(name)
+{
+    for (int i = 0; i < CHANNELS; ++i) {
+        channelResults[i] = 0;
+    }
+}
+
+Adc::~Adc() {}
+
+void Adc::attach(Clock& targetClock)
+{
+    clock = &targetClock;
+    clock->addCycleHook([this](long long firstCycle, long long count) {
+        convertSpan(firstCycle, count);
+    });
+}
+
+void Adc::setInterruptLine(InterruptController* controller, IrqNumber line)
+{
+    interrupts = controller;
+    irq = line;
+}
+
+bool Adc::setSource(int channel, std::unique_ptr<SampleSource> source)
+{
+    if (channel < 0 || channel >= CHANNELS) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    channels[channel].source = std::move(source);
+    channels[channel].position = BLOCK;   // Drop samples pulled from the old source
+    return true;
+}
+
+std::string Adc::describeSource(int channel) const
+{
+    if (channel < 0 || channel >= CHANNELS) {
+        return "";
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const Channel& entry = channels[channel];
+    return entry.source ? entry.source->describe() : "none";
+}
+
+uint32_t Adc::readRegister(uint32_t offset)
+{
+    if (offset >= CDR && offset < REGISTER_WINDOW && (offset & 3) == 0) {
+        return channelResults[(offset - CDR) / 4].load();
+    }
+
+    switch (offset) {
+        case CR: return control.load();
+        case SR: {
+            uint32_t status = 0;
+            if (!results.empty()) status |= SR_EOC;
+            if (overrun.load()) status |= SR_OVR;
+            if (busy.load()) status |= SR_BUSY;
+            return status;
+        }
+        case SQR: return scanMask.load();
+        case SMPR: return conversionCycles.load();
+        case DR: return lastResult.load();
+        case FDR: return popResult();
+        default: return 0;
+    }
+}
+
+void Adc::writeRegister(uint32_t offset, uint32_t value)
+{
+    switch (offset) {
+        case CR:
+            control = value & (CR_CONT | CR_EOCIE);
+            if (value & CR_STOP) {
+                stopRequested = busy.load();
+            } else if (value & CR_START) {
+                start();
+            }
+            break;
+        case SR:
+            if (value & SR_OVR) {
+                overrun = false;
+            }
+            break;
+        case SQR: scanMask = value & ((1u << CHANNELS) - 1); break;
+        case SMPR: conversionCycles = value > 0 ? value : 1; break;
+        default: break;   // Data registers are read-only
+    }
+}
+
+size_t Adc::readResults(AdcResult* buffer, size_t count)
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    return results.popBulk(buffer, count);
+}
+
+uint32_t Adc::popResult()
+{
+    AdcResult result;
+    std::lock_guard<std::mutex> lock(resultMutex);
+    if (!results.tryPop(result)) {
+        return 0;
+    }
+    return FDR_VALID | (static_cast<uint32_t>(result.channel) << FDR_CHANNEL_SHIFT) | result.value;
+}
+
+void Adc::start()
+{
+    if (!clock || scanMask.load() == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    scanIndex = 0;
+    nextDoneCycle = clock->getClockCycles() + conversionCycles.load();
+    stopRequested = false;
+    busy = true;
+}
+
+int Adc::channelAt(int index) const
+{
+    uint32_t mask = scanMask.load();
+    for (int channel = 0; channel < CHANNELS; ++channel) {
+        if ((mask >> channel) & 1) {
+            if (index-- == 0) {
+                return channel;
+            }
+        }
+    }
+    return -1;
+}
+
+uint16_t Adc::nextSample(Channel& channel)
+{
+    if (channel.position == BLOCK) {
+        if (channel.source) {
+            channel.source->read(channel.block, BLOCK);
+        } else {
+            std::memset(channel.block, 0, sizeof(channel.block));
+        }
+        channel.position = 0;
+    }
+    return channel.block[channel.position++];
+}
+
+void Adc::convertSpan(long long firstCycle, long long count)
+{
+    // Idle ADCs only pay for this load
+    if (!busy.load()) {
+        return;
+    }
+
+    uint64_t converted = 0;
+    uint64_t lost = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        long long endCycle = firstCycle + count;
+        long long cycles = conversionCycles.load();
+
+        // Scan order for this span, so the loop below is plain array work
+        int sequence[CHANNELS];
+        int length = 0;
+        while (channelAt(length) >= 0) {
+            sequence[length] = channelAt(length);
+            length++;
+        }
+        if (length == 0) {
+            busy = false;
+        }
+
+        bool continuous = (control.load() & CR_CONT) != 0;
+        while (length > 0 && nextDoneCycle <= endCycle && busy.load(std::memory_order_relaxed)) {
+            if (scanIndex >= length) {
+                scanIndex = 0;   // Scan mask shrank mid-sequence
+            }
+            int channel = sequence[scanIndex];
+
+            uint16_t value = nextSample(channels[channel]);
+            channelResults[channel].store(value, std::memory_order_relaxed);
+            lastResult.store(value, std::memory_order_relaxed);
+            converted++;
+
+            AdcResult result;
+            result.channel = static_cast<uint16_t>(channel);
+            result.value = value;
+            if (!results.tryPush(result)) {
+                lost++;
+            }
+
+            // The next conversion starts as this one ends, unless stopped
+            nextDoneCycle += cycles;
+            if (stopRequested.load(std::memory_order_relaxed) && stopRequested.exchange(false)) {
+                busy = false;
+            }
+            if (++scanIndex == length) {
+                scanIndex = 0;
+                if (!continuous) {
+                    busy = false;
+                }
+            }
+        }
+    }
+
+    if (converted == 0) {
+        return;
+    }
+    conversions += converted;
+    if (lost > 0) {
+        overrun = true;
+        overruns += lost;
+    }
+    if ((control.load() & CR_EOCIE) && interrupts) {
+        interrupts->raise(irq);
+    }
+}
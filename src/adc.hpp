@@ -0,0 +1,207 @@
+#ifndef ADC_HPP
+#define ADC_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "clock.hpp"
+#include "interrupt_controller.hpp"
+#include "mapped_file.hpp"
+#include "spsc_ring.hpp"
+
+// Analog input for the ADC. Sources are pulled a block at a time, so one
+// virtual call covers hundreds of conversions. Samples are 12-bit, right
+// aligned, and sources never run dry.
+
+class SampleSource
+{
+    public:
+        static const uint16_t FULL_SCALE = 4095;
+
+        virtual ~SampleSource() {}
+
+        // Fills all count samples
+        virtual void read(uint16_t* samples, size_t count) = 0;
+        virtual std::string describe() const = 0;
+};
+
+// Raw little-endian 16-bit samples, mapped and replayed in a loop
+class FileSampleSource : public SampleSource
+{
+    public:
+        bool open(const std::string& path, std::string& error);
+        void read(uint16_t* samples, size_t count) override;
+        std::string describe() const override;
+
+    private:
+        MappedFile file;
+        size_t sampleCount = 0;
+        size_t position = 0;
+};
+
+class SineSampleSource : public SampleSource
+{
+    public:
+        SineSampleSource(double periodSamples, double amplitude, double offset);
+        void read(uint16_t* samples, size_t count) override;
+        std::string describe() const override;
+
+    private:
+        double period;
+        double amplitude;
+        double offset;
+        double phase = 0.0;
+};
+
+// Uniform noise around a mean, from a xorshift generator
+class NoiseSampleSource : public SampleSource
+{
+    public:
+        NoiseSampleSource(double mean, double amplitude, uint32_t seed = 2463534242u);
+        void read(uint16_t* samples, size_t count) override;
+        std::string describe() const override;
+
+    private:
+        double mean;
+        double amplitude;
+        uint32_t state;
+};
+
+// Sawtooth from 0 to full scale
+class RampSampleSource : public SampleSource
+{
+    public:
+        explicit RampSampleSource(uint16_t step);
+        void read(uint16_t* samples, size_t count) override;
+        std::string describe() const override;
+
+    private:
+        uint16_t step;
+        uint16_t value = 0;
+};
+
+// Multi-channel successive-approximation ADC.
+//
+// A conversion takes a fixed number of clock cycles. Starting a sequence
+// converts each channel in the scan mask in turn, lowest first; continuous
+// mode starts the next sequence straight away. Conversions are worked out
+// per span of cycles from a clock cycle hook, so a long span completes many
+// of them in one pass instead of costing an event each. Results land in
+// per-channel data registers and in a result ring that firmware drains in
+// bulk, or one at a time through FDR; the end-of-conversion interrupt is
+// raised once per span that produced results.
+
+struct AdcResult {
+    uint16_t channel;
+    uint16_t value;
+};
+
+class Adc
+{
+    public:
+        enum Register : uint32_t {
+            CR = 0x00,      // control
+            SR = 0x04,      // status
+            SQR = 0x08,     // scan mask, one bit per channel
+            SMPR = 0x0C,    // conversion time in clock cycles
+            DR = 0x10,      // last result of any channel
+            FDR = 0x14,     // read pops the result ring, see FDR_ bits
+            CDR = 0x20      // per-channel results, 4 bytes apart
+        };
+        static const int CHANNELS = 8;
+        static const uint32_t REGISTER_WINDOW = CDR + 4 * CHANNELS;
+
+        // CR bits
+        static const uint32_t CR_START = 1u << 0;   // write 1 to start a sequence
+        static const uint32_t CR_STOP = 1u << 1;    // write 1 to stop after the current conversion
+        static const uint32_t CR_CONT = 1u << 2;    // continuous conversion
+        static const uint32_t CR_EOCIE = 1u << 3;   // end-of-conversion interrupt
+
+        // SR bits; EOC clears when the result ring is drained
+        static const uint32_t SR_EOC = 1u << 0;
+        static const uint32_t SR_OVR = 1u << 1;     // results lost to a full ring, write 1 to clear
+        static const uint32_t SR_BUSY = 1u << 2;
+
+        // FDR: the value in the low 12 bits, the channel from bit 16, and
+        // FDR_VALID set unless the ring was empty
+        static const uint32_t FDR_CHANNEL_SHIFT = 16;
+        static const uint32_t FDR_VALID = 1u << 31;
+
+        static const size_t RESULT_RING = 4096;
+
+        Adc();
+        Adc(const std::string& name);
+        ~Adc();
+
+        const std::string& getName() const {return name; }
+
+        // Registers a cycle hook; call once, before the clock starts
+        void attach(Clock& clock);
+        void setInterruptLine(InterruptController* controller, IrqNumber irq);
+
+        // A channel without a source reads as zero
+        bool setSource(int channel, std::unique_ptr<SampleSource> source);
+        std::string describeSource(int channel) const;
+
+        uint32_t readRegister(uint32_t offset);
+        void writeRegister(uint32_t offset, uint32_t value);
+
+        // Drain the result ring, in bulk or as one FDR word. Safe from any
+        // thread: the bus, the HAL and the stand-in handler all read it.
+        size_t readResults(AdcResult* results, size_t count);
+        uint32_t popResult();
+
+        bool isBusy() const {return busy.load(); }
+        uint32_t getScanMask() const {return scanMask.load(); }
+        uint32_t getConversionCycles() const {return conversionCycles.load(); }
+        uint16_t getChannelResult(int channel) const {return static_cast<uint16_t>(channelResults[channel].load()); }
+        uint64_t getConversions() const {return conversions.load(); }
+        uint64_t getOverruns() const {return overruns.load(); }
+
+    private:
+        static const size_t BLOCK = 256;
+
+        struct Channel {
+            std::unique_ptr<SampleSource> source;
+            uint16_t block[BLOCK];
+            size_t position = BLOCK;
+        };
+
+        std::string name;
+        Clock* clock = nullptr;
+        InterruptController* interrupts = nullptr;
+        IrqNumber irq = -1;
+
+        // Sequencer state, guarded by mutex; the hook takes it once per span
+        mutable std::mutex mutex;
+        Channel channels[CHANNELS];
+        int scanIndex = 0;
+        long long nextDoneCycle = 0;
+
+        std::atomic<uint32_t> control{0};
+        std::atomic<uint32_t> scanMask{1};
+        std::atomic<uint32_t> conversionCycles{12};
+        std::atomic<bool> busy{false};
+        std::atomic<bool> stopRequested{false};   // CR_STOP, taken when the next result lands
+        std::atomic<bool> overrun{false};
+        std::atomic<uint32_t> lastResult{0};
+        std::atomic<uint32_t> channelResults[CHANNELS];
+        std::atomic<uint64_t> conversions{0};
+        std::atomic<uint64_t> overruns{0};
+
+        // The hook is the only producer; consumers serialise on resultMutex
+        SpscRing<AdcResult> results{RESULT_RING};
+        std::mutex resultMutex;
+
+        void start();
+        void convertSpan(long long firstCycle, long long count);
+        uint16_t nextSample(Channel& channel);
+        int channelAt(int index) const;
+};
+
+#endif
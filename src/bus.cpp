@@ -0,0 +1,281 @@
+#include "bus.hpp"
+
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
+const uint32_t Bus::PAGE_SHIFT;
+const uint32_t Bus::PAGE_SIZE;
+const uint32_t Bus::PAGE_MASK;
+const size_t Bus::PAGE_COUNT;
+const uint32_t Bus::PAGE_PRESENT;
+const uint32_t Bus::PAGE_REGISTERS;
+const uint32_t Bus::PAGE_READONLY;
+const uint32_t Bus::PAGE_WATCH;
+const unsigned Bus::WATCH_READ;
+const unsigned Bus::WATCH_WRITE;
+
+Bus::Bus()
+{
+    // calloc rather than new[] so the OS hands out zero pages lazily
+    pages = static_cast<Page*>(std::calloc(PAGE_COUNT, sizeof(Page)));
+}
+
+Bus::~Bus()
+{
+    std::free(pages);
+}
+
+// Checks the region against the table and takes its pages
+bool Bus::claim(const Region& region, std::string& error)
+{
+    uint64_t end = uint64_t(region.base) + region.size;
+    if (!pages) {
+        error = "bus page table could not be allocated";
+        return false;
+    }
+    if ((region.base & PAGE_MASK) != 0 || (region.size & PAGE_MASK) != 0 || region.size == 0 ||
+        end > (uint64_t(1) << 32)) {
+        error = region.name + ": base and size must be whole pages and fit below 4 GiB";
+        return false;
+    }
+
+    uint32_t first = region.base >> PAGE_SHIFT;
+    uint32_t count = region.size >> PAGE_SHIFT;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (pages[first + i].flags.load() & PAGE_PRESENT) {
+            error = region.name + ": overlaps " + regions[pages[first + i].owner].name;
+            return false;
+        }
+    }
+
+    regions.push_back(region);
+    uint32_t flags = PAGE_PRESENT | (region.registers ? PAGE_REGISTERS : 0) | (region.readOnly ? PAGE_READONLY : 0);
+    uint8_t* host = region.registers ? region.registers->getStorage() : region.host;
+    for (uint32_t i = 0; i < count; ++i) {
+        Page& page = pages[first + i];
+        page.host = host + (size_t(i) << PAGE_SHIFT);
+        page.owner = static_cast<uint32_t>(regions.size() - 1);
+        page.flags.fetch_or(flags);   // keeps a watch flag set before mapping
+    }
+    return true;
+}
+
+bool Bus::mapMemory(const std::string& name, RegionKind kind, uint32_t base, uint8_t* host, uint32_t size,
+                    bool readOnly, std::string& error)
+{
+    if (!host) {
+        error = name + ": no backing memory";
+        return false;
+    }
+
+    Region region;
+    region.name = name;
+    region.kind = kind;
+    region.base = base;
+    region.size = size;
+    region.readOnly = readOnly;
+    region.host = host;
+    region.registers = nullptr;
+    return claim(region, error);
+}
+
+bool Bus::mapRegisters(uint32_t base, RegisterFile& registers, std::string& error)
+{
+    Region region;
+    region.name = registers.getName();
+    region.kind = PERIPHERAL;
+    region.base = base;
+    region.size = registers.getStorageSize();
+    region.readOnly = false;
+    region.host = nullptr;
+    region.registers = &registers;
+    return claim(region, error);
+}
+
+const Bus::Region* Bus::findRegion(uint32_t address) const
+{
+    if (!pages) {
+        return nullptr;
+    }
+    const Page& page = pages[address >> PAGE_SHIFT];
+    return (page.flags.load() & PAGE_PRESENT) ? &regions[page.owner] : nullptr;
+}
+
+const Bus::Region* Bus::findRegion(const std::string& name) const
+{
+    for (const Region& region : regions) {
+        if (region.name == name) {
+            return &region;
+        }
+    }
+    return nullptr;
+}
+
+bool Bus::read(uint32_t address, unsigned width, uint32_t& value)
+{
+    switch (width) {
+        case 1: {
+            uint8_t narrow = 0;
+            bool ok = load(address, narrow);
+            value = narrow;
+            return ok;
+        }
+        case 2: {
+            uint16_t narrow = 0;
+            bool ok = load(address, narrow);
+            value = narrow;
+            return ok;
+        }
+        case 4: return load(address, value);
+        default: return false;
+    }
+}
+
+bool Bus::write(uint32_t address, unsigned width, uint32_t value)
+{
+    if ((width == 1 || width == 2 || width == 4) && (address & (width - 1)) == 0) {
+        const Page& page = pages[address >> PAGE_SHIFT];
+        if ((page.flags.load() & ~PAGE_WATCH) == (PAGE_PRESENT | PAGE_READONLY)) {
+            std::memcpy(page.host + (address & PAGE_MASK), &value, width);
+            return true;
+        }
+    }
+
+    switch (width) {
+        case 1: return store(address, static_cast<uint8_t>(value));
+        case 2: return store(address, static_cast<uint16_t>(value));
+        case 4: return store(address, value);
+        default: return false;
+    }
+}
+
+std::string Bus::describeMap() const
+{
+    static const char* kinds[] = {"flash", "SRAM", "peripheral"};
+
+    std::ostringstream oss;
+    for (size_t i = 0; i < regions.size(); ++i) {
+        const Region& region = regions[i];
+        oss << (i > 0 ? "\n" : "") << std::hex << std::setfill('0') << "0x" << std::setw(8) << region.base
+            << "-0x" << std::setw(8) << (region.base + region.size - 1) << std::dec << "  " << region.name
+            << " (" << kinds[region.kind] << ", ";
+        if (region.registers) {
+            oss << region.registers->getRegisters().size() << " registers)";
+        } else {
+            oss << region.size / 1024 << " KiB" << (region.readOnly ? ", read-only)" : ")");
+        }
+    }
+    return oss.str();
+}
+
+int Bus::addWatchpoint(uint32_t address, uint32_t length, unsigned kinds, bool breaks, std::string& error)
+{
+    if (!pages) {
+        error = "bus page table could not be allocated";
+        return -1;
+    }
+    if (length == 0 || uint64_t(address) + length > (uint64_t(1) << 32)) {
+        error = "watched range must be non-empty and fit below 4 GiB";
+        return -1;
+    }
+    if ((kinds & (WATCH_READ | WATCH_WRITE)) == 0) {
+        error = "watchpoint must watch reads, writes or both";
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(watchMutex);
+    Watchpoint watchpoint;
+    watchpoint.id = nextWatchId++;
+    watchpoint.address = address;
+    watchpoint.length = length;
+    watchpoint.kinds = kinds;
+    watchpoint.breaks = breaks;
+    watchpoint.hits = 0;
+    watchpoints.push_back(watchpoint);
+    updateWatchFlags(address, length);
+    return watchpoint.id;
+}
+
+bool Bus::removeWatchpoint(int id)
+{
+    std::lock_guard<std::mutex> lock(watchMutex);
+    for (size_t i = 0; i < watchpoints.size(); ++i) {
+        if (watchpoints[i].id == id) {
+            Watchpoint removed = watchpoints[i];
+            watchpoints.erase(watchpoints.begin() + i);
+            updateWatchFlags(removed.address, removed.length);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<Bus::Watchpoint> Bus::getWatchpoints() const
+{
+    std::lock_guard<std::mutex> lock(watchMutex);
+    return watchpoints;
+}
+
+void Bus::setWatchHandler(WatchHandler handler)
+{
+    std::lock_guard<std::mutex> lock(watchMutex);
+    watchHandler = std::move(handler);
+}
+
+// Called with watchMutex held. A page keeps its flag while any watchpoint
+// still touches it.
+void Bus::updateWatchFlags(uint32_t address, uint32_t length)
+{
+    uint32_t first = address >> PAGE_SHIFT;
+    uint32_t last = static_cast<uint32_t>((uint64_t(address) + length - 1) >> PAGE_SHIFT);
+
+    for (uint64_t index = first; index <= last; ++index) {
+        uint64_t pageStart = index << PAGE_SHIFT;
+        bool watched = false;
+        for (const Watchpoint& watchpoint : watchpoints) {
+            if (watchpoint.address < pageStart + PAGE_SIZE && uint64_t(watchpoint.address) + watchpoint.length > pageStart) {
+                watched = true;
+                break;
+            }
+        }
+
+        if (watched) {
+            pages[index].flags.fetch_or(PAGE_WATCH);
+        } else {
+            pages[index].flags.fetch_and(~PAGE_WATCH);
+        }
+    }
+}
+
+void Bus::reportWatch(uint32_t address, unsigned width, bool write, uint32_t value)
+{
+    std::vector<WatchHit> hits;
+    WatchHandler handler;
+    {
+        std::lock_guard<std::mutex> lock(watchMutex);
+        unsigned kind = write ? WATCH_WRITE : WATCH_READ;
+        for (Watchpoint& watchpoint : watchpoints) {
+            if ((watchpoint.kinds & kind) && address < uint64_t(watchpoint.address) + watchpoint.length &&
+                uint64_t(address) + width > watchpoint.address) {
+                watchpoint.hits++;
+                WatchHit hit;
+                hit.id = watchpoint.id;
+                hit.address = address;
+                hit.width = width;
+                hit.write = write;
+                hit.value = value;
+                hit.breaks = watchpoint.breaks;
+                hits.push_back(hit);
+            }
+        }
+        handler = watchHandler;
+    }
+
+    // Outside the lock, so handlers may add or remove watchpoints
+    if (handler) {
+        for (const WatchHit& hit : hits) {
+            handler(hit);
+        }
+    }
+}
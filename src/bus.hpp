@@ -0,0 +1,231 @@
+#ifndef BUS_HPP
+#define BUS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "register.hpp"
+
+// 32-bit address space decoded through a flat page table.
+//
+// Every 4 KiB page has an entry holding a host pointer to its backing bytes
+// and what sits there, so decoding an access is one indexed load. The
+// address space is split into regions - flash, SRAM and peripheral
+// register files - each at a page-aligned base, one region per page. The
+// table covers the whole address space (16 MiB of entries, allocated zeroed
+// so untouched pages cost no memory).
+//
+// Memory accesses are a page lookup and a memcpy straight from the host
+// pointer. Accesses must be naturally aligned; unmapped or misaligned
+// accesses, and stores to read-only regions, fail and are counted as bus
+// faults.
+//
+// Watchpoints set a flag on every page they touch. The fast paths compare
+// the whole flags word, so a watched page simply misses them and only
+// accesses to watched pages pay for checking the watch list.
+
+class Bus
+{
+    public:
+        static const uint32_t PAGE_SHIFT = 12;
+        static const uint32_t PAGE_SIZE = 1u << PAGE_SHIFT;
+        static const uint32_t PAGE_MASK = PAGE_SIZE - 1;
+        static const size_t PAGE_COUNT = size_t(1) << (32 - PAGE_SHIFT);
+
+        // Page flags
+        static const uint32_t PAGE_PRESENT = 1u << 0;
+        static const uint32_t PAGE_REGISTERS = 1u << 1;
+        static const uint32_t PAGE_READONLY = 1u << 2;
+        static const uint32_t PAGE_WATCH = 1u << 3;
+
+        // Watchpoint kinds
+        static const unsigned WATCH_READ = 1u << 0;
+        static const unsigned WATCH_WRITE = 1u << 1;
+
+        enum RegionKind {
+            FLASH,
+            SRAM,
+            PERIPHERAL
+        };
+
+        struct Region {
+            std::string name;
+            RegionKind kind;
+            uint32_t base;
+            uint32_t size;
+            bool readOnly;
+            uint8_t* host;              // memory regions
+            RegisterFile* registers;    // peripheral regions
+        };
+
+        struct Watchpoint {
+            int id;
+            uint32_t address;
+            uint32_t length;
+            unsigned kinds;
+            bool breaks;        // the handler should stop the simulation
+            uint64_t hits;
+        };
+
+        struct WatchHit {
+            int id;
+            uint32_t address;
+            unsigned width;
+            bool write;
+            uint32_t value;     // read or written
+            bool breaks;
+        };
+
+        // Runs on whichever thread made the access, after it completed
+        typedef std::function<void(const WatchHit& hit)> WatchHandler;
+
+        Bus();
+        ~Bus();
+
+        Bus(const Bus&) = delete;
+        Bus& operator=(const Bus&) = delete;
+
+        // Call before accesses start. Memory must stay at the same host
+        // address for as long as it is mapped; size is a whole number of
+        // pages. A register file is mapped with its whole backing store.
+        bool mapMemory(const std::string& name, RegionKind kind, uint32_t base, uint8_t* host, uint32_t size,
+                       bool readOnly, std::string& error);
+        bool mapRegisters(uint32_t base, RegisterFile& registers, std::string& error);
+        const std::vector<Region>& getRegions() const {return regions; }
+        const Region* findRegion(uint32_t address) const;
+        const Region* findRegion(const std::string& name) const;
+
+        template <typename T>
+        bool load(uint32_t address, T& value)
+        {
+            const Page& page = pages[address >> PAGE_SHIFT];
+            uint32_t flags = page.flags.load(std::memory_order_relaxed);
+            if ((address & (sizeof(T) - 1)) == 0) {
+                if (loadFrom(page, flags, address, value)) {
+                    return true;
+                }
+                if (flags & PAGE_WATCH) {
+                    return loadWatched(page, flags & ~PAGE_WATCH, address, value);
+                }
+            }
+            faults++;
+            return false;
+        }
+
+        template <typename T>
+        bool store(uint32_t address, T value)
+        {
+            const Page& page = pages[address >> PAGE_SHIFT];
+            uint32_t flags = page.flags.load(std::memory_order_relaxed);
+            if ((address & (sizeof(T) - 1)) == 0) {
+                if (storeTo(page, flags, address, value)) {
+                    return true;
+                }
+                if (flags & PAGE_WATCH) {
+                    return storeWatched(page, flags & ~PAGE_WATCH, address, value);
+                }
+            }
+            faults++;
+            return false;
+        }
+
+        // Width-selected access for tools (1, 2 or 4 bytes). Tool writes may
+        // patch read-only memory, as a debugger would.
+        bool read(uint32_t address, unsigned width, uint32_t& value);
+        bool write(uint32_t address, unsigned width, uint32_t value);
+
+        uint64_t getFaultCount() const {return faults.load(); }
+        std::string describeMap() const;
+
+        // Any thread. Returns the new watchpoint's id, or -1 with error set.
+        int addWatchpoint(uint32_t address, uint32_t length, unsigned kinds, bool breaks, std::string& error);
+        bool removeWatchpoint(int id);
+        std::vector<Watchpoint> getWatchpoints() const;
+        void setWatchHandler(WatchHandler handler);
+
+    private:
+        // Flags are atomic only so watchpoints can be changed while another
+        // thread is accessing the bus; relaxed loads cost nothing extra
+        struct Page {
+            uint8_t* host;      // backing bytes of this page
+            std::atomic<uint32_t> flags;
+            uint32_t owner;     // index into regions
+        };
+
+        Page* pages = nullptr;
+        std::vector<Region> regions;
+        std::atomic<uint64_t> faults{0};
+
+        mutable std::mutex watchMutex;
+        std::vector<Watchpoint> watchpoints;
+        WatchHandler watchHandler;
+        int nextWatchId = 1;
+
+        bool claim(const Region& region, std::string& error);
+        void updateWatchFlags(uint32_t address, uint32_t length);
+        void reportWatch(uint32_t address, unsigned width, bool write, uint32_t value);
+
+        template <typename T>
+        bool loadFrom(const Page& page, uint32_t flags, uint32_t address, T& value)
+        {
+            if ((flags & ~PAGE_READONLY) == PAGE_PRESENT) {
+                std::memcpy(&value, page.host + (address & PAGE_MASK), sizeof(T));
+                return true;
+            }
+            if (flags == (PAGE_PRESENT | PAGE_REGISTERS)) {
+                value = registersAt(page)->load<T>(offsetIn(page, address));
+                return true;
+            }
+            return false;
+        }
+
+        template <typename T>
+        bool storeTo(const Page& page, uint32_t flags, uint32_t address, T value)
+        {
+            if (flags == PAGE_PRESENT) {
+                std::memcpy(page.host + (address & PAGE_MASK), &value, sizeof(T));
+                return true;
+            }
+            if (flags == (PAGE_PRESENT | PAGE_REGISTERS)) {
+                registersAt(page)->store<T>(offsetIn(page, address), value);
+                return true;
+            }
+            return false;
+        }
+
+        template <typename T>
+        bool loadWatched(const Page& page, uint32_t flags, uint32_t address, T& value)
+        {
+            if (!loadFrom(page, flags, address, value)) {
+                faults++;
+                return false;
+            }
+            reportWatch(address, sizeof(T), false, value);
+            return true;
+        }
+
+        template <typename T>
+        bool storeWatched(const Page& page, uint32_t flags, uint32_t address, T value)
+        {
+            if (!storeTo(page, flags, address, value)) {
+                faults++;
+                return false;
+            }
+            reportWatch(address, sizeof(T), true, value);
+            return true;
+        }
+
+        RegisterFile* registersAt(const Page& page) const {return regions[page.owner].registers; }
+        uint32_t offsetIn(const Page& page, uint32_t address) const
+        {
+            return static_cast<uint32_t>(page.host - registersAt(page)->getStorage()) + (address & PAGE_MASK);
+        }
+};
+
+#endif
@@ -1,20 +1,43 @@
 /*
 A clock system that uses ticks to simulate a clock for any use case.
+
+The clock is a discrete-event kernel: simulated time only moves between
+scheduled events, so an idle stretch costs O(events) rather than O(cycles).
+Cycle count and clock output are derived from the simulated time.
 */
 
 #include "clock.hpp"
 
 int NANOSECOND_SCALAR_VALUE = 1000000000;
 
+// While nothing is pending the clock still advances in slices of at most
+// this much simulated time so observers see the cycle count move.
+const uint64_t MAX_IDLE_SLICE_NS = 1000000;
+
+// Hybrid pacing sleeps until this long before a deadline and spins the rest,
+// which covers typical sleep overshoot on a desktop kernel.
+const long long SPIN_THRESHOLD_NS = 100000;
+
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
 Clock::Clock() : periodInNanoseconds(0), startPulseValue(false)
 {
     cout << "Warning: Default constructor called. Clock will have no period. \n";
 }
 
-Clock::Clock(int periodInNanoseconds, bool startPulseValue) : 
+Clock::Clock(int periodInNanoseconds, bool startPulseValue) :
         periodInNanoseconds(periodInNanoseconds),         // Timescale: nanoseconds
         startPulseValue(startPulseValue)                        // Initial clock value
-{}
+{
+    periodNs = static_cast<uint64_t>(periodInNanoseconds);
+}
 
 Clock::~Clock()
 {
@@ -22,12 +45,23 @@ Clock::~Clock()
 }
 
 void Clock::beginTicking(bool useSeconds)
-{   
+{
     if (running.load()) {
         cout << "Clock is already running. \n Stop the clock to restart it.";
         return;
     }
 
+    if (periodInNanoseconds <= 0) {
+        cout << "Clock has no period configured, not starting. \n";
+        return;
+    }
+
+    useSecondsMode = useSeconds;
+    periodNs = static_cast<uint64_t>(periodInNanoseconds);
+    if (useSecondsMode) {
+        periodNs *= NANOSECOND_SCALAR_VALUE;
+    }
+
     running = true;
     clockOutput = startPulseValue;
 
@@ -38,7 +72,9 @@ void Clock::beginTicking(bool useSeconds)
 void Clock::stop()
 {
     if (running.load()) {
+        std::unique_lock<std::mutex> lock = lockScheduler();
         running = false;
+        schedulerChanged.notify_all();
     }
 
     if (clockFuture.valid()) {
@@ -48,55 +84,380 @@ void Clock::stop()
     cout << "Clock stopped after " << clockCycles.load() << " cycles. \n";
 }
 
+void Clock::requestStop()
+{
+    // Unlike stop() this does not wait, so events on the clock thread can use it
+    std::unique_lock<std::mutex> lock = lockScheduler();
+    running = false;
+    schedulerChanged.notify_all();
+}
+
+void Clock::setSpeedRatio(double ratio)
+{
+    std::unique_lock<std::mutex> lock = lockScheduler();
+    speedRatio = ratio > 0.0 ? ratio : UNTHROTTLED;
+    speedRatioChanged = true;
+    wakeRequested = true;
+    schedulerChanged.notify_all();
+}
+
+double Clock::getNominalMHz() const
+{
+    uint64_t period = periodNs > 0 ? periodNs : static_cast<uint64_t>(periodInNanoseconds);
+    return period > 0 ? 1000.0 / static_cast<double>(period) : 0.0;
+}
+
 void Clock::clockThreadLoop()
 {
-    int halfClockPeriod = periodInNanoseconds / 2;
-    int clockWaitTime = 0;
+    cout << "Clock thread started. Period: " << periodNs << " ns. \n";
 
-    if (useSecondsMode) {
-        clockWaitTime = halfClockPeriod * 1000000000;
-    }
-    else {
-        clockWaitTime = halfClockPeriod;
-    }
+    std::unique_lock<std::mutex> lock(schedulerMutex);
+
+    // Pace against absolute wall-clock deadlines, re-anchored on speed changes
+    wallAnchor = steady_clock::now();
+    simAnchor = simTimeNs.load();
+    speedRatioChanged = false;
 
-    cout << "Clock thread started. Half period: " << halfClockPeriod << " ns. \n";
+    // Throughput is measured over windows of roughly this much wall time
+    const nanoseconds rateWindow = milliseconds(100);
+    steady_clock::time_point rateWall = wallAnchor;
+    long long rateCycles = clockCycles.load();
 
     while (running.load()) {
-        std::this_thread::sleep_for(nanoseconds(clockWaitTime));
+        adoptTimerCommands();
+
+        if (speedRatioChanged.exchange(false)) {
+            wallAnchor = steady_clock::now();
+            simAnchor = simTimeNs.load();
+        }
 
-        clockOutput =! clockOutput.load();
+        uint64_t now = simTimeNs.load();
+        uint64_t target = now + MAX_IDLE_SLICE_NS;
 
-        clockCycles++;
+        if (!scheduler.empty() && scheduler.nextEventTime() < target) {
+            target = std::max(now, scheduler.nextEventTime());
+        }
 
-        for (int i = 0; i < timers.size(); ++i) {
-            timers[i].pollTimer();
+        // The wheel only reports a lower bound for far-off timers; landing
+        // on it just cascades them closer without firing anything
+        uint64_t wheelNext = timerWheel.nextExpiry();
+        if (wheelNext != TimingWheel::NO_EXPIRY && wheelNext < target / periodNs + 1) {
+            target = std::min(target, std::max(now, wheelNext * periodNs));
+        }
 
-            // Debug
-            // cout << "Timer index: " << i << ". Current cycles: "
-            //     << timers[i].getCurrentCycles() << " Rollover count: "
-            //     << timers[i].getRolloverCount() << " \n";
+        if (isUnthrottled()) {
+            // Nothing ever blocks here, so step aside for writers queued on
+            // the scheduler mutex instead of starving them.
+            if (waitingWriters.load() > 0) {
+                lock.unlock();
+                std::this_thread::yield();
+                lock.lock();
+                continue;
+            }
         }
+        else if (!waitForWallClock(lock, target)) {
+            continue;
+        }
+
+        long long previousCycles = clockCycles.load();
+        advanceTo(target);
 
+        long long cycleCount = clockCycles.load() - previousCycles;
+        if (cycleHooks && cycleCount > 0) {
+            std::shared_ptr<const std::vector<CycleHookEntry>> hooks = cycleHooks;
+            lock.unlock();
+            for (const CycleHookEntry& entry : *hooks) {
+                entry.hook(previousCycles, cycleCount);
+            }
+            lock.lock();
+        }
+
+        // Run everything that is now due. Actions run unlocked so they are
+        // free to schedule follow-up events.
+        std::function<void()> action;
+        while (scheduler.popDue(target, action)) {
+            lock.unlock();
+            action();
+            lock.lock();
+        }
+
+        // Expiry cost depends only on the timers that actually expire
+        timerWheel.advance(static_cast<uint64_t>(clockCycles.load()));
+        TimerId expiredTimer = TimingWheel::INVALID_HANDLE;
+        while (timerWheel.popExpired(expiredTimer, action)) {
+            lock.unlock();
+            action();
+            lock.lock();
+            timerWheel.finishExpired(expiredTimer, std::move(action));
+        }
+
+        steady_clock::time_point wallNow = steady_clock::now();
+        if (wallNow - rateWall >= rateWindow) {
+            long long cycles = clockCycles.load();
+            double elapsedUs = duration<double, std::micro>(wallNow - rateWall).count();
+            achievedMHz = static_cast<double>(cycles - rateCycles) / elapsedUs;
+            rateWall = wallNow;
+            rateCycles = cycles;
+        }
     }
 
     cout << "Clock thread exiting. \n";
 
 }
 
+bool Clock::waitForWallClock(std::unique_lock<std::mutex>& lock, uint64_t targetNs)
+{
+    // Wait until the wall clock catches up with the target. A newly
+    // scheduled event or a speed change wakes us early so nothing is overshot.
+    double ratio = speedRatio.load();
+    double wallNs = static_cast<double>(targetNs - simAnchor) / ratio;
+    steady_clock::time_point deadline = wallAnchor + nanoseconds(static_cast<long long>(wallNs));
+    bool hybrid = pacingMode.load() == PacingMode::Hybrid;
+
+    steady_clock::time_point sleepUntil = deadline;
+    if (hybrid) {
+        sleepUntil -= nanoseconds(SPIN_THRESHOLD_NS);
+    }
+
+    // Timer registrations only take the lock to wake us while we sleep here
+    wakeRequested = false;
+    clockSleeping = true;
+    bool woken = schedulerChanged.wait_until(lock, sleepUntil, [this]() {
+        return wakeRequested || !running.load() || !timerCommands.empty();
+    });
+    clockSleeping = false;
+    if (woken) {
+        return false;
+    }
+
+    if (hybrid) {
+        // Spin out the remainder unlocked so writers are not held off
+        lock.unlock();
+        while (steady_clock::now() < deadline) {
+            cpuRelax();
+        }
+        lock.lock();
+
+        if (wakeRequested || !running.load()) {
+            return false;
+        }
+    }
+
+    if (timingResetRequested.exchange(false)) {
+        pacingJitter.reset();
+        driftNs = 0;
+        maxDriftNs = 0;
+    }
+
+    steady_clock::time_point wallNow = steady_clock::now();
+    long long lateNs = duration_cast<nanoseconds>(wallNow - deadline).count();
+    pacingJitter.record(lateNs > 0 ? static_cast<uint64_t>(lateNs) : 0);
+
+    // Drift is measured against the anchor, so it only grows if the clock
+    // genuinely cannot keep up; sleep overshoot is not carried forward.
+    double idealSimNs = duration<double, std::nano>(wallNow - wallAnchor).count() * ratio;
+    long long drift = static_cast<long long>(idealSimNs) - static_cast<long long>(targetNs - simAnchor);
+    driftNs = drift;
+    if (drift > maxDriftNs.load()) {
+        maxDriftNs = drift;
+    }
+
+    return true;
+}
+
+void Clock::resetTimingStats()
+{
+    // Histograms have a single writer, so the clock thread does the reset
+    timingResetRequested = true;
+}
+
+void Clock::advanceTo(uint64_t timeNs)
+{
+    simTimeNs = timeNs;
+    clockCycles = static_cast<long long>(timeNs / periodNs);
+
+    // Output toggles every half period from its configured start value
+    uint64_t edges = timeNs / (periodNs / 2 > 0 ? periodNs / 2 : 1);
+    clockOutput = startPulseValue != ((edges & 1) != 0);
+}
+
+std::unique_lock<std::mutex> Clock::lockScheduler()
+{
+    // Announce ourselves so an unthrottled clock thread yields the mutex
+    waitingWriters++;
+    std::unique_lock<std::mutex> lock(schedulerMutex);
+    waitingWriters--;
+    return lock;
+}
+
+EventId Clock::scheduleAt(uint64_t timeNs, std::function<void()> action)
+{
+    std::unique_lock<std::mutex> lock = lockScheduler();
+
+    EventId id = scheduler.scheduleAt(std::max(timeNs, simTimeNs.load()), std::move(action));
+
+    wakeRequested = true;
+    schedulerChanged.notify_all();
+
+    return id;
+}
+
+EventId Clock::scheduleAfterCycles(long long cycles, std::function<void()> action)
+{
+    // Align to the current cycle boundary so periodic events do not drift
+    uint64_t cycleStart = static_cast<uint64_t>(clockCycles.load()) * periodNs;
+    return scheduleAt(cycleStart + static_cast<uint64_t>(cycles) * periodNs, std::move(action));
+}
+
+EventId Clock::scheduleAtCycle(long long cycle, std::function<void()> action)
+{
+    return scheduleAt(static_cast<uint64_t>(cycle) * periodNs, std::move(action));
+}
+
+bool Clock::cancelEvent(EventId id)
+{
+    std::unique_lock<std::mutex> lock = lockScheduler();
+    return scheduler.cancel(id);
+}
+
 bool Clock::createCountUpTimer(int timeInMilliseconds, bool outputRollovers)
 {
-    Timer timer(timeInMilliseconds, periodInNanoseconds, outputRollovers);
-    cout << "Configured a new timer for " << timeInMilliseconds << " ms" 
+    TimerCommand command;
+    command.type = TimerCommand::Type::Add;
+    command.index = nextTimerIndex++;
+    command.milliseconds = timeInMilliseconds;
+    command.continuous = outputRollovers;
+
+    // A failed registration leaves its index unused; it never shows up in timers
+    if (!pushTimerCommand(std::move(command))) {
+        cout << "Timer queue full, could not configure a " << timeInMilliseconds << " ms timer. \n";
+        return false;
+    }
+
+    cout << "Configured a new timer for " << timeInMilliseconds << " ms"
         << " which " << (outputRollovers ? "does" : "does not") << "count rollovers.";
+    return true;
+}
 
-    timers.push_back(timer);
+bool Clock::pushTimerCommand(TimerCommand command)
+{
+    if (!timerCommands.tryPush(std::move(command))) {
+        return false;
+    }
 
-    // Return dummy true here
+    // Pairs with the store to clockSleeping in waitForWallClock: either the
+    // clock thread sees the command before sleeping or we see it asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (clockSleeping.load()) {
+        std::lock_guard<std::mutex> lock(schedulerMutex);
+        schedulerChanged.notify_all();
+    }
     return true;
 }
 
+void Clock::adoptTimerCommands()
+{
+    // Clock thread only, so timers is never touched concurrently
+    TimerCommand command;
+    while (timerCommands.tryPop(command)) {
+        if (command.index < 0) {
+            continue;
+        }
+        if (command.index >= static_cast<int>(timers.size())) {
+            // Registrations from different threads can arrive out of order,
+            // so a Start may find only this placeholder
+            timers.resize(command.index + 1, Timer(0, periodInNanoseconds, false, &clockCycles));
+        }
+
+        switch (command.type) {
+            case TimerCommand::Type::Add: {
+                // A placeholder started ahead of its Add hands that on
+                bool startedEarly = timers[command.index].isRunning();
+                timers[command.index] = Timer(command.milliseconds, periodInNanoseconds, command.continuous, &clockCycles);
+                if (startedEarly) {
+                    timers[command.index].startTimer();
+                }
+                break;
+            }
+            case TimerCommand::Type::Start:
+                // Timer state is derived from the cycle count, so starting
+                // just records the cycle it was adopted at
+                timers[command.index].startTimer();
+                break;
+        }
+    }
+}
+
+Clock::TimerId Clock::armTimer(long long delayCycles, long long periodCycles, std::function<void()> onExpire)
+{
+    std::unique_lock<std::mutex> lock = lockScheduler();
+
+    uint64_t expiry = timerWheel.getCurrentTime() + static_cast<uint64_t>(std::max(1LL, delayCycles));
+    uint64_t period = static_cast<uint64_t>(std::max(0LL, periodCycles));
+    TimerId id = timerWheel.schedule(expiry, period, std::move(onExpire));
+
+    wakeRequested = true;
+    schedulerChanged.notify_all();
+
+    return id;
+}
+
+bool Clock::cancelTimer(TimerId id)
+{
+    std::unique_lock<std::mutex> lock = lockScheduler();
+    return timerWheel.cancel(id);
+}
+
+int Clock::addCycleHook(CycleHook hook)
+{
+    std::unique_lock<std::mutex> lock = lockScheduler();
+
+    std::shared_ptr<std::vector<CycleHookEntry>> hooks = std::make_shared<std::vector<CycleHookEntry>>();
+    if (cycleHooks) {
+        *hooks = *cycleHooks;
+    }
+
+    CycleHookEntry entry;
+    entry.id = nextCycleHookId++;
+    entry.hook = std::move(hook);
+    hooks->push_back(std::move(entry));
+
+    cycleHooks = hooks;
+    return hooks->back().id;
+}
+
+void Clock::removeCycleHook(int id)
+{
+    std::unique_lock<std::mutex> lock = lockScheduler();
+    if (!cycleHooks) {
+        return;
+    }
+
+    std::shared_ptr<std::vector<CycleHookEntry>> hooks = std::make_shared<std::vector<CycleHookEntry>>();
+    for (const CycleHookEntry& entry : *cycleHooks) {
+        if (entry.id != id) {
+            hooks->push_back(entry);
+        }
+    }
+
+    if (hooks->empty()) {
+        cycleHooks.reset();
+    } else {
+        cycleHooks = hooks;
+    }
+}
+
 void Clock::startCountUpTimer(int index)
 {
-    timers[index].startTimer();
-}
\ No newline at end of file
+    if (index < 0 || index >= nextTimerIndex.load()) {
+        return;
+    }
+
+    TimerCommand command;
+    command.type = TimerCommand::Type::Start;
+    command.index = index;
+
+    if (!pushTimerCommand(std::move(command))) {
+        cout << "Timer queue full, could not start timer " << index << ". \n";
+    }
+}
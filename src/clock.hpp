@@ -5,8 +5,16 @@
 #include <atomic>
 #include <future>
 #include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
 
 #include "timer.hpp"
+#include "scheduler.hpp"
+#include "histogram.hpp"
+#include "timing_wheel.hpp"
+#include "lockfree_queue.hpp"
 
 using namespace std;
 using namespace std::this_thread;
@@ -26,13 +34,64 @@ class Clock
 
         void beginTicking(bool useSeconds);
         void stop();
+        void requestStop();
         bool getCurrentClockState() const {return clockOutput.load();}
+        bool getStartPulseValue() const {return startPulseValue; }
         long long getClockCycles() const {return clockCycles.load(); }
+        uint64_t getSimTimeNanoseconds() const {return simTimeNs.load(); }
         bool isRunning() const {return running.load(); }
         int getSystemClockPeriodInNanoseconds() const {return periodInNanoseconds; }
+        const std::atomic<long long>& getCycleCounter() const {return clockCycles; }
 
+        // Timer registration never takes the scheduler lock: requests go through
+        // a lock-free queue and the clock thread adopts them at the next cycle
+        // boundary it reaches. Returns false when the queue is full.
         bool createCountUpTimer(int timeInMilliseconds, bool outputRollovers);
         void startCountUpTimer(int index);
+
+        // Simulated-to-wall-clock speed. 1.0 is real time, UNTHROTTLED (or any
+        // ratio <= 0) removes pacing entirely. Safe to change while running.
+        static constexpr double UNTHROTTLED = 0.0;
+        void setSpeedRatio(double ratio);
+        double getSpeedRatio() const {return speedRatio.load(); }
+        bool isUnthrottled() const {return speedRatio.load() <= 0.0; }
+        double getNominalMHz() const;
+        double getAchievedMHz() const {return achievedMHz.load(); }
+
+        // Paced (non-unthrottled) runs either sleep straight to each deadline
+        // or sleep until just before it and spin the rest for precision.
+        enum class PacingMode { Sleep, Hybrid };
+        void setPacingMode(PacingMode mode) {pacingMode = mode; }
+        PacingMode getPacingMode() const {return pacingMode.load(); }
+
+        // Timing fidelity telemetry: lateness of each paced wake-up in wall
+        // nanoseconds, and how far simulated time lags the ideal schedule.
+        // The clock thread is their only writer, so a reset from another
+        // thread is applied at its next paced wake-up.
+        const Histogram& getPacingJitter() const {return pacingJitter; }
+        long long getDriftNanoseconds() const {return driftNs.load(); }
+        long long getMaxDriftNanoseconds() const {return maxDriftNs.load(); }
+        void resetTimingStats();
+
+        // Discrete-event interface. Times are absolute simulated nanoseconds,
+        // events in the past fire at the next opportunity.
+        EventId scheduleAt(uint64_t timeNs, std::function<void()> action);
+        EventId scheduleAfterCycles(long long cycles, std::function<void()> action);
+        EventId scheduleAtCycle(long long cycle, std::function<void()> action);
+        bool cancelEvent(EventId id);
+
+        // Cycle-based timers on a hierarchical timing wheel. A period of 0
+        // arms a one-shot timer. Expiry callbacks run on the clock thread.
+        typedef TimingWheel::Handle TimerId;
+        TimerId armTimer(long long delayCycles, long long periodCycles, std::function<void()> onExpire);
+        bool cancelTimer(TimerId id);
+
+        // Per-cycle consumers. Each hook runs on the clock thread with the span
+        // of cycles [firstCycle, firstCycle + count) the clock just advanced
+        // over, before events at the new time fire.
+        typedef std::function<void(long long firstCycle, long long count)> CycleHook;
+        int addCycleHook(CycleHook hook);
+        void removeCycleHook(int id);
     /*
     Initialize a clock with a specific frequency of operation. This serves
     as the basis for any scheduled events.
@@ -43,19 +102,68 @@ class Clock
         // This should allow us to access other lines of code while the clock runs
         std::atomic<bool> clockOutput{false};
         std::atomic<long long> clockCycles{0};
+        std::atomic<uint64_t> simTimeNs{0};
         std::atomic<bool> running{false};
         std::future<void> clockFuture;
 
+        // Pacing configuration and measured throughput
+        std::atomic<double> speedRatio{1.0};
+        std::atomic<bool> speedRatioChanged{false};
+        std::atomic<double> achievedMHz{0.0};
+        steady_clock::time_point wallAnchor;
+        uint64_t simAnchor = 0;
+        std::atomic<PacingMode> pacingMode{PacingMode::Hybrid};
+        Histogram pacingJitter;
+        std::atomic<long long> driftNs{0};
+        std::atomic<long long> maxDriftNs{0};
+        std::atomic<bool> timingResetRequested{false};
+
         // Clock configuration
         int periodInNanoseconds = 0;
         bool startPulseValue = 0;
         bool useSecondsMode = false;
+        uint64_t periodNs = 0;
+
+        // Pending events, guarded by schedulerMutex. The clock thread sleeps
+        // on schedulerChanged so an earlier event can cut an idle wait short.
+        Scheduler scheduler;
+        std::mutex schedulerMutex;
+        std::condition_variable schedulerChanged;
+        bool wakeRequested = false;
+        std::atomic<int> waitingWriters{0};
+
+        // Armed timers, also guarded by schedulerMutex
+        TimingWheel timerWheel;
 
-        // Utility members
+        // Cycle hooks are replaced wholesale so the clock thread can keep
+        // using its snapshot after dropping the lock
+        struct CycleHookEntry {
+            int id;
+            CycleHook hook;
+        };
+        std::shared_ptr<const std::vector<CycleHookEntry>> cycleHooks;
+        int nextCycleHookId = 1;
+
+        // Timers registered through createCountUpTimer, owned by the clock thread
+        struct TimerCommand {
+            enum class Type { Add, Start };
+            Type type = Type::Add;
+            int index = 0;
+            int milliseconds = 0;
+            bool continuous = false;
+        };
+        LockFreeQueue<TimerCommand> timerCommands{4096};
+        std::atomic<int> nextTimerIndex{0};
+        std::atomic<bool> clockSleeping{false};
         vector<Timer> timers;
-        
+
         void clockThreadLoop();
+        void advanceTo(uint64_t timeNs);
+        std::unique_lock<std::mutex> lockScheduler();
+        bool waitForWallClock(std::unique_lock<std::mutex>& lock, uint64_t targetNs);
+        void adoptTimerCommands();
+        bool pushTimerCommand(TimerCommand command);
 
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -647,7 +647,7 @@ void DisplayApp::setupMiniDisplay()
     std::cout << "DEBUG: setupMiniDisplay completed" << std::endl;
 }
 
-void DisplayApp::updateClockCycles(int cycles)
+void DisplayApp::updateClockCycles(long long cycles)
 {
     currentClockCycles = cycles;
     if (clockCyclesLabel) {
@@ -77,8 +77,8 @@ struct TimerDisplayItem {
     int timeMs;
     std::shared_ptr<Timer> timer;
     bool isRunning;
-    int currentCycles;
-    int rolloverCount;
+    long long currentCycles;
+    long long rolloverCount;
 };
 
 class DisplayApp : public QMainWindow
@@ -103,7 +103,7 @@ public:
     void connectL4ButtonClick(std::function<void()> handler);
     
     // Timer management functions
-    void updateClockCycles(int cycles);
+    void updateClockCycles(long long cycles);
     void updateTimerStatus(const std::vector<TimerDisplayItem>& timers);
     void addTimer(const std::string& name, int timeMs, std::shared_ptr<Timer> timer);
     void removeTimer(const std::string& name);
@@ -218,7 +218,7 @@ private:
     
     // Timer management
     std::vector<TimerDisplayItem> timerItems;
-    int currentClockCycles = 0;
+    long long currentClockCycles = 0;
 };
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,169 @@
+#ifndef EMBEDSIM_HAL_H
+#define EMBEDSIM_HAL_H
+
+/*
+ * C ABI for firmware built as a host shared library and run natively by
+ * embedsim (--firmware <file.so>, or the firmware CLI command).
+ *
+ * The firmware exports
+ *
+ *     int embedsim_main(const struct embedsim_hal* hal);
+ *
+ * which runs on its own thread and should return once
+ * hal_wait_for_interrupt() returns 0, or hal_stop_requested() returns 1
+ * in firmware that polls instead of waiting. Firmware that does neither
+ * cannot be unloaded. ISRs are installed with
+ * hal_irq_register(), or by exporting embedsim_isr_<line>
+ * (embedsim_isr_gpioa, embedsim_isr_timer0, ...), which are looked up once
+ * at load like the weak handlers of a vector table.
+ *
+ * ISRs run on the firmware thread, so firmware sees the single-threaded
+ * world it expects: a pending interrupt is taken at the next HAL call (any
+ * of them) or while waiting in hal_wait_for_interrupt(), never between
+ * two plain instructions. Busy-wait loops should therefore call into the
+ * HAL, as they would execute WFI on hardware. ISRs do not nest.
+ *
+ * Every call is an indirect call through the table; nothing is looked up
+ * by name after load.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EMBEDSIM_HAL_VERSION 2
+
+/* Interrupt lines. The peripheral lines are also the RV32 core's local
+ * interrupts (mip/mie bit 16 + line). */
+#define EMBEDSIM_IRQ_GPIOA 0
+#define EMBEDSIM_IRQ_UART0 1
+#define EMBEDSIM_IRQ_ADC1 2
+#define EMBEDSIM_IRQ_SPI1 3
+#define EMBEDSIM_IRQ_I2C1 4
+#define EMBEDSIM_IRQ_TIMER0 8
+#define EMBEDSIM_TIMERS 4
+#define EMBEDSIM_IRQ_LINES 16
+
+/* ADC1 results as returned by adc_read, the same word as its FDR register */
+#define EMBEDSIM_ADC_VALID 0x80000000u
+#define EMBEDSIM_ADC_CHANNEL(result) (((result) >> 16) & 0x7u)
+#define EMBEDSIM_ADC_VALUE(result) ((result) & 0xFFFu)
+
+typedef void (*embedsim_isr)(void);
+
+struct embedsim_hal {
+    uint32_t version;
+    void* context;
+
+    /* GPIO port A: pin levels, output bits to set and to reset, and the
+     * edge-pending bits (read and cleared in one go) */
+    uint32_t (*gpio_read)(void* context);
+    void (*gpio_write)(void* context, uint32_t set, uint32_t reset);
+    uint32_t (*gpio_take_edges)(void* context);
+
+    /* Simulated time */
+    uint64_t (*cycles)(void* context);
+    uint64_t (*time_ns)(void* context);
+
+    /* Cycle timers raising EMBEDSIM_IRQ_TIMER0 + timer. A period of 0 is
+     * one-shot; re-arming replaces the previous setting. Return 0 on an
+     * invalid timer. */
+    int (*timer_arm)(void* context, unsigned timer, uint64_t delay_cycles, uint64_t period_cycles);
+    void (*timer_cancel)(void* context, unsigned timer);
+
+    /* Installs (or with NULL removes) the ISR for a line; returns 0 on an
+     * invalid line. Interrupts on lines without an ISR are dropped. */
+    int (*irq_register)(void* context, unsigned line, embedsim_isr isr);
+
+    /* Global interrupt enable, for critical sections; returns the previous
+     * state. Interrupts raised while disabled stay pending. */
+    int (*irq_set_enabled)(void* context, int enabled);
+
+    /* Sleeps until an interrupt is pending and runs its ISR; returns 0 when
+     * the firmware is being unloaded and embedsim_main should return */
+    int (*wait_for_interrupt)(void* context);
+
+    /* Since version 2. Pops the oldest ADC1 result; EMBEDSIM_ADC_VALID is
+     * clear when there was none. SR.EOC clears once they are all read. */
+    uint32_t (*adc_read)(void* context);
+
+    /* Since version 2. Returns 1 once the firmware is being unloaded, for
+     * polling loops that never call wait_for_interrupt */
+    int (*stop_requested)(void* context);
+};
+
+typedef int (*embedsim_main_fn)(const struct embedsim_hal* hal);
+
+/* Convenience wrappers. Define EMBEDSIM_HAL_INSTANCE in exactly one
+ * translation unit of the firmware and assign embedsim_hal_table from
+ * embedsim_main's argument before calling them. */
+extern const struct embedsim_hal* embedsim_hal_table;
+#define EMBEDSIM_HAL_INSTANCE const struct embedsim_hal* embedsim_hal_table = 0
+
+static inline uint32_t hal_gpio_read(void)
+{
+    return embedsim_hal_table->gpio_read(embedsim_hal_table->context);
+}
+
+static inline void hal_gpio_write(uint32_t set, uint32_t reset)
+{
+    embedsim_hal_table->gpio_write(embedsim_hal_table->context, set, reset);
+}
+
+static inline uint32_t hal_gpio_take_edges(void)
+{
+    return embedsim_hal_table->gpio_take_edges(embedsim_hal_table->context);
+}
+
+static inline uint64_t hal_cycles(void)
+{
+    return embedsim_hal_table->cycles(embedsim_hal_table->context);
+}
+
+static inline uint64_t hal_time_ns(void)
+{
+    return embedsim_hal_table->time_ns(embedsim_hal_table->context);
+}
+
+static inline int hal_timer_arm(unsigned timer, uint64_t delay_cycles, uint64_t period_cycles)
+{
+    return embedsim_hal_table->timer_arm(embedsim_hal_table->context, timer, delay_cycles, period_cycles);
+}
+
+static inline void hal_timer_cancel(unsigned timer)
+{
+    embedsim_hal_table->timer_cancel(embedsim_hal_table->context, timer);
+}
+
+static inline int hal_irq_register(unsigned line, embedsim_isr isr)
+{
+    return embedsim_hal_table->irq_register(embedsim_hal_table->context, line, isr);
+}
+
+static inline int hal_irq_set_enabled(int enabled)
+{
+    return embedsim_hal_table->irq_set_enabled(embedsim_hal_table->context, enabled);
+}
+
+static inline int hal_wait_for_interrupt(void)
+{
+    return embedsim_hal_table->wait_for_interrupt(embedsim_hal_table->context);
+}
+
+static inline uint32_t hal_adc_read(void)
+{
+    return embedsim_hal_table->adc_read(embedsim_hal_table->context);
+}
+
+static inline int hal_stop_requested(void)
+{
+    return embedsim_hal_table->stop_requested(embedsim_hal_table->context);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
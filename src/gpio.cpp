@@ -0,0 +1,98 @@
+#include "gpio.hpp"
+
+const uint32_t GpioPort::REGISTER_WINDOW;
+const int GpioPort::PIN_COUNT;
+
+GpioPort::GpioPort() : name("GPIO") {}
+
+GpioPort::GpioPort(const std::string& name) : name(name) {}
+
+GpioPort::~GpioPort() {}
+
+uint32_t GpioPort::readPins() const
+{
+    // Output pins read back their latch, inputs their driven level
+    uint32_t outputs = moder.load();
+    return (inputLevels.load() & ~outputs) | (odr.load() & outputs);
+}
+
+uint32_t GpioPort::readRegister(uint32_t offset) const
+{
+    switch (offset) {
+        case MODER: return moder.load();
+        case IDR: return readPins();
+        case ODR: return odr.load();
+        case RTSR: return risingMask.load();
+        case FTSR: return fallingMask.load();
+        case PR: return pending.load();
+        default: return 0;   // BSRR and BRR are write-only
+    }
+}
+
+void GpioPort::writeRegister(uint32_t offset, uint32_t value)
+{
+    switch (offset) {
+        case MODER: moder = value; break;
+        case ODR: odr = value; break;
+        case BSRR: setOutputs(value); break;
+        case BRR: resetOutputs(value); break;
+        case RTSR: risingMask = value; break;
+        case FTSR: fallingMask = value; break;
+        case PR: pending.fetch_and(~value); break;
+        default: break;   // IDR is read-only
+    }
+}
+
+void GpioPort::driveInputs(uint32_t mask, uint32_t levels)
+{
+    // Swap in the new levels atomically so concurrent drivers each see the
+    // exact edges they caused
+    uint32_t previous = inputLevels.load();
+    uint32_t next = 0;
+    do {
+        next = (previous & ~mask) | (levels & mask);
+    } while (!inputLevels.compare_exchange_weak(previous, next));
+
+    // Only input pins generate edges
+    uint32_t inputs = ~moder.load();
+    uint32_t rising = next & ~previous & inputs & risingMask.load();
+    uint32_t falling = previous & ~next & inputs & fallingMask.load();
+    uint32_t edges = rising | falling;
+
+    if (edges != 0) {
+        uint32_t wasPending = pending.fetch_or(edges);
+        if ((edges & ~wasPending) != 0 && interrupts) {
+            interrupts->raise(irq);
+        }
+    }
+}
+
+void GpioPort::setInterruptLine(InterruptController* controller, IrqNumber line)
+{
+    interrupts = controller;
+    irq = line;
+}
+
+void GpioPort::connectButtons(const IO* io, ButtonHandle first, int firstPin, int count)
+{
+    if (firstPin < 0 || firstPin >= PIN_COUNT) {
+        return;
+    }
+
+    buttonSource = io;
+    firstButton = first;
+    firstButtonPin = firstPin;
+    buttonPinCount = count < PIN_COUNT - firstPin ? count : PIN_COUNT - firstPin;
+}
+
+void GpioPort::sample()
+{
+    if (!buttonSource || buttonPinCount <= 0) {
+        return;
+    }
+
+    // One read of the packed button planes covers every connected pin
+    uint64_t pressed = buttonSource->getPressedBits(firstButton, buttonPinCount);
+    uint32_t mask = (buttonPinCount >= PIN_COUNT) ? UINT32_MAX : (((1U << buttonPinCount) - 1) << firstButtonPin);
+    driveInputs(mask, static_cast<uint32_t>(pressed << firstButtonPin));
+}
@@ -0,0 +1,87 @@
+#ifndef GPIO_HPP
+#define GPIO_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "io.hpp"
+#include "interrupt_controller.hpp"
+
+// A 32-pin GPIO port with memory-mapped style 32-bit registers.
+//
+// Pin levels live in single atomic words, so reading the whole port is one
+// load and any thread (CLI, GUI, peripheral models) can drive input pins or
+// set and reset output bits without locks. Input pins can be wired to a
+// run of IO buttons, whose debounced PRESSED state is copied in by sample().
+//
+// Edge detection works like an EXTI block: a change on an input pin whose
+// bit is set in the rising or falling mask latches it in the pending
+// register and raises the port's interrupt. Pending bits are cleared by
+// writing ones to them.
+//
+// A 32-bit port cannot encode set and reset for every pin in one register,
+// so BSRR sets pins and a separate BRR resets them.
+
+class GpioPort
+{
+    public:
+        // Register offsets within the port's 32-byte window
+        enum Register : uint32_t {
+            MODER = 0x00,   // 1 = output
+            IDR = 0x04,     // pin levels, read-only
+            ODR = 0x08,     // output latch
+            BSRR = 0x0C,    // write 1 to set output bits
+            BRR = 0x10,     // write 1 to reset output bits
+            RTSR = 0x14,    // rising-edge interrupt mask
+            FTSR = 0x18,    // falling-edge interrupt mask
+            PR = 0x1C       // edge pending, write 1 to clear
+        };
+        static const uint32_t REGISTER_WINDOW = 0x20;
+        static const int PIN_COUNT = 32;
+
+        GpioPort();
+        GpioPort(const std::string& name);
+        ~GpioPort();
+
+        const std::string& getName() const {return name; }
+
+        // Register access by offset; unknown offsets read as zero
+        uint32_t readRegister(uint32_t offset) const;
+        void writeRegister(uint32_t offset, uint32_t value);
+
+        // Fast paths, all lock-free
+        uint32_t readPins() const;
+        uint32_t readOutputs() const {return odr.load(); }
+        void setOutputs(uint32_t mask) {odr.fetch_or(mask); }
+        void resetOutputs(uint32_t mask) {odr.fetch_and(~mask); }
+        void driveInputs(uint32_t mask, uint32_t levels);
+        uint32_t getPending() const {return pending.load(); }
+
+        // Edge interrupts are raised on this line when pending bits latch
+        void setInterruptLine(InterruptController* controller, IrqNumber irq);
+
+        // Wire pins [firstPin, firstPin + count) to consecutive IO buttons
+        void connectButtons(const IO* io, ButtonHandle firstButton, int firstPin, int count);
+        void sample();
+
+    private:
+        std::string name;
+
+        std::atomic<uint32_t> moder{0};
+        std::atomic<uint32_t> inputLevels{0};
+        std::atomic<uint32_t> odr{0};
+        std::atomic<uint32_t> risingMask{0};
+        std::atomic<uint32_t> fallingMask{0};
+        std::atomic<uint32_t> pending{0};
+
+        InterruptController* interrupts = nullptr;
+        IrqNumber irq = -1;
+
+        const IO* buttonSource = nullptr;
+        ButtonHandle firstButton = INVALID_BUTTON;
+        int firstButtonPin = 0;
+        int buttonPinCount = 0;
+};
+
+#endif
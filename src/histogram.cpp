@@ -0,0 +1,115 @@
+#include "histogram.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+Histogram::Histogram()
+{
+    reset();
+}
+
+Histogram::~Histogram() {}
+
+int Histogram::bucketFor(uint64_t value)
+{
+    int bucket = 0;
+    while (value != 0) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+uint64_t Histogram::bucketUpperBound(int bucket)
+{
+    if (bucket == 0) {
+        return 0;
+    }
+    if (bucket >= 64) {
+        return UINT64_MAX;
+    }
+    return (1ULL << bucket) - 1;
+}
+
+void Histogram::record(uint64_t value)
+{
+    // Single writer: plain load/store pairs avoid locked read-modify-writes
+    std::atomic<uint64_t>& bucket = buckets[bucketFor(value)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+
+    if (value < minValue.load(std::memory_order_relaxed)) {
+        minValue.store(value, std::memory_order_relaxed);
+    }
+    if (value > maxValue.load(std::memory_order_relaxed)) {
+        maxValue.store(value, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::reset()
+{
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    minValue.store(UINT64_MAX, std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::getMin() const
+{
+    return getCount() == 0 ? 0 : minValue.load(std::memory_order_relaxed);
+}
+
+double Histogram::getMean() const
+{
+    uint64_t samples = getCount();
+    if (samples == 0) {
+        return 0.0;
+    }
+    return static_cast<double>(sum.load(std::memory_order_relaxed)) / static_cast<double>(samples);
+}
+
+uint64_t Histogram::getPercentile(double percentile) const
+{
+    uint64_t samples = getCount();
+    if (samples == 0) {
+        return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(samples));
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen > rank) {
+            return std::min(bucketUpperBound(i), getMax());
+        }
+    }
+    return getMax();
+}
+
+std::string Histogram::format(const std::string& unit) const
+{
+    std::ostringstream oss;
+    uint64_t samples = getCount();
+
+    oss << "samples=" << samples
+        << " min=" << getMin() << unit
+        << " mean=" << static_cast<uint64_t>(getMean()) << unit
+        << " p50<=" << getPercentile(50.0) << unit
+        << " p99<=" << getPercentile(99.0) << unit
+        << " max=" << getMax() << unit;
+
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        uint64_t bucketCount = buckets[i].load(std::memory_order_relaxed);
+        if (bucketCount == 0) {
+            continue;
+        }
+        uint64_t low = (i == 0) ? 0 : (1ULL << (i - 1));
+        oss << "\n  [" << low << ", " << bucketUpperBound(i) << "]" << unit << ": " << bucketCount;
+    }
+
+    return oss.str();
+}
@@ -0,0 +1,47 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Power-of-two bucketed histogram for latency style measurements.
+// Bucket i holds values in [2^(i-1), 2^i), bucket 0 holds zero. A single
+// thread records while any thread may read; counters are relaxed atomics
+// so recording stays a handful of instructions.
+
+class Histogram
+{
+    public:
+        static const int BUCKET_COUNT = 65;
+
+        Histogram();
+        ~Histogram();
+
+        void record(uint64_t value);
+        void reset();
+
+        uint64_t getCount() const {return count.load(std::memory_order_relaxed); }
+        uint64_t getMin() const;
+        uint64_t getMax() const {return maxValue.load(std::memory_order_relaxed); }
+        double getMean() const;
+
+        // Upper bound of the bucket containing the given percentile (0-100)
+        uint64_t getPercentile(double percentile) const;
+
+        // Multi-line human readable summary, values suffixed with unit
+        std::string format(const std::string& unit) const;
+
+    private:
+        std::atomic<uint64_t> buckets[BUCKET_COUNT];
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> minValue{UINT64_MAX};
+        std::atomic<uint64_t> maxValue{0};
+
+        static int bucketFor(uint64_t value);
+        static uint64_t bucketUpperBound(int bucket);
+};
+
+#endif
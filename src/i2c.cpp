@@ -0,0 +1,234 @@
+#include "i2c.hpp"
+
+#include <algorithm>
+
+const size_t I2cController::MAX_READ_LENGTH;
+
+I2cController::I2cController() : name("I2C") {}
+
+I2cController::I2cController(const std::string& name) : name(name) {}
+
+I2cController::~I2cController() {}
+
+void I2cController::attach(Clock& targetClock)
+{
+    clock = &targetClock;
+}
+
+void I2cController::setInterruptLine(InterruptController* controller, IrqNumber line)
+{
+    interrupts = controller;
+    irq = line;
+}
+
+void I2cController::setBitRate(uint32_t hz)
+{
+    if (hz > 0) {
+        bitRate = hz;
+    }
+}
+
+bool I2cController::attachDevice(uint8_t address, std::shared_ptr<I2cDevice> device)
+{
+    if (address > 0x7F) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    devices[address] = device;
+    return true;
+}
+
+std::vector<uint8_t> I2cController::getDeviceAddresses() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<uint8_t> addresses;
+    for (uint8_t address = 0; address < 128; ++address) {
+        if (devices[address]) {
+            addresses.push_back(address);
+        }
+    }
+    return addresses;
+}
+
+std::string I2cController::describeDevice(uint8_t address) const
+{
+    if (address > 0x7F) {
+        return "";
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return devices[address] ? devices[address]->describe() : "none";
+}
+
+bool I2cController::transact(uint8_t address, std::vector<uint8_t> write, size_t readLength, Completion done)
+{
+    if (!clock || address > 0x7F || readLength > MAX_READ_LENGTH) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Pending pending;
+    pending.transaction.address = address;
+    pending.transaction.write = std::move(write);
+    pending.transaction.readLength = readLength;
+    pending.done = std::move(done);
+    queue.push_back(std::move(pending));
+
+    if (!busy) {
+        busy = true;
+        startNext();
+    }
+    return true;
+}
+
+bool I2cController::isBusy() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return busy;
+}
+
+I2cTransaction I2cController::getLastTransaction() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastTransaction;
+}
+
+// Called with mutex held and a transaction at the front of the queue. Only
+// one transaction is ever in flight, so devices are never called from two
+// threads at once.
+void I2cController::startNext()
+{
+    I2cTransaction& next = queue.front().transaction;
+    std::shared_ptr<I2cDevice> device = devices[next.address];
+    uint64_t rate = bitRate.load();
+    next.startNs = std::max(busFreeNs, clock->getSimTimeNanoseconds());
+
+    // The address phases are the only place a target can end the frame
+    // early, so they settle the frame length up front
+    bool writePhase = !next.write.empty() || next.readLength == 0;
+    bool readPhase = next.readLength > 0;
+    uint64_t bits = 1;   // start
+    next.acked = true;
+    if (writePhase) {
+        bits += 9;
+        next.acked = device && device->addressed(false, next.startNs + (bits * 1000000000ULL) / rate);
+        if (next.acked) {
+            bits += 9ULL * next.write.size();
+        }
+    }
+    if (next.acked && readPhase) {
+        bits += writePhase ? 10 : 9;   // repeated start and address
+        next.acked = device && device->addressed(true, next.startNs + (bits * 1000000000ULL) / rate);
+        if (next.acked) {
+            bits += 9ULL * next.readLength;
+        }
+    }
+    bits += 1;   // stop
+
+    next.endNs = next.startNs + (bits * 1000000000ULL + rate - 1) / rate;
+    busFreeNs = next.endNs;
+    clock->scheduleAt(next.endNs, [this]() {complete(); });
+}
+
+void I2cController::complete()
+{
+    Pending finished;
+    std::shared_ptr<I2cDevice> device;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = std::move(queue.front());
+        queue.pop_front();
+        device = devices[finished.transaction.address];
+    }
+
+    // Both phases move in bulk; a NACKed read phase reads back 0xFF
+    I2cTransaction& transaction = finished.transaction;
+    transaction.read.assign(transaction.readLength, 0xFF);
+    if (device && transaction.acked) {
+        if (!transaction.write.empty()) {
+            device->write(transaction.write.data(), transaction.write.size());
+        }
+        if (transaction.readLength > 0) {
+            device->read(transaction.read.data(), transaction.readLength);
+        }
+        bytes += transaction.write.size() + transaction.readLength;
+    } else {
+        nacks++;
+    }
+    if (device) {
+        device->stop(transaction.endNs);
+    }
+    transactions++;
+
+    if (finished.done) {
+        finished.done(transaction);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        lastTransaction = std::move(transaction);
+        if (queue.empty()) {
+            busy = false;
+        } else {
+            startNext();
+        }
+    }
+
+    if (interrupts) {
+        interrupts->raise(irq);
+    }
+}
+
+I2cEeprom::I2cEeprom(size_t size, size_t pageSize, uint64_t writeCycleNs)
+    : memory(size > 0 ? size : 1, 0xFF), pageSize(std::max<size_t>(1, std::min(pageSize, memory.size()))),
+      addressBytes(size > 2048 ? 2 : 1), writeCycleNs(writeCycleNs) {}
+
+bool I2cEeprom::addressed(bool read, uint64_t timeNs)
+{
+    (void)read;
+    wroteData = false;
+    return timeNs >= busyUntilNs;
+}
+
+void I2cEeprom::write(const uint8_t* data, size_t length)
+{
+    size_t consumed = std::min(length, addressBytes);
+    if (consumed == addressBytes) {
+        pointer = 0;
+        for (size_t i = 0; i < addressBytes; ++i) {
+            pointer = (pointer << 8) | data[i];
+        }
+        pointer %= memory.size();
+    }
+
+    // Page writes wrap within the page rather than spilling into the next
+    size_t pageBase = pointer - pointer % pageSize;
+    for (size_t i = consumed; i < length; ++i) {
+        memory[pointer % memory.size()] = data[i];
+        pointer = pageBase + (pointer - pageBase + 1) % pageSize;
+        wroteData = true;
+    }
+}
+
+void I2cEeprom::read(uint8_t* data, size_t length)
+{
+    // Sequential reads run on across pages and wrap at the end
+    for (size_t i = 0; i < length; ++i) {
+        data[i] = memory[pointer % memory.size()];
+        pointer = (pointer + 1) % memory.size();
+    }
+}
+
+void I2cEeprom::stop(uint64_t timeNs)
+{
+    if (wroteData) {
+        busyUntilNs = timeNs + writeCycleNs;
+        wroteData = false;
+    }
+}
+
+std::string I2cEeprom::describe() const
+{
+    return "EEPROM, " + std::to_string(memory.size()) + " bytes, " + std::to_string(pageSize) + "-byte pages";
+}
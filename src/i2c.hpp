@@ -0,0 +1,138 @@
+#ifndef I2C_HPP
+#define I2C_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "clock.hpp"
+#include "interrupt_controller.hpp"
+
+// A target on an I2C bus. The controller asks whether the device answers
+// its address when the transaction starts, then hands over the data of
+// each phase in one call when the transaction ends.
+class I2cDevice
+{
+    public:
+        virtual ~I2cDevice() {}
+
+        // Address phase; returning false NACKs and ends the transaction
+        virtual bool addressed(bool read, uint64_t timeNs) = 0;
+        virtual void write(const uint8_t* data, size_t length) = 0;
+        virtual void read(uint8_t* data, size_t length) = 0;
+        virtual void stop(uint64_t timeNs) {(void)timeNs; }
+        virtual std::string describe() const = 0;
+};
+
+// Write phase, then an optional read phase after a repeated start. Either
+// may be empty; with both empty the transaction is a bare address probe.
+struct I2cTransaction {
+    uint8_t address = 0;
+    std::vector<uint8_t> write;
+    size_t readLength = 0;
+    std::vector<uint8_t> read;
+    bool acked = false;
+    uint64_t startNs = 0;
+    uint64_t endNs = 0;
+};
+
+// Transaction-level I2C controller.
+//
+// Each transaction is one clock event lasting exactly as many bit times
+// as the frame would on the wire: start, nine bits per address or data
+// byte including its ACK, a repeated start before the read phase, and a
+// stop. A NACKed address cuts the frame short there. Transactions queue
+// and run back to back.
+class I2cController
+{
+    public:
+        typedef std::function<void(const I2cTransaction& transaction)> Completion;
+
+        // Longest read phase transact() accepts; the read buffer is
+        // allocated on the clock thread when the transaction completes
+        static const size_t MAX_READ_LENGTH = 4096;
+
+        I2cController();
+        I2cController(const std::string& name);
+        ~I2cController();
+
+        const std::string& getName() const {return name; }
+        void attach(Clock& clock);
+        void setInterruptLine(InterruptController* controller, IrqNumber irq);
+        void setBitRate(uint32_t hz);
+        uint32_t getBitRate() const {return bitRate.load(); }
+
+        // 7-bit addresses
+        bool attachDevice(uint8_t address, std::shared_ptr<I2cDevice> device);
+        std::vector<uint8_t> getDeviceAddresses() const;
+        std::string describeDevice(uint8_t address) const;
+
+        // Any thread; completion runs on the clock thread
+        bool transact(uint8_t address, std::vector<uint8_t> write, size_t readLength,
+                      Completion done = Completion());
+
+        bool isBusy() const;
+        I2cTransaction getLastTransaction() const;
+        uint64_t getTransactionCount() const {return transactions.load(); }
+        uint64_t getNackCount() const {return nacks.load(); }
+        uint64_t getByteCount() const {return bytes.load(); }
+
+    private:
+        struct Pending {
+            I2cTransaction transaction;
+            Completion done;
+        };
+
+        std::string name;
+        Clock* clock = nullptr;
+        InterruptController* interrupts = nullptr;
+        IrqNumber irq = -1;
+        std::atomic<uint32_t> bitRate{100000};
+
+        mutable std::mutex mutex;
+        std::shared_ptr<I2cDevice> devices[128];
+        std::deque<Pending> queue;
+        bool busy = false;
+        uint64_t busFreeNs = 0;
+        I2cTransaction lastTransaction;
+
+        std::atomic<uint64_t> transactions{0};
+        std::atomic<uint64_t> nacks{0};
+        std::atomic<uint64_t> bytes{0};
+
+        void startNext();
+        void complete();
+};
+
+// 24xx-style serial EEPROM. A write sets the word address (one byte up to
+// 2 KiB, two above) and stores the rest within the current page, wrapping
+// at the page boundary. After a stop that wrote data the part is busy for
+// its write cycle and NACKs its address, so firmware can ACK-poll.
+class I2cEeprom : public I2cDevice
+{
+    public:
+        I2cEeprom(size_t size, size_t pageSize, uint64_t writeCycleNs);
+
+        bool addressed(bool read, uint64_t timeNs) override;
+        void write(const uint8_t* data, size_t length) override;
+        void read(uint8_t* data, size_t length) override;
+        void stop(uint64_t timeNs) override;
+        std::string describe() const override;
+
+    private:
+        std::vector<uint8_t> memory;
+        size_t pageSize;
+        size_t addressBytes;
+        uint64_t writeCycleNs;
+        uint64_t busyUntilNs = 0;
+        size_t pointer = 0;
+        bool wroteData = false;
+};
+
+#endif
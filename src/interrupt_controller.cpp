@@ -0,0 +1,405 @@
+#include "interrupt_controller.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+const int InterruptController::MAX_IRQS;
+const int InterruptController::PRIORITY_LEVELS;
+const uint8_t InterruptController::LOWEST_PRIORITY;
+
+// Execution priority of thread mode, below every interrupt
+static const int THREAD_PRIORITY = InterruptController::PRIORITY_LEVELS;
+
+InterruptController::InterruptController() : vectorTable(MAX_IRQS)
+{
+    for (int i = 0; i < MAX_IRQS; ++i) {
+        priorities[i].store(LOWEST_PRIORITY);
+        handlerCosts[i].store(0);
+        dispatchCounts[i].store(0);
+        pendingStamped[i] = false;
+        pendingCycle[i] = 0;
+        pendingWallNs[i] = 0;
+        irqLevel[i] = LOWEST_PRIORITY;
+    }
+    for (int level = 0; level < PRIORITY_LEVELS; ++level) {
+        levelReady[level] = 0;
+    }
+    for (int word = 0; word < PRIORITY_LEVELS / 64; ++word) {
+        readyLevels[word] = 0;
+    }
+}
+
+InterruptController::~InterruptController() {}
+
+bool InterruptController::setHandler(IrqNumber irq, Handler handler)
+{
+    if (!isValid(irq)) {
+        return false;
+    }
+    vectorTable[irq] = std::move(handler);
+    return true;
+}
+
+bool InterruptController::setPriority(IrqNumber irq, uint8_t priority)
+{
+    if (!isValid(irq)) {
+        return false;
+    }
+    priorities[irq] = priority;
+    configVersion++;
+    return true;
+}
+
+uint8_t InterruptController::getPriority(IrqNumber irq) const
+{
+    return isValid(irq) ? priorities[irq].load() : LOWEST_PRIORITY;
+}
+
+bool InterruptController::enable(IrqNumber irq)
+{
+    if (!isValid(irq)) {
+        return false;
+    }
+    enabledMask.fetch_or(1ULL << irq);
+    configVersion++;
+    return true;
+}
+
+bool InterruptController::disable(IrqNumber irq)
+{
+    if (!isValid(irq)) {
+        return false;
+    }
+    enabledMask.fetch_and(~(1ULL << irq));
+    configVersion++;
+    return true;
+}
+
+bool InterruptController::setHandlerCost(IrqNumber irq, uint32_t cycles)
+{
+    if (!isValid(irq)) {
+        return false;
+    }
+    handlerCosts[irq] = cycles;
+    return true;
+}
+
+uint32_t InterruptController::getHandlerCost(IrqNumber irq) const
+{
+    return isValid(irq) ? handlerCosts[irq].load() : 0;
+}
+
+void InterruptController::setExceptionTiming(uint32_t entryCycles, uint32_t tailChainCycles)
+{
+    entryLatency = entryCycles;
+    tailChainLatency = tailChainCycles;
+}
+
+void InterruptController::consumeCycles(long long cycles)
+{
+    // Only meaningful from inside a handler, which runs on the dispatcher
+    if (handlerFrame >= 0 && cycles > 0) {
+        activeStack[handlerFrame].remainingCycles += cycles;
+    }
+}
+
+bool InterruptController::isEnabled(IrqNumber irq) const
+{
+    return isValid(irq) && (enabledMask.load() >> irq) & 1;
+}
+
+bool InterruptController::isPending(IrqNumber irq) const
+{
+    return isValid(irq) && (pendingMask.load() >> irq) & 1;
+}
+
+bool InterruptController::raise(IrqNumber irq)
+{
+    if (!isValid(irq)) {
+        return false;
+    }
+
+    RaiseRecord record;
+    record.irq = irq;
+    record.cycle = currentCycle();
+    record.wallNs = wallNanoseconds();
+
+    if (!raiseQueue.tryPush(record)) {
+        // Pending bits coalesce anyway, so a full ring never loses the raise.
+        // Without a timestamp it is left out of the latency stats.
+        pendingMask.fetch_or(1ULL << irq);
+        overflowRaises++;
+    }
+    return true;
+}
+
+long long InterruptController::currentCycle() const
+{
+    return cycleSource ? cycleSource->load(std::memory_order_relaxed) : 0;
+}
+
+int64_t InterruptController::wallNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void InterruptController::resetLatencyStats()
+{
+    // Histograms have a single writer, so the dispatcher does the reset
+    resetRequested = true;
+}
+
+void InterruptController::insertReady(IrqNumber irq)
+{
+    int level = irqLevel[irq];
+    levelReady[level] |= 1ULL << irq;
+    readyLevels[level / 64] |= 1ULL << (level % 64);
+    trackedReady |= 1ULL << irq;
+}
+
+void InterruptController::removeReady(IrqNumber irq)
+{
+    int level = irqLevel[irq];
+    levelReady[level] &= ~(1ULL << irq);
+    if (levelReady[level] == 0) {
+        readyLevels[level / 64] &= ~(1ULL << (level % 64));
+    }
+    trackedReady &= ~(1ULL << irq);
+}
+
+IrqNumber InterruptController::highestReady(long long cycle, int below, long long& nextArrival) const
+{
+    // Interrupts raised after the cycle being modelled do not exist yet;
+    // the earliest such one that could be taken is where time has to stop
+    // and look again. Usually everything ready has arrived, and the first
+    // bit scanned is the answer.
+    for (int word = 0; word < PRIORITY_LEVELS / 64; ++word) {
+        uint64_t levels = readyLevels[word];
+        while (levels != 0) {
+            int level = word * 64 + __builtin_ctzll(levels);
+            if (level >= below) {
+                return -1;
+            }
+            uint64_t irqs = levelReady[level];
+            while (irqs != 0) {
+                IrqNumber irq = __builtin_ctzll(irqs);
+                if (!pendingStamped[irq] || pendingCycle[irq] <= cycle) {
+                    return irq;
+                }
+                nextArrival = std::min(nextArrival, pendingCycle[irq]);
+                irqs &= irqs - 1;
+            }
+            levels &= levels - 1;
+        }
+    }
+    return -1;
+}
+
+void InterruptController::syncReady()
+{
+    uint64_t ready = pendingMask.load() & enabledMask.load();
+
+    // Priority changes move entries between levels, so start over; they
+    // only happen on configuration, never per interrupt
+    unsigned version = configVersion.load();
+    if (version != trackedVersion) {
+        trackedVersion = version;
+        while (trackedReady != 0) {
+            removeReady(__builtin_ctzll(trackedReady));
+        }
+        for (int i = 0; i < MAX_IRQS; ++i) {
+            irqLevel[i] = priorities[i].load();
+        }
+    }
+
+    // Otherwise only the bits that changed since the last call are touched
+    uint64_t added = ready & ~trackedReady;
+    uint64_t removed = trackedReady & ~ready;
+    while (added != 0) {
+        insertReady(__builtin_ctzll(added));
+        added &= added - 1;
+    }
+    while (removed != 0) {
+        removeReady(__builtin_ctzll(removed));
+        removed &= removed - 1;
+    }
+}
+
+void InterruptController::takeInterrupt(IrqNumber irq, Frame& frame)
+{
+    removeReady(irq);
+    pendingMask.fetch_and(~(1ULL << irq));
+
+    frame.irq = irq;
+    frame.priority = irqLevel[irq];
+    frame.stamped = pendingStamped[irq];
+    frame.raisedCycle = pendingCycle[irq];
+    frame.raisedWallNs = pendingWallNs[irq];
+    pendingStamped[irq] = false;
+}
+
+void InterruptController::repend(const Frame& frame)
+{
+    // The displaced interrupt keeps its original raise time
+    if (frame.stamped && !pendingStamped[frame.irq]) {
+        pendingStamped[frame.irq] = true;
+        pendingCycle[frame.irq] = frame.raisedCycle;
+        pendingWallNs[frame.irq] = frame.raisedWallNs;
+    }
+    pendingMask.fetch_or(1ULL << frame.irq);
+    if (enabledMask.load() & (1ULL << frame.irq)) {
+        insertReady(frame.irq);
+    }
+}
+
+size_t InterruptController::dispatch(long long now)
+{
+    // Called at every span boundary, so the idle path avoids atomic writes
+    if (resetRequested.load(std::memory_order_relaxed) && resetRequested.exchange(false)) {
+        for (int i = 0; i < MAX_IRQS; ++i) {
+            cycleLatency[i].reset();
+            wallLatency[i].reset();
+        }
+    }
+
+    // Fold raised interrupts into the pending bits; repeated raises of an
+    // interrupt that is already pending coalesce, as on hardware
+    uint64_t raised = 0;
+    RaiseRecord record;
+    while (raiseQueue.tryPop(record)) {
+        raised |= 1ULL << record.irq;
+        if (!pendingStamped[record.irq]) {
+            pendingStamped[record.irq] = true;
+            pendingCycle[record.irq] = record.cycle;
+            pendingWallNs[record.irq] = record.wallNs;
+        }
+    }
+    if (raised != 0) {
+        pendingMask.fetch_or(raised);
+    }
+    syncReady();
+
+    if (lastCycle < 0 || now < lastCycle) {
+        lastCycle = now;
+    }
+
+    // Walk simulated time from the last call to now. Every pass either
+    // takes an interrupt, finishes a phase of the active one, or runs out
+    // of time, so the loop is bounded by the work actually modelled.
+    long long cycle = lastCycle;
+    bool returning = false;
+    size_t serviced = 0;
+
+    while (true) {
+        int current = activeDepth > 0 ? activeStack[activeDepth - 1].priority : THREAD_PRIORITY;
+        long long nextArrival = now;
+        IrqNumber candidate = globalMask.load() ? -1 : highestReady(cycle, current, nextArrival);
+
+        if (candidate >= 0) {
+            Frame* top = activeDepth > 0 ? &activeStack[activeDepth - 1] : nullptr;
+
+            if (top && !top->started) {
+                // Late arrival: the higher priority vector is fetched instead,
+                // reusing the stacking already in progress
+                Frame displaced = *top;
+                takeInterrupt(candidate, *top);
+                repend(displaced);
+                lateArrivals++;
+            } else {
+                Frame& frame = activeStack[activeDepth++];
+                takeInterrupt(candidate, frame);
+                frame.started = false;
+                frame.remainingCycles = 0;
+                frame.entryCycles = returning ? tailChainLatency.load() : entryLatency.load();
+
+                if (returning) {
+                    tailChains++;
+                } else if (top) {
+                    preemptions++;
+                }
+                if (activeDepth > maxActiveDepth.load()) {
+                    maxActiveDepth = activeDepth;
+                }
+            }
+            returning = false;
+            continue;
+        }
+        returning = false;
+
+        if (activeDepth == 0) {
+            if (nextArrival >= now) {
+                break;
+            }
+            // Idle until the next raise
+            cycle = nextArrival;
+            continue;
+        }
+
+        // The active frame only runs until the next raise that could
+        // preempt it, then the candidates are looked at again
+        Frame& top = activeStack[activeDepth - 1];
+        long long available = nextArrival - cycle;
+
+        if (!top.started) {
+            long long step = std::min(top.entryCycles, available);
+            cycle += step;
+            top.entryCycles -= step;
+            if (top.entryCycles > 0) {
+                if (cycle >= now) {
+                    break;
+                }
+                continue;
+            }
+
+            top.started = true;
+            top.remainingCycles = handlerCosts[top.irq].load();
+            dispatchCounts[top.irq]++;
+            recordLatency(top, cycle);
+            serviced++;
+
+            if (vectorTable[top.irq]) {
+                handlerFrame = activeDepth - 1;
+                vectorTable[top.irq]();
+                handlerFrame = -1;
+            }
+            continue;
+        }
+
+        long long step = std::min(top.remainingCycles, available);
+        cycle += step;
+        top.remainingCycles -= step;
+        if (top.remainingCycles > 0) {
+            if (cycle >= now) {
+                break;
+            }
+            continue;
+        }
+
+        // Handler returned; anything taken right now tail-chains
+        activeDepth--;
+        returning = true;
+    }
+
+    lastCycle = now;
+    if (publishedDepth.load(std::memory_order_relaxed) != activeDepth) {
+        publishedDepth = activeDepth;
+    }
+    return serviced;
+}
+
+void InterruptController::recordLatency(const Frame& frame, long long startCycle)
+{
+    // Only raises that overflowed the ring arrive unstamped
+    if (!frame.stamped) {
+        return;
+    }
+
+    cycleLatency[frame.irq].record(static_cast<uint64_t>(std::max(0LL, startCycle - frame.raisedCycle)));
+    wallLatency[frame.irq].record(static_cast<uint64_t>(std::max<int64_t>(0, wallNanoseconds() - frame.raisedWallNs)));
+}
+
+uint64_t InterruptController::getDispatchCount(IrqNumber irq) const
+{
+    return isValid(irq) ? dispatchCounts[irq].load() : 0;
+}
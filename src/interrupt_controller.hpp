@@ -0,0 +1,176 @@
+#ifndef INTERRUPT_CONTROLLER_HPP
+#define INTERRUPT_CONTROLLER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "lockfree_queue.hpp"
+#include "histogram.hpp"
+
+// NVIC-style interrupt controller.
+//
+// Interrupts are small integers indexing a flat vector table. Any thread can
+// raise() an interrupt: the request goes into a lock-free ring and is folded
+// into the pending bits when the simulation thread calls dispatch() at a
+// cycle boundary. dispatch() then services pending, enabled interrupts in
+// priority order (lower number first, ties to the lower IRQ number), much
+// like an NVIC where a raised-but-masked interrupt stays pending until it
+// is enabled.
+//
+// The vector table is not synchronised, so install handlers before
+// dispatching starts, as firmware does at reset. Masks and priorities may
+// be changed from any thread.
+//
+// Every raise is timestamped in simulated cycles and host nanoseconds, and
+// the wait until its handler starts is recorded per IRQ. Coalesced raises
+// are measured from the earliest one still pending.
+//
+// Execution is modelled in simulated cycles. Taking an interrupt costs the
+// entry latency, a handler then stays active for its configured cost plus
+// whatever it adds through consumeCycles(), and only a strictly higher
+// priority can preempt it. An interrupt taken straight off a handler's
+// return tail-chains at the shorter tail-chain latency, and a higher
+// priority interrupt raised during entry takes over that entry (late
+// arrival). An interrupt only competes from the cycle it was raised at, so
+// a dispatch that runs late still places preemptions where they happened.
+// Ready interrupts sit in per-priority masks indexed by a level
+// bitmap, so picking the next one is a few bit scans however many are
+// pending. With the default costs of zero, handlers complete instantly.
+
+typedef int IrqNumber;
+
+class InterruptController
+{
+    public:
+        typedef std::function<void()> Handler;
+        static const int MAX_IRQS = 64;
+        static const int PRIORITY_LEVELS = 256;
+        static const uint8_t LOWEST_PRIORITY = 255;
+
+        InterruptController();
+        ~InterruptController();
+
+        // Cycle count used to timestamp raises, normally the clock's counter
+        void setCycleSource(const std::atomic<long long>* source) {cycleSource = source; }
+
+        // Vector table and per-IRQ configuration
+        bool setHandler(IrqNumber irq, Handler handler);
+        bool setPriority(IrqNumber irq, uint8_t priority);
+        uint8_t getPriority(IrqNumber irq) const;
+        bool enable(IrqNumber irq);
+        bool disable(IrqNumber irq);
+        bool isEnabled(IrqNumber irq) const;
+        bool isPending(IrqNumber irq) const;
+
+        // Simulated time taken by a handler, and by exception entry and
+        // tail-chaining. Handlers may add to their own cost while running.
+        bool setHandlerCost(IrqNumber irq, uint32_t cycles);
+        uint32_t getHandlerCost(IrqNumber irq) const;
+        void setExceptionTiming(uint32_t entryCycles, uint32_t tailChainCycles);
+        void consumeCycles(long long cycles);
+
+        // Global mask, like PRIMASK: interrupts stay pending while set
+        void setGlobalMask(bool masked) {globalMask = masked; }
+        bool isGloballyMasked() const {return globalMask.load(); }
+
+        // Lock-free, callable from any thread. Only fails for an invalid IRQ.
+        bool raise(IrqNumber irq);
+
+        // Simulation thread only. Plays the execution model forward to the
+        // given cycle and returns how many handlers were started. Raises
+        // stamped after that cycle wait for a later call, as do interrupts
+        // raised by a handler.
+        size_t dispatch(long long cycle);
+
+        uint64_t getDispatchCount(IrqNumber irq) const;
+        uint64_t getOverflowRaises() const {return overflowRaises.load(); }
+        uint64_t getPreemptions() const {return preemptions.load(); }
+        uint64_t getTailChains() const {return tailChains.load(); }
+        uint64_t getLateArrivals() const {return lateArrivals.load(); }
+        int getActiveDepth() const {return publishedDepth.load(); }
+        int getMaxActiveDepth() const {return maxActiveDepth.load(); }
+
+        // Raise-to-handler latency, readable from any thread
+        const Histogram& getCycleLatency(IrqNumber irq) const {return cycleLatency[isValid(irq) ? irq : 0]; }
+        const Histogram& getWallLatency(IrqNumber irq) const {return wallLatency[isValid(irq) ? irq : 0]; }
+        void resetLatencyStats();
+
+    private:
+        struct RaiseRecord {
+            IrqNumber irq = 0;
+            long long cycle = 0;
+            int64_t wallNs = 0;
+        };
+
+        // One entry per handler that has been taken and not yet returned.
+        // Each level of nesting has a strictly higher priority than the one
+        // below, so an IRQ is never on the stack twice.
+        struct Frame {
+            IrqNumber irq = 0;
+            int priority = 0;
+            long long entryCycles = 0;
+            long long remainingCycles = 0;
+            bool started = false;
+            bool stamped = false;
+            long long raisedCycle = 0;
+            int64_t raisedWallNs = 0;
+        };
+
+        std::vector<Handler> vectorTable;
+        std::atomic<uint8_t> priorities[MAX_IRQS];
+        std::atomic<uint32_t> handlerCosts[MAX_IRQS];
+        std::atomic<uint64_t> dispatchCounts[MAX_IRQS];
+        std::atomic<uint64_t> enabledMask{0};
+        std::atomic<uint64_t> pendingMask{0};
+        std::atomic<bool> globalMask{false};
+        std::atomic<uint32_t> entryLatency{0};
+        std::atomic<uint32_t> tailChainLatency{0};
+        std::atomic<unsigned> configVersion{0};
+        std::atomic<uint64_t> overflowRaises{0};
+        std::atomic<uint64_t> preemptions{0};
+        std::atomic<uint64_t> tailChains{0};
+        std::atomic<uint64_t> lateArrivals{0};
+        std::atomic<int> publishedDepth{0};
+        std::atomic<int> maxActiveDepth{0};
+
+        // Ready interrupts (pending and enabled) by priority, simulation
+        // thread only. readyLevels has one bit per non-empty levelReady.
+        uint64_t levelReady[PRIORITY_LEVELS];
+        uint64_t readyLevels[PRIORITY_LEVELS / 64];
+        uint64_t trackedReady = 0;
+        int irqLevel[MAX_IRQS];
+        unsigned trackedVersion = 0;
+
+        Frame activeStack[MAX_IRQS];
+        int activeDepth = 0;
+        int handlerFrame = -1;
+        long long lastCycle = -1;
+
+        LockFreeQueue<RaiseRecord> raiseQueue{1024};
+        const std::atomic<long long>* cycleSource = nullptr;
+
+        // Timestamp of the earliest pending raise, simulation thread only
+        bool pendingStamped[MAX_IRQS];
+        long long pendingCycle[MAX_IRQS];
+        int64_t pendingWallNs[MAX_IRQS];
+        Histogram cycleLatency[MAX_IRQS];
+        Histogram wallLatency[MAX_IRQS];
+        std::atomic<bool> resetRequested{false};
+
+        long long currentCycle() const;
+        void recordLatency(const Frame& frame, long long startCycle);
+        static int64_t wallNanoseconds();
+
+        static bool isValid(IrqNumber irq) {return irq >= 0 && irq < MAX_IRQS; }
+        void syncReady();
+        void insertReady(IrqNumber irq);
+        void removeReady(IrqNumber irq);
+        IrqNumber highestReady(long long cycle, int below, long long& nextArrival) const;
+        void takeInterrupt(IrqNumber irq, Frame& frame);
+        void repend(const Frame& frame);
+};
+
+#endif
@@ -1,5 +1,13 @@
 #include "io.hpp"
 
+#include <algorithm>
+
+static const int LANES_PER_WORD = 64;
+
+// Three counter planes hold counts up to 7
+static_assert(Button::DEBOUNCE_THRESHOLD > 0 && Button::DEBOUNCE_THRESHOLD <= 7,
+              "Debounce threshold must fit the three counter planes");
+
 IO::IO()
 {
     cout << "Warning: Default constructor called. IO module will have no features.";
@@ -9,125 +17,302 @@ IO::IO(string name, bool enable) : name(name), enable(enable) {}
 
 IO::~IO() {}
 
-void IO::addButton(Button button)
+ButtonHandle IO::addButton(Button button)
 {
-    buttons.push_back(button);
+    ButtonHandle index = static_cast<ButtonHandle>(buttonNames.size());
+    buttonNames.push_back(button.name);
+
+    // Lookups by name find the first button added under it
+    buttonIndex.emplace(button.name, index);
+    if (index % LANES_PER_WORD == 0) {
+        words.push_back(InputWord());
+        wordIsActive.push_back(0);
+    }
+
+    InputWord& word = words[index / LANES_PER_WORD];
+    uint64_t bit = 1ULL << (index % LANES_PER_WORD);
+
+    // Encode the enum into the two state planes
+    bool debounce = button.state == ButtonState::DEBOUNCE;
+    bool pressed = button.state == ButtonState::PRESSED;
+    bool released = button.state == ButtonState::RELEASED;
+
+    word.enable |= button.enable ? bit : 0;
+    word.input |= button.inputState ? bit : 0;
+    word.state0 |= (debounce || released) ? bit : 0;
+    word.state1 |= (pressed || released) ? bit : 0;
+    word.count0 |= (button.debounceCount & 1) ? bit : 0;
+    word.count1 |= (button.debounceCount & 2) ? bit : 0;
+    word.count2 |= (button.debounceCount & 4) ? bit : 0;
+
+    if (button.enable && pressed) {
+        pressedTotal++;
+    }
+    markActive(index / LANES_PER_WORD);
+
+    return index;
+}
+
+ButtonHandle IO::getButtonHandle(const string& buttonName) const
+{
+    auto it = buttonIndex.find(buttonName);
+    return it != buttonIndex.end() ? it->second : INVALID_BUTTON;
 }
 
 void IO::pollButtons(bool inputState)
 {
-    for (Button& button : buttons) {
-        if (button.enable) {
-            updateButtonState(button, inputState);
-        }
+    // Every button sees the same input, so every word is stepped
+    pressedCount += pressedTotal;
+    for (size_t i = 0; i < words.size(); ++i) {
+        stepWord(words[i], inputState ? ~0ULL : 0, ~0ULL);
+        markActive(static_cast<int>(i));
     }
 }
 
 void IO::pollButtonsWithStates()
 {
-    for (Button& button : buttons) {
-        if (button.enable) {
-            updateButtonState(button, button.inputState);
+    // Buttons held in PRESSED are counted without visiting their words
+    pressedCount += pressedTotal;
+
+    size_t i = 0;
+    while (i < activeWords.size()) {
+        int wordIndex = activeWords[i];
+        InputWord& word = words[wordIndex];
+        stepWord(word, word.input, ~0ULL);
+
+        if (activeLanes(word) != 0) {
+            ++i;
+        } else {
+            // Settled, swap it out of the list
+            wordIsActive[wordIndex] = 0;
+            activeWords[i] = activeWords.back();
+            activeWords.pop_back();
         }
     }
 }
 
-void IO::setButtonPressed(string buttonName, bool pressed)
+uint64_t IO::activeLanes(const InputWord& word)
 {
-    Button* button = findButton(buttonName);
-    if (button && button->enable) {
-        // Set the input state that the button "sees"
-        button->inputState = pressed;
-        // Optionally trigger immediate state update
-        updateButtonState(*button, pressed);
+    uint64_t idle = ~word.state1 & ~word.state0;
+    uint64_t debounce = ~word.state1 & word.state0;
+    uint64_t pressed = word.state1 & ~word.state0;
+
+    // Lanes the next poll would change
+    return word.enable & (debounce | (idle & word.input) | (pressed & ~word.input));
+}
+
+void IO::markActive(int wordIndex)
+{
+    if (!wordIsActive[wordIndex]) {
+        wordIsActive[wordIndex] = 1;
+        activeWords.push_back(wordIndex);
     }
 }
 
-bool IO::isButtonPressed(string buttonName) const
+void IO::setButtonPressed(const string& buttonName, bool pressed)
+{
+    setButtonPressed(getButtonHandle(buttonName), pressed);
+}
+
+void IO::setButtonPressed(ButtonHandle index, bool pressed)
 {
-    for (const Button& button : buttons) {
-        if (button.name == buttonName) {
-            return button.state == ButtonState::PRESSED;
+    if (!isValid(index)) {
+        return;
+    }
+
+    InputWord& word = words[index / LANES_PER_WORD];
+    uint64_t bit = 1ULL << (index % LANES_PER_WORD);
+    if (word.enable & bit) {
+        if (word.state1 & ~word.state0 & bit) {
+            pressedCount++;
         }
+
+        // Set the input state that the button "sees"
+        word.input = pressed ? (word.input | bit) : (word.input & ~bit);
+        // Optionally trigger immediate state update
+        stepWord(word, word.input, bit);
+        markActive(index / LANES_PER_WORD);
     }
-    return false;
 }
 
-void IO::resetButton(string buttonName)
+bool IO::isButtonPressed(const string& buttonName) const
+{
+    return isButtonPressed(getButtonHandle(buttonName));
+}
+
+bool IO::isButtonPressed(ButtonHandle button) const
+{
+    return getButtonState(button) == ButtonState::PRESSED;
+}
+
+ButtonState IO::getButtonState(const string& buttonName) const
+{
+    return getButtonState(getButtonHandle(buttonName));
+}
+
+ButtonState IO::getButtonState(ButtonHandle index) const
 {
-    Button* button = findButton(buttonName);
-    if (button) {
-        button->state = ButtonState::IDLE;
-        button->inputState = false;
-        button->debounceCount = 0;
+    if (!isValid(index)) {
+        return ButtonState::IDLE;
     }
+    return decodeState(words[index / LANES_PER_WORD], index % LANES_PER_WORD);
 }
 
-bool IO::getButtonInputState(string buttonName) const
+void IO::resetButton(const string& buttonName)
 {
-    for (const Button& button : buttons) {
-        if (button.name == buttonName) {
-            return button.inputState;
+    resetButton(getButtonHandle(buttonName));
+}
+
+void IO::resetButton(ButtonHandle index)
+{
+    if (isValid(index)) {
+        InputWord& word = words[index / LANES_PER_WORD];
+        uint64_t bit = 1ULL << (index % LANES_PER_WORD);
+        uint64_t keep = ~bit;
+        if (word.enable & word.state1 & ~word.state0 & bit) {
+            pressedTotal--;
         }
+        word.input &= keep;
+        word.state0 &= keep;
+        word.state1 &= keep;
+        word.count0 &= keep;
+        word.count1 &= keep;
+        word.count2 &= keep;
+    }
+}
+
+bool IO::getButtonInputState(const string& buttonName) const
+{
+    return getButtonInputState(getButtonHandle(buttonName));
+}
+
+bool IO::getButtonInputState(ButtonHandle index) const
+{
+    if (isValid(index)) {
+        return (words[index / LANES_PER_WORD].input >> (index % LANES_PER_WORD)) & 1;
     }
 
     // Default to false if button not found
     return false;
 }
 
-Button* IO::findButton(string buttonName)
+uint64_t IO::getPressedBits(ButtonHandle first, int count) const
 {
-    for (Button& button : buttons) {
-        if (button.name == buttonName) {
-            return &button;
+    if (first < 0 || count <= 0) {
+        return 0;
+    }
+    count = std::min(count, LANES_PER_WORD);
+
+    uint64_t bits = 0;
+    int collected = 0;
+    int index = first;
+
+    // At most two words are involved when the range straddles a boundary
+    while (collected < count && index < static_cast<int>(buttonNames.size())) {
+        const InputWord& word = words[index / LANES_PER_WORD];
+        int lane = index % LANES_PER_WORD;
+        int take = std::min(count - collected, LANES_PER_WORD - lane);
+
+        uint64_t pressed = (word.enable & word.state1 & ~word.state0) >> lane;
+        if (take < LANES_PER_WORD) {
+            pressed &= (1ULL << take) - 1;
         }
+        bits |= pressed << collected;
+
+        collected += take;
+        index += take;
     }
-    return nullptr;
-}
-
-void IO::updateButtonState(Button& button, bool inputState)
-{
-    switch (button.state) {
-        case ButtonState::IDLE:
-            if (inputState) {
-                button.state = ButtonState::DEBOUNCE;
-                button.debounceCount = 1;
-            }
-
-            // cout << "Button " << button.name << " is in IDLE state. \n";
-            break;
-            
-        case ButtonState::DEBOUNCE:
-            if (inputState) {
-                button.debounceCount++;
-                // Directly compare with static threshold in Button class 
-                if (button.debounceCount >= Button::DEBOUNCE_THRESHOLD) {
-                    button.state = ButtonState::PRESSED;
-                    button.debounceCount = 0;
-                }
-            } else {
-                // Input went low during debounce, go back to idle
-                button.state = ButtonState::IDLE;
-                button.debounceCount = 0;
-            }
-
-            // cout << "Button " << button.name << " is in DEBOUNCE state. \n";
-            // cout << "Debounce count: " << button.debounceCount << endl;
-            // cout << "Leaving debounce state (y/n)?" << inputState << endl;
-            break;
-            
-        case ButtonState::PRESSED:
-            if (!inputState) {
-                button.state = ButtonState::RELEASED;
-            }
-            pressedCount++;
-            // cout << "Button " << button.name << " is in PRESSED state. \n";
-            break;
-            
-        case ButtonState::RELEASED:
-            // Stay in released state until explicitly reset
-            // This allows the system to detect the release event
-            // cout << "Button " << button.name << " is in RELEASED state. \n";
-            break;
+
+    // Lanes past the last added button are never pressed
+    if (count < LANES_PER_WORD) {
+        bits &= (1ULL << count) - 1;
     }
+    return bits;
+}
+
+vector<Button> IO::getButtons() const
+{
+    vector<Button> buttons;
+    buttons.reserve(buttonNames.size());
+
+    for (size_t i = 0; i < buttonNames.size(); ++i) {
+        const InputWord& word = words[i / LANES_PER_WORD];
+        int lane = static_cast<int>(i % LANES_PER_WORD);
+
+        Button button(buttonNames[i]);
+        button.state = decodeState(word, lane);
+        button.enable = (word.enable >> lane) & 1;
+        button.inputState = (word.input >> lane) & 1;
+        button.debounceCount = static_cast<int>(((word.count0 >> lane) & 1) |
+                                                (((word.count1 >> lane) & 1) << 1) |
+                                                (((word.count2 >> lane) & 1) << 2));
+        buttons.push_back(button);
+    }
+
+    return buttons;
+}
+
+ButtonState IO::decodeState(const InputWord& word, int lane)
+{
+    bool s0 = (word.state0 >> lane) & 1;
+    bool s1 = (word.state1 >> lane) & 1;
+
+    if (s1) {
+        return s0 ? ButtonState::RELEASED : ButtonState::PRESSED;
+    }
+    return s0 ? ButtonState::DEBOUNCE : ButtonState::IDLE;
+}
+
+void IO::stepWord(InputWord& word, uint64_t inputs, uint64_t lanes)
+{
+    // The same state machine as before, one bit per button:
+    //   IDLE      input high -> DEBOUNCE with count 1
+    //   DEBOUNCE  input high -> count + 1, PRESSED once it hits the threshold
+    //             input low  -> IDLE
+    //   PRESSED   input low  -> RELEASED (callers count it in pressedCount)
+    //   RELEASED  stays until reset
+    uint64_t active = word.enable & lanes;
+    uint64_t high = inputs & active;
+    uint64_t low = ~inputs & active;
+
+    uint64_t idle = ~word.state1 & ~word.state0;
+    uint64_t debounce = ~word.state1 & word.state0;
+    uint64_t pressed = word.state1 & ~word.state0;
+
+    // Ripple-carry increment of the vertical counter for debouncing lanes
+    uint64_t carry = debounce & high;
+    uint64_t count0 = word.count0 ^ carry;
+    carry &= word.count0;
+    uint64_t count1 = word.count1 ^ carry;
+    carry &= word.count1;
+    uint64_t count2 = word.count2 ^ carry;
+
+    // count >= threshold, compared a bit at a time from the top
+    uint64_t atLeast = 0;
+    uint64_t equal = ~0ULL;
+    const uint64_t planes[3] = {count0, count1, count2};
+    for (int bit = 2; bit >= 0; --bit) {
+        if ((Button::DEBOUNCE_THRESHOLD >> bit) & 1) {
+            equal &= planes[bit];
+        } else {
+            atLeast |= equal & planes[bit];
+            equal &= ~planes[bit];
+        }
+    }
+    atLeast |= equal;
+
+    uint64_t toDebounce = idle & high;
+    uint64_t toIdle = debounce & low;
+    uint64_t toPressed = debounce & high & atLeast;
+    uint64_t toReleased = pressed & low;
+
+    word.state1 |= toPressed;
+    word.state0 = (word.state0 & ~(toIdle | toPressed)) | toDebounce | toReleased;
+
+    pressedTotal += __builtin_popcountll(toPressed) - __builtin_popcountll(toReleased);
+
+    uint64_t clear = toIdle | toPressed;
+    word.count0 = (count0 & ~clear) | toDebounce;
+    word.count1 = count1 & ~clear;
+    word.count2 = count2 & ~clear;
 }
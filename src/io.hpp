@@ -3,6 +3,9 @@
 
 #include <iostream>
 #include <vector>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
 using namespace std;
 
 enum class ButtonState {
@@ -28,6 +31,24 @@ public:
     Button(string n) : name(n), state(ButtonState::IDLE), enable(true), debounceCount(0), inputState(false) {}
 };
 
+// Buttons are stored bit-sliced: each group of 64 buttons shares one
+// InputWord, where every field is a bit plane with one bit per button.
+// The debounce state machine and counter are evaluated with plain logic
+// ops on whole planes, so one poll steps 64 buttons at once. State is
+// encoded in two planes (IDLE=00, DEBOUNCE=01, PRESSED=10, RELEASED=11)
+// and the debounce count in three vertical counter planes.
+//
+// Polling only visits words on the active list: words with a lane that is
+// debouncing or whose input disagrees with its settled state. Input changes
+// put a word on the list and it drops off once every lane has settled, so
+// a poll costs O(active words) however many buttons exist.
+
+// Buttons are identified by the handle addButton returns, so per-tick code
+// never touches strings. Names resolve to handles through a hash index and
+// the name-based overloads are kept for the CLI.
+typedef int ButtonHandle;
+const ButtonHandle INVALID_BUTTON = -1;
+
 class IO
 {
     public:
@@ -36,29 +57,61 @@ class IO
         ~IO();
         int pressedCount = 0;
 
-        void addButton(Button button);
+        ButtonHandle addButton(Button button);
+        ButtonHandle getButtonHandle(const string& buttonName) const;
         void pollButtons(bool inputState);
-        void setButtonPressed(string buttonName, bool pressed);
-        bool isButtonPressed(string buttonName) const;
+        void setButtonPressed(ButtonHandle button, bool pressed);
+        void setButtonPressed(const string& buttonName, bool pressed);
+        bool isButtonPressed(ButtonHandle button) const;
+        bool isButtonPressed(const string& buttonName) const;
         
         // New method to poll using actual button input states
         void pollButtonsWithStates();
         
         // Additional control methods
-        void resetButton(string buttonName);
-        bool getButtonInputState(string buttonName) const;
+        void resetButton(ButtonHandle button);
+        void resetButton(const string& buttonName);
+        bool getButtonInputState(ButtonHandle button) const;
+        bool getButtonInputState(const string& buttonName) const;
+        
+        // Per-button queries, decoded from the packed planes
+        ButtonState getButtonState(ButtonHandle button) const;
+        ButtonState getButtonState(const string& buttonName) const;
+        size_t getButtonCount() const { return buttonNames.size(); }
         
-        // Getter for status reporting
-        const vector<Button>& getButtons() const { return buttons; }
+        // PRESSED flags of count (<= 64) consecutive buttons from first, one
+        // bit each, read straight from the packed planes
+        uint64_t getPressedBits(ButtonHandle first, int count) const;
+        
+        // Snapshot for status reporting
+        vector<Button> getButtons() const;
 
     private:
+        struct InputWord {
+            uint64_t input = 0;
+            uint64_t enable = 0;
+            uint64_t state0 = 0;
+            uint64_t state1 = 0;
+            uint64_t count0 = 0;
+            uint64_t count1 = 0;
+            uint64_t count2 = 0;
+        };
+
         string name;
         bool enable;
-        vector<Button> buttons;
+        vector<string> buttonNames;
+        unordered_map<string, ButtonHandle> buttonIndex;
+        vector<InputWord> words;
+        vector<int> activeWords;
+        vector<char> wordIsActive;
+        int pressedTotal = 0;   // enabled buttons in PRESSED
         
         // Helper functions
-        Button* findButton(string buttonName);
-        void updateButtonState(Button& button, bool inputState);
+        bool isValid(ButtonHandle button) const { return button >= 0 && button < static_cast<int>(buttonNames.size()); }
+        void stepWord(InputWord& word, uint64_t inputs, uint64_t lanes);
+        static ButtonState decodeState(const InputWord& word, int lane);
+        static uint64_t activeLanes(const InputWord& word);
+        void markActive(int wordIndex);
 
 };
 
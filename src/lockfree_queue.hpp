@@ -0,0 +1,114 @@
+#ifndef LOCKFREE_QUEUE_HPP
+#define LOCKFREE_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded multi-producer multi-consumer queue (Vyukov's ring design).
+//
+// Every cell carries a sequence number that tells producers and consumers
+// whether it is free to write or ready to read, so a push or pop is one CAS
+// on the shared position plus one store on the cell. No locks are taken and
+// nothing is allocated after construction. Capacity is rounded up to a power
+// of two; tryPush() fails instead of blocking when the ring is full.
+
+template <typename T>
+class LockFreeQueue
+{
+    public:
+        explicit LockFreeQueue(size_t capacity)
+        {
+            size_t size = 2;
+            while (size < capacity) {
+                size <<= 1;
+            }
+
+            mask = size - 1;
+            cells.reset(new Cell[size]);
+            for (size_t i = 0; i < size; ++i) {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        LockFreeQueue(const LockFreeQueue&) = delete;
+        LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+        bool tryPush(T value)
+        {
+            size_t pos = enqueuePos.load(std::memory_order_relaxed);
+            Cell* cell;
+
+            while (true) {
+                cell = &cells[pos & mask];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+                if (diff == 0) {
+                    if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false;   // Full
+                } else {
+                    pos = enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+
+            cell->value = std::move(value);
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool tryPop(T& value)
+        {
+            size_t pos = dequeuePos.load(std::memory_order_relaxed);
+            Cell* cell;
+
+            while (true) {
+                cell = &cells[pos & mask];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+
+                if (diff == 0) {
+                    if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false;   // Empty
+                } else {
+                    pos = dequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+
+            value = std::move(cell->value);
+            cell->sequence.store(pos + mask + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Only a hint while other threads are pushing or popping
+        bool empty() const
+        {
+            size_t pos = dequeuePos.load(std::memory_order_relaxed);
+            size_t sequence = cells[pos & mask].sequence.load(std::memory_order_acquire);
+            return static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1) < 0;
+        }
+
+        size_t capacity() const {return mask + 1; }
+
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        // Producers and consumers each get their own cache line
+        std::unique_ptr<Cell[]> cells;
+        size_t mask = 0;
+        alignas(64) std::atomic<size_t> enqueuePos{0};
+        alignas(64) std::atomic<size_t> dequeuePos{0};
+};
+
+#endif
@@ -1,4 +1,7 @@
 #include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cerrno>
 #include <signal.h>
 #include <execinfo.h>
 #include <unistd.h>
@@ -33,7 +36,18 @@ void cleanup_handler(int sig) {
     exit(0);
 }
 
-int main() {
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [--headless] [--speed <ratio|max>] [--cycles <n>] [--stimulus <file>] [--trace <file>] [--flash <file>] [--firmware <file.so>]\n"
+              << "  --headless        Run without the display or CLI\n"
+              << "  --speed <ratio>   Simulated-to-real-time ratio, e.g. 1, 10 or max\n"
+              << "  --cycles <n>      Stop a headless run after n clock cycles\n"
+              << "  --stimulus <file> Replay a binary stimulus file into the buttons\n"
+              << "  --trace <file>    Write a VCD waveform of the run\n"
+              << "  --flash <file>    Load a raw firmware image into flash at 0x08000000\n"
+              << "  --firmware <file.so> Run host-compiled firmware built against src/embedsim_hal.h\n";
+}
+
+int main(int argc, char* argv[]) {
     // Set up signal handlers for segmentation faults and cleanup
     signal(SIGSEGV, segfault_handler);
     signal(SIGINT, cleanup_handler);   // Ctrl+C
@@ -41,8 +55,65 @@ int main() {
     
     std::cout << "DEBUG: Starting main()" << std::endl;
     
-    System system;
+    bool headless = false;
+    double speedRatio = 1.0;
+    long long cycleLimit = 0;
+    std::string stimulusPath;
+    std::string tracePath;
+    std::string flashPath;
+    std::string firmwarePath;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--headless") {
+            headless = true;
+        }
+        else if (arg == "--speed" && i + 1 < argc) {
+            std::string value = argv[++i];
+            if (!System::parseSpeedRatio(value, speedRatio)) {
+                std::cerr << "Invalid speed: " << value << "\n";
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (arg == "--cycles" && i + 1 < argc) {
+            // Whole positive numbers only; anything else would never stop the run
+            const char* value = argv[++i];
+            char* end = nullptr;
+            errno = 0;
+            cycleLimit = std::strtoll(value, &end, 10);
+            if (end == value || *end != '\0' || errno == ERANGE || cycleLimit <= 0) {
+                std::cerr << "Invalid cycle count: " << value << "\n";
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (arg == "--stimulus" && i + 1 < argc) {
+            stimulusPath = argv[++i];
+        }
+        else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        }
+        else if (arg == "--flash" && i + 1 < argc) {
+            flashPath = argv[++i];
+        }
+        else if (arg == "--firmware" && i + 1 < argc) {
+            firmwarePath = argv[++i];
+        }
+        else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    System system(headless);
     g_system = &system;  // Store for cleanup
+    system.setSpeedRatio(speedRatio);
+    system.setHeadlessCycleLimit(cycleLimit);
+    system.setStimulusFile(stimulusPath);
+    system.setTraceFile(tracePath);
+    system.setFlashFile(flashPath);
+    system.setFirmwareLibrary(firmwarePath);
     std::cout << "DEBUG: System object created" << std::endl;
     
     system.run();
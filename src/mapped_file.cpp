@@ -0,0 +1,91 @@
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile() {}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+    if (this != &other) {
+        close();
+        data = other.data;
+        size = other.size;
+        opened = other.opened;
+        path = std::move(other.path);
+        other.data = nullptr;
+        other.size = 0;
+        other.opened = false;
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string& filePath, std::string& error)
+{
+    close();
+
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = filePath + ": " + std::strerror(errno);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        error = filePath + ": " + std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    size_t length = static_cast<size_t>(info.st_size);
+    void* mapping = nullptr;
+
+    // mmap rejects zero-length mappings, an empty file simply has no data
+    if (length > 0) {
+        mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            error = filePath + ": " + std::strerror(errno);
+            ::close(fd);
+            return false;
+        }
+
+        // Records are consumed front to back
+        madvise(mapping, length, MADV_SEQUENTIAL);
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+
+    data = mapping;
+    size = length;
+    opened = true;
+    path = filePath;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data) {
+        munmap(data, size);
+    }
+    data = nullptr;
+    size = 0;
+    opened = false;
+    path.clear();
+}
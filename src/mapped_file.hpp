@@ -0,0 +1,37 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. The mapping is released when
+// the object is destroyed or another file is opened; moving transfers it.
+
+class MappedFile
+{
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other);
+        MappedFile& operator=(MappedFile&& other);
+
+        // On failure returns false and describes why in error
+        bool open(const std::string& path, std::string& error);
+        void close();
+
+        bool isOpen() const {return opened; }
+        const unsigned char* getData() const {return static_cast<const unsigned char*>(data); }
+        size_t getSize() const {return size; }
+        const std::string& getPath() const {return path; }
+
+    private:
+        void* data = nullptr;
+        size_t size = 0;
+        bool opened = false;
+        std::string path;
+};
+
+#endif
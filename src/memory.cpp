@@ -0,0 +1,173 @@
+#include "memory.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t pageRound(size_t bytes)
+{
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return (bytes + page - 1) / page * page;
+}
+
+MemoryArena::MemoryArena() {}
+
+MemoryArena::~MemoryArena()
+{
+    if (base) {
+        munmap(base, size);
+    }
+}
+
+bool MemoryArena::reserve(size_t bytes, std::string& error)
+{
+    if (base) {
+        error = "memory arena already reserved";
+        return false;
+    }
+
+    size_t length = pageRound(bytes);
+    void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        error = std::string("cannot reserve memory arena: ") + std::strerror(errno);
+        return false;
+    }
+
+    base = static_cast<uint8_t*>(mapping);
+    size = length;
+    used = 0;
+    return true;
+}
+
+uint8_t* MemoryArena::allocate(size_t bytes)
+{
+    size_t length = pageRound(bytes);
+    if (!base || length > size - used) {
+        return nullptr;
+    }
+
+    uint8_t* block = base + used;
+    used += length;
+    return block;
+}
+
+FlashImage::FlashImage() {}
+
+FlashImage::~FlashImage()
+{
+    if (base) {
+        munmap(base, size);
+    }
+}
+
+bool FlashImage::reserve(size_t bytes, std::string& error)
+{
+    if (base) {
+        error = "flash already reserved";
+        return false;
+    }
+
+    size_t length = pageRound(bytes);
+    void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        error = std::string("cannot reserve flash: ") + std::strerror(errno);
+        return false;
+    }
+
+    base = static_cast<uint8_t*>(mapping);
+    size = length;
+    std::memset(base, 0xFF, size);
+    return true;
+}
+
+// Anonymous pages over [from, to), filled with the erased value. On
+// failure the old pages, file-backed or not, are still there.
+bool FlashImage::erase(size_t from, size_t to, std::string& error)
+{
+    if (from >= to) {
+        return true;
+    }
+    void* mapping = mmap(base + from, to - from, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    if (mapping == MAP_FAILED) {
+        error = std::string("cannot erase flash: ") + std::strerror(errno);
+        return false;
+    }
+    std::memset(base + from, 0xFF, to - from);
+    return true;
+}
+
+bool FlashImage::load(const std::string& filePath, std::string& error)
+{
+    if (!base) {
+        error = "flash not reserved";
+        return false;
+    }
+
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = filePath + ": " + std::strerror(errno);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        error = filePath + ": " + std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    size_t length = static_cast<size_t>(info.st_size);
+    if (length > size) {
+        error = filePath + ": image is " + std::to_string(length) + " bytes, flash holds " + std::to_string(size);
+        ::close(fd);
+        return false;
+    }
+
+    // Replaces the old contents in place; MAP_PRIVATE makes writes land in
+    // private copies of the pages rather than in the file
+    size_t end = pageRound(length);
+    if (length > 0) {
+        void* mapping = mmap(base, end, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            error = filePath + ": " + std::strerror(errno);
+            ::close(fd);
+            return false;
+        }
+    }
+    ::close(fd);
+
+    // Past the end of the file reads as erased, including any leftovers
+    // from a longer image loaded before
+    std::memset(base + length, 0xFF, std::min(end, size) - length);
+    imageSize = length;
+    path = filePath;
+    if (!erase(end, mappedEnd, error)) {
+        // The new image is in place but the tail of the old one is too;
+        // keep it counted so a later erase covers it
+        error = filePath + ": " + error;
+        mappedEnd = std::max(end, mappedEnd);
+        return false;
+    }
+    mappedEnd = end;
+    return true;
+}
+
+bool FlashImage::unload(std::string& error)
+{
+    if (!base) {
+        return true;
+    }
+
+    if (!erase(0, mappedEnd, error)) {
+        return false;
+    }
+    imageSize = 0;
+    mappedEnd = 0;
+    path.clear();
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Backing storage for the memory regions on the bus.
+
+// One contiguous block of anonymous memory that SRAM regions are carved
+// from. Pages are zero and only become resident when first touched.
+class MemoryArena
+{
+    public:
+        MemoryArena();
+        ~MemoryArena();
+
+        MemoryArena(const MemoryArena&) = delete;
+        MemoryArena& operator=(const MemoryArena&) = delete;
+
+        bool reserve(size_t size, std::string& error);
+
+        // Page-aligned; returns nullptr once the arena is used up
+        uint8_t* allocate(size_t size);
+
+        size_t getSize() const {return size; }
+        size_t getUsed() const {return used; }
+
+    private:
+        uint8_t* base = nullptr;
+        size_t size = 0;
+        size_t used = 0;
+};
+
+// Flash contents at a fixed host address. The whole flash is reserved up
+// front and reads as erased (0xFF); loading an image maps the file over the
+// start of it, copy-on-write, so start-up costs nothing per byte and
+// nothing written through the mapping ever reaches the file. Because the
+// host address never changes, bus pages pointing at flash stay valid
+// across loads.
+class FlashImage
+{
+    public:
+        FlashImage();
+        ~FlashImage();
+
+        FlashImage(const FlashImage&) = delete;
+        FlashImage& operator=(const FlashImage&) = delete;
+
+        bool reserve(size_t size, std::string& error);
+        bool load(const std::string& path, std::string& error);
+        bool unload(std::string& error);
+
+        uint8_t* getData() {return base; }
+        size_t getSize() const {return size; }
+        size_t getImageSize() const {return imageSize; }
+        const std::string& getPath() const {return path; }
+
+    private:
+        uint8_t* base = nullptr;
+        size_t size = 0;
+        size_t imageSize = 0;
+        size_t mappedEnd = 0;   // page-rounded end of the file mapping
+        std::string path;
+
+        bool erase(size_t from, size_t to, std::string& error);
+};
+
+#endif
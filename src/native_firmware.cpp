@@ -0,0 +1,382 @@
+#include "native_firmware.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+#include <dlfcn.h>
+
+const int NativeFirmware::UNLOAD_TIMEOUT_MS;
+
+// Exported ISR names, by line; unnamed lines are reserved
+static const char* const ISR_SYMBOLS[EMBEDSIM_IRQ_LINES] = {
+    "embedsim_isr_gpioa", "embedsim_isr_uart0", "embedsim_isr_adc1", "embedsim_isr_spi1",
+    "embedsim_isr_i2c1", nullptr, nullptr, nullptr,
+    "embedsim_isr_timer0", "embedsim_isr_timer1", "embedsim_isr_timer2", "embedsim_isr_timer3",
+    nullptr, nullptr, nullptr, nullptr
+};
+
+NativeFirmware::NativeFirmware(Clock& clock, GpioPort& gpio, Adc& adc)
+    : clock(clock), gpio(gpio), adc(adc), hal(new embedsim_hal())
+{
+    for (int line = 0; line < EMBEDSIM_IRQ_LINES; ++line) {
+        isrs[line].store(nullptr);
+    }
+    for (int timer = 0; timer < EMBEDSIM_TIMERS; ++timer) {
+        timers[timer] = TimingWheel::INVALID_HANDLE;
+    }
+
+    hal->version = EMBEDSIM_HAL_VERSION;
+    hal->context = this;
+    hal->gpio_read = &NativeFirmware::halGpioRead;
+    hal->gpio_write = &NativeFirmware::halGpioWrite;
+    hal->gpio_take_edges = &NativeFirmware::halGpioTakeEdges;
+    hal->cycles = &NativeFirmware::halCycles;
+    hal->time_ns = &NativeFirmware::halTimeNs;
+    hal->timer_arm = &NativeFirmware::halTimerArm;
+    hal->timer_cancel = &NativeFirmware::halTimerCancel;
+    hal->irq_register = &NativeFirmware::halIrqRegister;
+    hal->irq_set_enabled = &NativeFirmware::halIrqSetEnabled;
+    hal->wait_for_interrupt = &NativeFirmware::halWaitForInterrupt;
+    hal->adc_read = &NativeFirmware::halAdcRead;
+    hal->stop_requested = &NativeFirmware::halStopRequested;
+}
+
+NativeFirmware::~NativeFirmware()
+{
+    std::string error;
+    if (unload(error)) {
+        return;
+    }
+
+    // Nothing can make the thread return, so cut it off from this object.
+    // Its next HAL call parks for good; one that never comes finds the
+    // table, which outlives us, without a context and parks all the same.
+    std::cout << error << ", abandoning it\n";
+    {
+        std::unique_lock<std::mutex> lock(waitMutex);
+        abandoned = true;
+        exited.wait_for(lock, std::chrono::milliseconds(UNLOAD_TIMEOUT_MS), [this]() {
+            return parked || !running.load();
+        });
+    }
+    if (!running.load() && unload(error)) {
+        return;
+    }
+    hal->context = nullptr;
+    hal.release();
+    thread.detach();
+}
+
+bool NativeFirmware::load(const std::string& file, std::string& error)
+{
+    if (handle) {
+        error = "firmware already loaded from " + path;
+        return false;
+    }
+
+    void* library = dlopen(file.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        const char* reason = dlerror();
+        error = reason ? reason : file + ": cannot load";
+        return false;
+    }
+
+    void* symbol = dlsym(library, "embedsim_main");
+    if (!symbol) {
+        error = file + ": no embedsim_main";
+        dlclose(library);
+        return false;
+    }
+    entry = reinterpret_cast<embedsim_main_fn>(symbol);
+
+    for (int line = 0; line < EMBEDSIM_IRQ_LINES; ++line) {
+        void* isr = ISR_SYMBOLS[line] ? dlsym(library, ISR_SYMBOLS[line]) : nullptr;
+        isrs[line].store(reinterpret_cast<embedsim_isr>(isr));
+    }
+
+    handle = library;
+    path = file;
+    pending.store(0);
+    delivered.store(0);
+    dropped.store(0);
+    exitCode.store(0);
+    stopping.store(false);
+    interruptsEnabled = true;
+    inInterrupt = false;
+
+    running.store(true);
+    thread = std::thread(&NativeFirmware::threadMain, this);
+    return true;
+}
+
+bool NativeFirmware::unload(std::string& error)
+{
+    if (!handle) {
+        return true;
+    }
+
+    stopping.store(true);
+    {
+        std::unique_lock<std::mutex> lock(waitMutex);
+        wake.notify_all();
+        bool returned = exited.wait_for(lock, std::chrono::milliseconds(UNLOAD_TIMEOUT_MS), [this]() {
+            return !running.load();
+        });
+        if (!returned) {
+            error = path + ": embedsim_main did not return within " + std::to_string(UNLOAD_TIMEOUT_MS) + " ms";
+            return false;
+        }
+    }
+    thread.join();
+
+    for (int line = 0; line < EMBEDSIM_IRQ_LINES; ++line) {
+        isrs[line].store(nullptr);
+    }
+    dlclose(handle);
+    handle = nullptr;
+    entry = nullptr;
+    path.clear();
+    return true;
+}
+
+void NativeFirmware::threadMain()
+{
+    exitCode.store(entry(hal.get()));
+    cancelTimers();
+
+    std::lock_guard<std::mutex> lock(waitMutex);
+    running.store(false);
+    exited.notify_all();
+}
+
+void NativeFirmware::raiseInterrupt(int line)
+{
+    if (line < 0 || line >= EMBEDSIM_IRQ_LINES) {
+        return;
+    }
+    pending.fetch_or(1u << line);
+    if (waiting.load()) {
+        std::lock_guard<std::mutex> lock(waitMutex);
+        wake.notify_one();
+    }
+}
+
+// Firmware thread only. Lowest line first; lines raised while an ISR runs
+// are picked up by the next pass.
+void NativeFirmware::deliverInterrupts()
+{
+    if (!interruptsEnabled || inInterrupt) {
+        return;
+    }
+
+    uint32_t lines;
+    while ((lines = pending.exchange(0)) != 0) {
+        for (int line = 0; lines != 0; ++line, lines >>= 1) {
+            if ((lines & 1) == 0) {
+                continue;
+            }
+            // An ISR that disabled interrupts leaves the rest pending
+            if (!interruptsEnabled) {
+                pending.fetch_or(lines << line);
+                return;
+            }
+            embedsim_isr isr = isrs[line].load();
+            if (!isr) {
+                dropped++;
+                continue;
+            }
+            inInterrupt = true;
+            isr();
+            inInterrupt = false;
+            delivered++;
+        }
+    }
+}
+
+void NativeFirmware::cancelTimers()
+{
+    for (int timer = 0; timer < EMBEDSIM_TIMERS; ++timer) {
+        if (timers[timer] != TimingWheel::INVALID_HANDLE) {
+            clock.cancelTimer(timers[timer]);
+            timers[timer] = TimingWheel::INVALID_HANDLE;
+        }
+    }
+}
+
+std::string NativeFirmware::describe() const
+{
+    std::ostringstream oss;
+    if (!handle) {
+        return "Native firmware: none loaded";
+    }
+
+    oss << "Native firmware: " << path << ", ";
+    if (running.load()) {
+        oss << (stopping.load() ? "asked to stop, still running" : "running");
+    } else {
+        oss << "embedsim_main returned " << exitCode.load();
+    }
+    oss << "\n" << delivered.load() << " interrupts delivered, " << dropped.load() << " dropped (no ISR); ISRs:";
+
+    bool any = false;
+    for (int line = 0; line < EMBEDSIM_IRQ_LINES; ++line) {
+        if (isrs[line].load()) {
+            oss << " " << line;
+            any = true;
+        }
+    }
+    if (!any) {
+        oss << " none";
+    }
+    return oss.str();
+}
+
+// HAL entry points. Each one takes any pending interrupt first, which is
+// what makes HAL calls the interrupt boundaries.
+
+NativeFirmware& NativeFirmware::owner(void* context)
+{
+    NativeFirmware* firmware = static_cast<NativeFirmware*>(context);
+    if (firmware && !firmware->abandoned.load(std::memory_order_relaxed)) {
+        return *firmware;
+    }
+
+    // Abandoned firmware stops here for good, touching nothing once the
+    // destructor knows
+    if (firmware) {
+        std::lock_guard<std::mutex> lock(firmware->waitMutex);
+        firmware->parked = true;
+        firmware->exited.notify_all();
+    }
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::hours(1));
+    }
+}
+
+NativeFirmware& NativeFirmware::self(void* context)
+{
+    NativeFirmware& firmware = owner(context);
+    if (firmware.pending.load(std::memory_order_relaxed) != 0) {
+        firmware.deliverInterrupts();
+    }
+    return firmware;
+}
+
+uint32_t NativeFirmware::halGpioRead(void* context)
+{
+    return self(context).gpio.readPins();
+}
+
+void NativeFirmware::halGpioWrite(void* context, uint32_t set, uint32_t reset)
+{
+    GpioPort& gpio = self(context).gpio;
+    if (set) {
+        gpio.setOutputs(set);
+    }
+    if (reset) {
+        gpio.resetOutputs(reset);
+    }
+}
+
+uint32_t NativeFirmware::halGpioTakeEdges(void* context)
+{
+    GpioPort& gpio = self(context).gpio;
+    uint32_t edges = gpio.getPending();
+    if (edges) {
+        gpio.writeRegister(GpioPort::PR, edges);
+    }
+    return edges;
+}
+
+uint64_t NativeFirmware::halCycles(void* context)
+{
+    return static_cast<uint64_t>(self(context).clock.getClockCycles());
+}
+
+uint64_t NativeFirmware::halTimeNs(void* context)
+{
+    return self(context).clock.getSimTimeNanoseconds();
+}
+
+int NativeFirmware::halTimerArm(void* context, unsigned timer, uint64_t delayCycles, uint64_t periodCycles)
+{
+    NativeFirmware& firmware = self(context);
+    if (timer >= EMBEDSIM_TIMERS) {
+        return 0;
+    }
+
+    if (firmware.timers[timer] != TimingWheel::INVALID_HANDLE) {
+        firmware.clock.cancelTimer(firmware.timers[timer]);
+    }
+    int line = EMBEDSIM_IRQ_TIMER0 + static_cast<int>(timer);
+    firmware.timers[timer] = firmware.clock.armTimer(static_cast<long long>(delayCycles),
+                                                     static_cast<long long>(periodCycles),
+                                                     [&firmware, line]() {
+        firmware.raiseInterrupt(line);
+    });
+    return firmware.timers[timer] != TimingWheel::INVALID_HANDLE;
+}
+
+void NativeFirmware::halTimerCancel(void* context, unsigned timer)
+{
+    NativeFirmware& firmware = self(context);
+    if (timer < EMBEDSIM_TIMERS && firmware.timers[timer] != TimingWheel::INVALID_HANDLE) {
+        firmware.clock.cancelTimer(firmware.timers[timer]);
+        firmware.timers[timer] = TimingWheel::INVALID_HANDLE;
+    }
+}
+
+int NativeFirmware::halIrqRegister(void* context, unsigned line, embedsim_isr isr)
+{
+    NativeFirmware& firmware = self(context);
+    if (line >= EMBEDSIM_IRQ_LINES) {
+        return 0;
+    }
+    firmware.isrs[line].store(isr);
+    return 1;
+}
+
+int NativeFirmware::halIrqSetEnabled(void* context, int enabled)
+{
+    NativeFirmware& firmware = owner(context);
+    int previous = firmware.interruptsEnabled ? 1 : 0;
+    firmware.interruptsEnabled = enabled != 0;
+    if (firmware.interruptsEnabled && firmware.pending.load(std::memory_order_relaxed) != 0) {
+        firmware.deliverInterrupts();
+    }
+    return previous;
+}
+
+int NativeFirmware::halWaitForInterrupt(void* context)
+{
+    NativeFirmware& firmware = self(context);
+    if (firmware.stopping.load()) {
+        return 0;
+    }
+
+    // Like WFI this wakes on a pending line even with interrupts disabled
+    if (firmware.pending.load() == 0) {
+        std::unique_lock<std::mutex> lock(firmware.waitMutex);
+        firmware.waiting.store(true);
+        firmware.wake.wait(lock, [&firmware]() {
+            return firmware.pending.load() != 0 || firmware.stopping.load();
+        });
+        firmware.waiting.store(false);
+    }
+
+    if (firmware.pending.load(std::memory_order_relaxed) != 0) {
+        firmware.deliverInterrupts();
+    }
+    return firmware.stopping.load() ? 0 : 1;
+}
+
+uint32_t NativeFirmware::halAdcRead(void* context)
+{
+    return self(context).adc.popResult();
+}
+
+int NativeFirmware::halStopRequested(void* context)
+{
+    return self(context).stopping.load() ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+#ifndef NATIVE_FIRMWARE_HPP
+#define NATIVE_FIRMWARE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "clock.hpp"
+#include "gpio.hpp"
+#include "adc.hpp"
+#include "embedsim_hal.h"
+
+// Runs firmware compiled for the host as a shared library, against the C
+// HAL in embedsim_hal.h.
+//
+// load() dlopens the library, resolves embedsim_main and any
+// embedsim_isr_<line> handlers once, and starts embedsim_main on a thread of
+// its own. The HAL table the firmware gets is filled with static functions
+// that go straight to the GPIO port, the ADC, the clock and this object's
+// interrupt lines, so a HAL call costs one indirect call.
+//
+// raiseInterrupt() is lock-free and may be called from any thread; it only
+// latches the line (and wakes the firmware if it is waiting). ISRs run on
+// the firmware thread at HAL call boundaries, see embedsim_hal.h.
+//
+// Firmware cannot be stopped from outside, only asked to return. unload()
+// waits UNLOAD_TIMEOUT_MS for that and otherwise leaves it loaded. If it
+// still has not returned when this object goes away, its thread is
+// abandoned: the library stays open and the next HAL call it makes never
+// returns.
+
+class NativeFirmware
+{
+    public:
+        static const int UNLOAD_TIMEOUT_MS = 1000;
+
+        NativeFirmware(Clock& clock, GpioPort& gpio, Adc& adc);
+        ~NativeFirmware();
+
+        NativeFirmware(const NativeFirmware&) = delete;
+        NativeFirmware& operator=(const NativeFirmware&) = delete;
+
+        // CLI or main thread. unload() asks embedsim_main to return and
+        // closes the library once it has; it fails, leaving the firmware
+        // loaded and asked to stop, if that takes longer than the timeout.
+        bool load(const std::string& path, std::string& error);
+        bool unload(std::string& error);
+        bool isLoaded() const {return handle != nullptr; }
+        bool isRunning() const {return running.load(); }
+
+        void raiseInterrupt(int line);
+        std::string describe() const;
+
+    private:
+        Clock& clock;
+        GpioPort& gpio;
+        Adc& adc;
+
+        void* handle = nullptr;
+        std::string path;
+        embedsim_main_fn entry = nullptr;
+        std::unique_ptr<embedsim_hal> hal;
+        std::thread thread;
+        std::atomic<bool> running{false};
+        std::atomic<bool> stopping{false};
+        std::atomic<int> exitCode{0};
+
+        // Interrupt lines
+        std::atomic<uint32_t> pending{0};
+        std::atomic<embedsim_isr> isrs[EMBEDSIM_IRQ_LINES];
+        std::atomic<uint64_t> delivered{0};
+        std::atomic<uint64_t> dropped{0};
+
+        // Firmware-thread state
+        bool interruptsEnabled = true;
+        bool inInterrupt = false;
+        Clock::TimerId timers[EMBEDSIM_TIMERS];
+
+        // Wake-up for wait_for_interrupt; raisers only take the lock when
+        // the firmware is actually asleep. exited is signalled when
+        // embedsim_main returns.
+        std::mutex waitMutex;
+        std::condition_variable wake;
+        std::condition_variable exited;
+        std::atomic<bool> waiting{false};
+
+        // Set by the destructor when the firmware would not return; the
+        // thread acknowledges from its next HAL call and parks there
+        std::atomic<bool> abandoned{false};
+        bool parked = false;
+
+        void threadMain();
+        void deliverInterrupts();
+        void cancelTimers();
+
+        static NativeFirmware& owner(void* context);
+        static NativeFirmware& self(void* context);
+        static uint32_t halGpioRead(void* context);
+        static void halGpioWrite(void* context, uint32_t set, uint32_t reset);
+        static uint32_t halGpioTakeEdges(void* context);
+        static uint64_t halCycles(void* context);
+        static uint64_t halTimeNs(void* context);
+        static int halTimerArm(void* context, unsigned timer, uint64_t delayCycles, uint64_t periodCycles);
+        static void halTimerCancel(void* context, unsigned timer);
+        static int halIrqRegister(void* context, unsigned line, embedsim_isr isr);
+        static int halIrqSetEnabled(void* context, int enabled);
+        static int halWaitForInterrupt(void* context);
+        static uint32_t halAdcRead(void* context);
+        static int halStopRequested(void* context);
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include "register.hpp"
+#include "bus.hpp"
+
+const uint8_t RegisterFile::PLAIN;
+const uint8_t RegisterFile::RESERVED;
+const size_t RegisterFile::MAX_HOOKED;
+
+RegisterFile::RegisterFile(const std::string& name, uint32_t size)
+    : name(name), size(size)
+{
+    uint32_t pages = (size + Bus::PAGE_MASK) >> Bus::PAGE_SHIFT;
+    storage.assign(static_cast<size_t>(pages > 0 ? pages : 1) << Bus::PAGE_SHIFT, 0);
+    slots.assign(storage.size(), RESERVED);
+}
+
+bool RegisterFile::define(const std::string& registerName, uint32_t offset, unsigned width, uint8_t slot)
+{
+    if ((width != 1 && width != 2 && width != 4) || (offset & (width - 1)) != 0 || offset + width > size) {
+        return false;
+    }
+    for (unsigned i = 0; i < width; ++i) {
+        if (slots[offset + i] != RESERVED) {
+            return false;
+        }
+    }
+
+    for (unsigned i = 0; i < width; ++i) {
+        slots[offset + i] = slot;
+    }
+    Info info;
+    info.name = registerName;
+    info.offset = offset;
+    info.width = width;
+    info.hooked = slot != PLAIN;
+    registers.push_back(info);
+    return true;
+}
+
+bool RegisterFile::addHooked(const std::string& registerName, uint32_t offset, unsigned width,
+                             ReadHook read, WriteHook write, uint32_t reset)
+{
+    if (hooks.size() >= MAX_HOOKED) {
+        return false;
+    }
+    if (!define(registerName, offset, width, static_cast<uint8_t>(hooks.size() + 1))) {
+        return false;
+    }
+
+    Hooks entry;
+    entry.offset = offset;
+    entry.width = width;
+    entry.read = std::move(read);
+    entry.write = std::move(write);
+    hooks.push_back(std::move(entry));
+    std::memcpy(&storage[offset], &reset, width);
+    return true;
+}
+
+bool RegisterFile::addReadOnly(const std::string& registerName, uint32_t offset, uint32_t value)
+{
+    return addHooked(registerName, offset, 4, ReadHook(), WriteHook(), value);
+}
+
+const RegisterFile::Info* RegisterFile::findRegister(const std::string& registerName) const
+{
+    for (const Info& info : registers) {
+        if (info.name == registerName) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+uint32_t RegisterFile::hookedValue(const Hooks& entry)
+{
+    if (entry.read) {
+        return entry.read();
+    }
+    uint32_t value = 0;
+    std::memcpy(&value, &storage[entry.offset], entry.width);
+    return value;
+}
+
+// Byte by byte, so an access can span several registers of any mix. Each
+// hook runs at most once per access.
+uint32_t RegisterFile::loadSlow(uint32_t offset, unsigned width)
+{
+    // The usual case: one access, exactly one hooked register
+    uint8_t first = slots[offset];
+    if (first != PLAIN && first != RESERVED && hooks[first - 1].offset == offset && hooks[first - 1].width == width) {
+        return hookedValue(hooks[first - 1]);
+    }
+
+    uint32_t result = 0;
+    uint8_t cachedSlot = RESERVED;
+    uint32_t cachedValue = 0;
+
+    for (unsigned i = 0; i < width; ++i) {
+        uint32_t at = offset + i;
+        uint8_t slot = slots[at];
+        uint32_t byte = 0;
+
+        if (slot == PLAIN) {
+            byte = storage[at];
+        } else if (slot != RESERVED) {
+            const Hooks& entry = hooks[slot - 1];
+            if (slot != cachedSlot) {
+                cachedSlot = slot;
+                cachedValue = hookedValue(entry);
+            }
+            byte = (cachedValue >> (8 * (at - entry.offset))) & 0xFF;
+        }
+        result |= byte << (8 * i);
+    }
+    return result;
+}
+
+// Narrow writes reach the hook as just the bytes written and their mask;
+// the stored bytes only back hooked registers without a read hook
+void RegisterFile::storeSlow(uint32_t offset, unsigned width, uint32_t value)
+{
+    uint8_t touched[4];
+    uint32_t written[4];
+    uint32_t masks[4];
+    unsigned touchedCount = 0;
+
+    for (unsigned i = 0; i < width; ++i) {
+        uint32_t at = offset + i;
+        uint8_t slot = slots[at];
+        uint8_t byte = static_cast<uint8_t>(value >> (8 * i));
+
+        if (slot == PLAIN) {
+            storage[at] = byte;
+        } else if (slot != RESERVED && hooks[slot - 1].write) {
+            storage[at] = byte;
+            if (touchedCount == 0 || touched[touchedCount - 1] != slot) {
+                touched[touchedCount] = slot;
+                written[touchedCount] = 0;
+                masks[touchedCount] = 0;
+                touchedCount++;
+            }
+            unsigned shift = 8 * (at - hooks[slot - 1].offset);
+            written[touchedCount - 1] |= static_cast<uint32_t>(byte) << shift;
+            masks[touchedCount - 1] |= 0xFFu << shift;
+        }
+    }
+
+    for (unsigned i = 0; i < touchedCount; ++i) {
+        hooks[touched[i] - 1].write(written[i], masks[i]);
+    }
+}
@@ -1,14 +1,153 @@
-#include <iostream>
+#ifndef REGISTER_HPP
+#define REGISTER_HPP
 
-using namespace std;
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 
-class Register {
+// Memory-mapped registers.
+//
+// A RegisterFile is one peripheral's register window: a block of backing
+// bytes, plus one slot byte per backing byte saying what lives there. Plain
+// registers are just their backing bytes, so a bus access to one is a slot
+// check and a memcpy - no allocation, no virtual call, no std::function.
+// Registers with side effects carry read and/or write hooks and go through
+// the slow path; only they pay for it. Bytes no register covers read as
+// zero and ignore writes.
+//
+// Values are little-endian. Plain registers are not synchronised: the
+// firmware side owns them, and other threads should go through hooks.
+
+// Typed handle onto a plain register's backing bytes, for the device side
+template <typename T>
+class Register
+{
     public:
-        Register();
-        Register(int size);
-        ~Register();
+        Register() {}
+        explicit Register(uint8_t* cell) : cell(cell) {}
+
+        bool isValid() const {return cell != nullptr; }
+        T get() const {T value; std::memcpy(&value, cell, sizeof(T)); return value; }
+        void set(T value) {std::memcpy(cell, &value, sizeof(T)); }
 
     private:
-        vector<double> storage;
+        uint8_t* cell = nullptr;
+};
+
+typedef Register<uint8_t> Register8;
+typedef Register<uint16_t> Register16;
+typedef Register<uint32_t> Register32;
+
+class RegisterFile
+{
+    public:
+        // A read hook supplies the register's value. A write hook gets the
+        // bytes written, in place within the register and the rest zero,
+        // plus a mask of the bits they cover: all of the register's bits
+        // for a full-width write, fewer for a narrow one. Nothing is merged
+        // in, since only the hook knows the register's live value and what
+        // writing its bits means. A hooked register without a write hook is
+        // read-only.
+        typedef std::function<uint32_t()> ReadHook;
+        typedef std::function<void(uint32_t value, uint32_t mask)> WriteHook;
+
+        struct Info {
+            std::string name;
+            uint32_t offset;
+            unsigned width;     // bytes
+            bool hooked;
+        };
+
+        // size is in bytes; the backing store is rounded up to whole pages
+        RegisterFile(const std::string& name, uint32_t size);
+
+        RegisterFile(const RegisterFile&) = delete;
+        RegisterFile& operator=(const RegisterFile&) = delete;
+
+        const std::string& getName() const {return name; }
+        uint32_t getSize() const {return size; }
+        uint32_t getStorageSize() const {return static_cast<uint32_t>(storage.size()); }
+        uint8_t* getStorage() {return storage.data(); }
+
+        // Registers are naturally aligned and may not overlap. These return
+        // an invalid handle (or false) when the offset is out of range,
+        // misaligned or taken.
+        template <typename T>
+        Register<T> add(const std::string& registerName, uint32_t offset, T reset = 0)
+        {
+            if (!define(registerName, offset, sizeof(T), PLAIN)) {
+                return Register<T>();
+            }
+            Register<T> handle(&storage[offset]);
+            handle.set(reset);
+            return handle;
+        }
+        bool addHooked(const std::string& registerName, uint32_t offset, unsigned width,
+                       ReadHook read, WriteHook write, uint32_t reset = 0);
+        bool addReadOnly(const std::string& registerName, uint32_t offset, uint32_t value);
+
+        const std::vector<Info>& getRegisters() const {return registers; }
+        const Info* findRegister(const std::string& registerName) const;
+
+        // Bus side. Offsets must be aligned to the access width.
+        template <typename T>
+        T load(uint32_t offset)
+        {
+            if (plain(offset, sizeof(T))) {
+                T value;
+                std::memcpy(&value, &storage[offset], sizeof(T));
+                return value;
+            }
+            return static_cast<T>(loadSlow(offset, sizeof(T)));
+        }
+
+        template <typename T>
+        void store(uint32_t offset, T value)
+        {
+            if (plain(offset, sizeof(T))) {
+                std::memcpy(&storage[offset], &value, sizeof(T));
+                return;
+            }
+            storeSlow(offset, sizeof(T), value);
+        }
+
+    private:
+        // Slot values: PLAIN for plain register bytes, RESERVED for bytes no
+        // register covers, otherwise 1 + the index of a hooked register
+        static const uint8_t PLAIN = 0;
+        static const uint8_t RESERVED = 0xFF;
+        static const size_t MAX_HOOKED = RESERVED - 1;
+
+        struct Hooks {
+            uint32_t offset;
+            unsigned width;
+            ReadHook read;
+            WriteHook write;
+        };
+
+        std::string name;
+        uint32_t size;
+        std::vector<uint8_t> storage;
+        std::vector<uint8_t> slots;
+        std::vector<Info> registers;
+        std::vector<Hooks> hooks;
+
+        bool plain(uint32_t offset, size_t width) const
+        {
+            // All slot bytes of the access are PLAIN exactly when they OR to zero
+            uint32_t marks = 0;
+            std::memcpy(&marks, &slots[offset], width);
+            return marks == 0;
+        }
+
+        bool define(const std::string& registerName, uint32_t offset, unsigned width, uint8_t slot);
+        uint32_t loadSlow(uint32_t offset, unsigned width);
+        void storeSlow(uint32_t offset, unsigned width, uint32_t value);
+        uint32_t hookedValue(const Hooks& entry);
+};
 
-};
\ No newline at end of file
+#endif
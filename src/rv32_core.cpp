@@ -0,0 +1,802 @@
+#include "rv32_core.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+
+const int Rv32Core::INTERRUPT_LINES;
+const uint32_t Rv32Core::DEFAULT_CLOCK_MULTIPLIER;
+const uint64_t Rv32Core::POLL_CYCLES;
+const unsigned Rv32Core::COST_ALU;
+const unsigned Rv32Core::COST_LOAD;
+const unsigned Rv32Core::COST_STORE;
+const unsigned Rv32Core::COST_BRANCH;
+const unsigned Rv32Core::COST_BRANCH_TAKEN;
+const unsigned Rv32Core::COST_JUMP;
+const unsigned Rv32Core::COST_MUL;
+const unsigned Rv32Core::COST_DIV;
+const unsigned Rv32Core::COST_CSR;
+const unsigned Rv32Core::COST_MRET;
+const unsigned Rv32Core::COST_TRAP;
+const uint32_t Rv32Core::OPS_PER_PAGE;
+const uint8_t Rv32Core::SINK;
+
+// Decoded op kinds. The order must match the label table in execute().
+#define RV32_OPS(X) \
+    X(DECODE) X(PAGE_END) X(ILLEGAL) \
+    X(LUI) X(AUIPC) X(JAL) X(JALR) \
+    X(BEQ) X(BNE) X(BLT) X(BGE) X(BLTU) X(BGEU) \
+    X(LB) X(LH) X(LW) X(LBU) X(LHU) X(SB) X(SH) X(SW) \
+    X(ADDI) X(SLTI) X(SLTIU) X(XORI) X(ORI) X(ANDI) X(SLLI) X(SRLI) X(SRAI) \
+    X(ADD) X(SUB) X(SLL) X(SLT) X(SLTU) X(XOR) X(SRL) X(SRA) X(OR) X(AND) \
+    X(MUL) X(MULH) X(MULHSU) X(MULHU) X(DIV) X(DIVU) X(REM) X(REMU) \
+    X(FENCE) X(FENCE_I) X(ECALL) X(EBREAK) X(MRET) X(WFI) \
+    X(CSRRW) X(CSRRS) X(CSRRC) X(CSRRWI) X(CSRRSI) X(CSRRCI)
+
+#define RV32_ENUM(name) OP_##name,
+enum OpKind {
+    RV32_OPS(RV32_ENUM)
+    OP_COUNT
+};
+#undef RV32_ENUM
+
+// Trap causes
+static const uint32_t CAUSE_MISALIGNED_FETCH = 0;
+static const uint32_t CAUSE_FETCH_FAULT = 1;
+static const uint32_t CAUSE_ILLEGAL = 2;
+static const uint32_t CAUSE_BREAKPOINT = 3;
+static const uint32_t CAUSE_MISALIGNED_LOAD = 4;
+static const uint32_t CAUSE_LOAD_FAULT = 5;
+static const uint32_t CAUSE_MISALIGNED_STORE = 6;
+static const uint32_t CAUSE_STORE_FAULT = 7;
+static const uint32_t CAUSE_ECALL = 11;
+static const uint32_t CAUSE_INTERRUPT = 0x80000000u;
+static const uint32_t LOCAL_INTERRUPT_BASE = 16;
+
+// mstatus bits
+static const uint32_t MSTATUS_MIE = 1u << 3;
+static const uint32_t MSTATUS_MPIE = 1u << 7;
+static const uint32_t MSTATUS_MPP = 3u << 11;
+
+static const uint32_t MISA_RV32IM = (1u << 30) | (1u << ('I' - 'A')) | (1u << ('M' - 'A'));
+
+static int32_t signExtend(uint32_t value, unsigned bits)
+{
+    return static_cast<int32_t>(value << (32 - bits)) >> (32 - bits);
+}
+
+static std::string hex32(uint32_t value)
+{
+    std::ostringstream out;
+    out << "0x" << std::hex << std::setw(8) << std::setfill('0') << value;
+    return out.str();
+}
+
+Rv32Core::Rv32Core(Bus& bus)
+    : bus(bus)
+{
+    decodedPages = static_cast<DecodedOp**>(std::calloc(Bus::PAGE_COUNT, sizeof(DecodedOp*)));
+    std::memset(regs, 0, sizeof(regs));
+    resetPc = 0;
+    resetSp = 0;
+    haltReason = "not started";
+}
+
+Rv32Core::~Rv32Core()
+{
+    std::free(decodedPages);
+}
+
+void Rv32Core::attach(Clock& target)
+{
+    target.addCycleHook([this](long long, long long count) {
+        if (!running.load(std::memory_order_relaxed)) {
+            return;
+        }
+        run(static_cast<uint64_t>(count) * clockMultiplier.load(std::memory_order_relaxed));
+    });
+}
+
+void Rv32Core::setClockMultiplier(uint32_t multiplier)
+{
+    clockMultiplier.store(multiplier > 0 ? multiplier : 1);
+}
+
+void Rv32Core::setResetState(uint32_t newPc, uint32_t newSp)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    resetPc = newPc;
+    resetSp = newSp;
+}
+
+void Rv32Core::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    resetLocked();
+}
+
+void Rv32Core::resetLocked()
+{
+    std::memset(regs, 0, sizeof(regs));
+    regs[2] = resetSp;
+    pc = resetPc;
+    mstatus = 0;
+    mie = 0;
+    mtvec = 0;
+    mscratch = 0;
+    mepc = 0;
+    mcause = 0;
+    mtval = 0;
+    cycles = 0;
+    instructions = 0;
+    overshoot = 0;
+    waiting = false;
+    pendingLines.store(0);
+    invalidateAll();
+}
+
+void Rv32Core::start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    haltReason.clear();
+    haltRequested.store(false);
+    running.store(true);
+}
+
+void Rv32Core::halt(const std::string& reason)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    haltLocked(reason);
+}
+
+void Rv32Core::haltLocked(const std::string& reason)
+{
+    running.store(false);
+    haltReason = reason;
+}
+
+void Rv32Core::requestHalt()
+{
+    haltRequested.store(true);
+}
+
+void Rv32Core::raiseInterrupt(int line)
+{
+    if (line < 0 || line >= INTERRUPT_LINES) {
+        return;
+    }
+    pendingLines.fetch_or(1u << line, std::memory_order_relaxed);
+}
+
+void Rv32Core::invalidateCache()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    invalidateAll();
+}
+
+Rv32Core::Snapshot Rv32Core::getSnapshot() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Snapshot snapshot;
+    snapshot.pc = pc;
+    std::memcpy(snapshot.regs, regs, sizeof(snapshot.regs));
+    snapshot.mstatus = mstatus;
+    snapshot.mcause = mcause;
+    snapshot.mepc = mepc;
+    snapshot.cycles = cycles;
+    snapshot.instructions = instructions;
+    snapshot.running = running.load();
+    snapshot.waiting = waiting;
+    snapshot.haltReason = haltReason;
+    return snapshot;
+}
+
+void Rv32Core::run(uint64_t budget)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // An instruction that ran past the last budget is paid for first
+    if (overshoot >= budget) {
+        overshoot -= budget;
+        return;
+    }
+    budget -= overshoot;
+    overshoot = 0;
+
+    uint64_t used = 0;
+    while (used < budget && running.load(std::memory_order_relaxed)) {
+        if (haltRequested.load(std::memory_order_relaxed) && haltRequested.exchange(false)) {
+            haltLocked("halt requested at pc " + hex32(pc));
+            break;
+        }
+        if (pendingLines.load(std::memory_order_relaxed) != 0 && takeInterrupt()) {
+            // Interrupt entry is core time like any other, mcycle included
+            cycles += COST_TRAP;
+            used += COST_TRAP;
+        }
+
+        uint64_t slice = budget - used < POLL_CYCLES ? budget - used : POLL_CYCLES;
+        if (waiting) {
+            // WFI: idle until an enabled interrupt is pending
+            cycles += slice;
+            used += slice;
+            continue;
+        }
+        uint64_t spent = execute(slice);
+        cycles += spent;
+        used += spent;
+    }
+
+    if (used > budget) {
+        overshoot = used - budget;
+    }
+}
+
+// Enabled pending lines wake a WFI even with interrupts masked, as on
+// hardware; they are only taken with mstatus.MIE set
+bool Rv32Core::takeInterrupt()
+{
+    uint32_t enabled = pendingLines.load(std::memory_order_relaxed) & (mie >> LOCAL_INTERRUPT_BASE);
+    if (enabled == 0) {
+        return false;
+    }
+    waiting = false;
+    if ((mstatus & MSTATUS_MIE) == 0) {
+        return false;
+    }
+
+    uint32_t line = 0;
+    while ((enabled & (1u << line)) == 0) {
+        ++line;
+    }
+    pendingLines.fetch_and(~(1u << line), std::memory_order_relaxed);
+    return enterTrap(CAUSE_INTERRUPT | (LOCAL_INTERRUPT_BASE + line), 0);
+}
+
+// pc is the instruction that trapped, or the next one for interrupts.
+// Returns false when there is no handler and the core halted.
+bool Rv32Core::enterTrap(uint32_t cause, uint32_t value)
+{
+    uint32_t base = mtvec & ~3u;
+    if (base == 0) {
+        std::string reason;
+        switch (cause) {
+            case CAUSE_BREAKPOINT: reason = "ebreak"; break;
+            case CAUSE_ECALL: reason = "ecall"; break;
+            case CAUSE_ILLEGAL: reason = "illegal instruction " + hex32(value); break;
+            default: reason = "trap cause " + std::to_string(cause & 0x7FFFFFFFu) + ", mtval " + hex32(value); break;
+        }
+        haltLocked(reason + " at pc " + hex32(pc) + " with no trap handler");
+        return false;
+    }
+    if (cause == CAUSE_FETCH_FAULT && pc == base) {
+        haltLocked("trap handler at " + hex32(base) + " is not executable");
+        return false;
+    }
+
+    mepc = pc;
+    mcause = cause;
+    mtval = value;
+    mstatus = (mstatus & ~(MSTATUS_MIE | MSTATUS_MPIE)) | ((mstatus & MSTATUS_MIE) ? MSTATUS_MPIE : 0) | MSTATUS_MPP;
+    pc = base;
+    if ((cause & CAUSE_INTERRUPT) && (mtvec & 3) == 1) {
+        pc += 4 * (cause & 0x7FFFFFFFu);
+    }
+    return true;
+}
+
+Rv32Core::DecodedOp* Rv32Core::decodePage(uint32_t pageNumber)
+{
+    DecodedOp* ops = decodedPages[pageNumber];
+    if (ops) {
+        return ops;
+    }
+
+    // Code runs from memory regions only, never from register files
+    const Bus::Region* region = bus.findRegion(pageNumber << Bus::PAGE_SHIFT);
+    if (!region || !region->host) {
+        return nullptr;
+    }
+
+    std::unique_ptr<DecodedOp[]> page(new DecodedOp[OPS_PER_PAGE + 1]);
+    for (uint32_t i = 0; i < OPS_PER_PAGE; ++i) {
+        page[i].kind = OP_DECODE;
+    }
+    page[OPS_PER_PAGE] = DecodedOp();
+    page[OPS_PER_PAGE].kind = OP_PAGE_END;
+
+    ops = page.get();
+    pageStore.push_back(std::move(page));
+    decodedPageNumbers.push_back(pageNumber);
+    decodedPages[pageNumber] = ops;
+    return ops;
+}
+
+void Rv32Core::invalidatePage(uint32_t pageNumber)
+{
+    DecodedOp* ops = decodedPages[pageNumber];
+    for (uint32_t i = 0; i < OPS_PER_PAGE; ++i) {
+        ops[i].kind = OP_DECODE;
+    }
+}
+
+void Rv32Core::invalidateAll()
+{
+    for (uint32_t pageNumber : decodedPageNumbers) {
+        invalidatePage(pageNumber);
+    }
+}
+
+void Rv32Core::decode(uint32_t word, DecodedOp& op)
+{
+    uint32_t opcode = word & 0x7F;
+    uint32_t rd = (word >> 7) & 31;
+    uint32_t funct3 = (word >> 12) & 7;
+    uint32_t rs1 = (word >> 15) & 31;
+    uint32_t rs2 = (word >> 20) & 31;
+    uint32_t funct7 = word >> 25;
+
+    int32_t immI = signExtend(word >> 20, 12);
+    int32_t immS = signExtend(((word >> 25) << 5) | ((word >> 7) & 31), 12);
+    int32_t immB = signExtend(((word >> 31) << 12) | (((word >> 7) & 1) << 11) | (((word >> 25) & 0x3F) << 5)
+                              | (((word >> 8) & 0xF) << 1), 13);
+    int32_t immJ = signExtend(((word >> 31) << 20) | (((word >> 12) & 0xFF) << 12) | (((word >> 20) & 1) << 11)
+                              | (((word >> 21) & 0x3FF) << 1), 21);
+
+    op.kind = OP_ILLEGAL;
+    op.rd = static_cast<uint8_t>(rd != 0 ? rd : SINK);
+    op.rs1 = static_cast<uint8_t>(rs1);
+    op.rs2 = static_cast<uint8_t>(rs2);
+    op.imm = static_cast<int32_t>(word);
+
+    switch (opcode) {
+        case 0x37: op.kind = OP_LUI; op.imm = static_cast<int32_t>(word & 0xFFFFF000u); break;
+        case 0x17: op.kind = OP_AUIPC; op.imm = static_cast<int32_t>(word & 0xFFFFF000u); break;
+        case 0x6F: op.kind = OP_JAL; op.imm = immJ; break;
+        case 0x67:
+            if (funct3 == 0) {
+                op.kind = OP_JALR;
+                op.imm = immI;
+            }
+            break;
+        case 0x63: {
+            static const uint8_t branches[8] = {OP_BEQ, OP_BNE, OP_ILLEGAL, OP_ILLEGAL, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU};
+            op.kind = branches[funct3];
+            if (op.kind != OP_ILLEGAL) {
+                op.imm = immB;
+            }
+            break;
+        }
+        case 0x03: {
+            static const uint8_t loads[8] = {OP_LB, OP_LH, OP_LW, OP_ILLEGAL, OP_LBU, OP_LHU, OP_ILLEGAL, OP_ILLEGAL};
+            op.kind = loads[funct3];
+            if (op.kind != OP_ILLEGAL) {
+                op.imm = immI;
+            }
+            break;
+        }
+        case 0x23: {
+            static const uint8_t stores[8] = {OP_SB, OP_SH, OP_SW, OP_ILLEGAL, OP_ILLEGAL, OP_ILLEGAL, OP_ILLEGAL, OP_ILLEGAL};
+            op.kind = stores[funct3];
+            if (op.kind != OP_ILLEGAL) {
+                op.imm = immS;
+            }
+            break;
+        }
+        case 0x13: {
+            static const uint8_t immediates[8] = {OP_ADDI, OP_SLLI, OP_SLTI, OP_SLTIU, OP_XORI, OP_SRLI, OP_ORI, OP_ANDI};
+            uint8_t kind = immediates[funct3];
+            if (kind == OP_SLLI || kind == OP_SRLI) {
+                if (funct7 == 0x20 && kind == OP_SRLI) {
+                    kind = OP_SRAI;
+                } else if (funct7 != 0) {
+                    break;
+                }
+                op.imm = static_cast<int32_t>(rs2);
+            } else {
+                op.imm = immI;
+            }
+            op.kind = kind;
+            break;
+        }
+        case 0x33: {
+            static const uint8_t base[8] = {OP_ADD, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_OR, OP_AND};
+            static const uint8_t muldiv[8] = {OP_MUL, OP_MULH, OP_MULHSU, OP_MULHU, OP_DIV, OP_DIVU, OP_REM, OP_REMU};
+            if (funct7 == 0) {
+                op.kind = base[funct3];
+            } else if (funct7 == 1) {
+                op.kind = muldiv[funct3];
+            } else if (funct7 == 0x20 && funct3 == 0) {
+                op.kind = OP_SUB;
+            } else if (funct7 == 0x20 && funct3 == 5) {
+                op.kind = OP_SRA;
+            }
+            break;
+        }
+        case 0x0F:
+            if (funct3 == 0) {
+                op.kind = OP_FENCE;
+            } else if (funct3 == 1) {
+                op.kind = OP_FENCE_I;
+            }
+            break;
+        case 0x73:
+            if (funct3 == 0) {
+                if (word == 0x00000073u) {
+                    op.kind = OP_ECALL;
+                } else if (word == 0x00100073u) {
+                    op.kind = OP_EBREAK;
+                } else if (word == 0x30200073u) {
+                    op.kind = OP_MRET;
+                } else if (word == 0x10500073u) {
+                    op.kind = OP_WFI;
+                }
+            } else if (funct3 != 4) {
+                static const uint8_t csrs[8] = {OP_ILLEGAL, OP_CSRRW, OP_CSRRS, OP_CSRRC,
+                                                OP_ILLEGAL, OP_CSRRWI, OP_CSRRSI, OP_CSRRCI};
+                op.kind = csrs[funct3];
+                op.imm = static_cast<int32_t>(word >> 20);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+bool Rv32Core::readCsr(uint32_t number, uint64_t spent, uint32_t& value) const
+{
+    uint64_t cycleCount = cycles + spent;
+    switch (number) {
+        case 0x300: value = mstatus | MSTATUS_MPP; return true;
+        case 0x301: value = MISA_RV32IM; return true;
+        case 0x304: value = mie; return true;
+        case 0x305: value = mtvec; return true;
+        case 0x340: value = mscratch; return true;
+        case 0x341: value = mepc; return true;
+        case 0x342: value = mcause; return true;
+        case 0x343: value = mtval; return true;
+        case 0x344: value = pendingLines.load(std::memory_order_relaxed) << LOCAL_INTERRUPT_BASE; return true;
+        case 0xB00: case 0xC00: case 0xC01: value = static_cast<uint32_t>(cycleCount); return true;
+        case 0xB80: case 0xC80: case 0xC81: value = static_cast<uint32_t>(cycleCount >> 32); return true;
+        case 0xB02: case 0xC02: value = static_cast<uint32_t>(instructions); return true;
+        case 0xB82: case 0xC82: value = static_cast<uint32_t>(instructions >> 32); return true;
+        case 0xF11: case 0xF12: case 0xF13: case 0xF14: value = 0; return true;
+        default: return false;
+    }
+}
+
+// Counters and ID registers ignore writes
+bool Rv32Core::writeCsr(uint32_t number, uint32_t value)
+{
+    switch (number) {
+        case 0x300: mstatus = value & (MSTATUS_MIE | MSTATUS_MPIE); return true;
+        case 0x304: mie = value & 0xFFFF0000u; return true;
+        case 0x305: mtvec = value & ~2u; return true;
+        case 0x340: mscratch = value; return true;
+        case 0x341: mepc = value & ~3u; return true;
+        case 0x342: mcause = value; return true;
+        case 0x343: mtval = value; return true;
+        case 0x344: {
+            // Software may set or clear pending lines
+            uint32_t lines = value >> LOCAL_INTERRUPT_BASE;
+            uint32_t pending = pendingLines.load(std::memory_order_relaxed);
+            pendingLines.fetch_and(~(pending & ~lines), std::memory_order_relaxed);
+            pendingLines.fetch_or(lines & ~pending, std::memory_order_relaxed);
+            return true;
+        }
+        case 0x301: case 0xB00: case 0xB80: case 0xB02: case 0xB82: return true;
+        default: return false;
+    }
+}
+
+bool Rv32Core::accessCsr(const DecodedOp& op, uint64_t spent)
+{
+    uint32_t number = static_cast<uint32_t>(op.imm) & 0xFFF;
+    bool immediate = op.kind >= OP_CSRRWI;
+    uint32_t source = immediate ? op.rs1 : regs[op.rs1];
+    bool swap = op.kind == OP_CSRRW || op.kind == OP_CSRRWI;
+
+    uint32_t old = 0;
+    if (!readCsr(number, spent, old)) {
+        return false;
+    }
+
+    // CSRRS/CSRRC with x0 or a zero immediate only read
+    if (swap || op.rs1 != 0) {
+        if ((number >> 10) == 3) {
+            return false;
+        }
+        uint32_t value = swap ? source : (op.kind == OP_CSRRS || op.kind == OP_CSRRSI) ? old | source : old & ~source;
+        if (!writeCsr(number, value)) {
+            return false;
+        }
+    }
+    regs[op.rd] = old;
+    return true;
+}
+
+// Runs until the budget is spent or the core has to leave the loop (a CSR
+// write, MRET or WFI that may change what interrupts are deliverable).
+// Returns the cycles spent, which may run slightly past the budget.
+uint64_t Rv32Core::execute(uint64_t budget)
+{
+    uint32_t* x = regs;
+    uint32_t pc = this->pc;
+    uint64_t spent = 0;
+    uint64_t retired = 0;
+    uint32_t trapCause = 0;
+    uint32_t trapValue = 0;
+    uint32_t pageNumber = 0;
+    DecodedOp* pageOps = nullptr;
+    DecodedOp* op = nullptr;
+
+#if defined(__GNUC__)
+#define RV32_LABEL(name) &&do_##name,
+    static const void* const labels[OP_COUNT] = {RV32_OPS(RV32_LABEL)};
+#undef RV32_LABEL
+#define CASE(name) do_##name:
+#define DISPATCH() do { if (spent >= budget) goto out; goto *labels[op->kind]; } while (0)
+#define DISPATCH_NOW() goto *labels[op->kind]
+#else
+#define CASE(name) case OP_##name:
+#define DISPATCH() do { if (spent >= budget) goto out; goto dispatch; } while (0)
+#define DISPATCH_NOW() goto dispatch
+#endif
+
+#define RETIRE(cost) do { spent += (cost); ++retired; } while (0)
+#define NEXT() do { pc += 4; ++op; DISPATCH(); } while (0)
+#define TRAP(cause, value) do { trapCause = (cause); trapValue = (value); goto trap; } while (0)
+#define JUMP(target) do { \
+        uint32_t next = (target); \
+        if (next & 3) TRAP(CAUSE_MISALIGNED_FETCH, next); \
+        pc = next; \
+        if ((pc >> Bus::PAGE_SHIFT) != pageNumber) goto lookup; \
+        op = pageOps + ((pc & Bus::PAGE_MASK) >> 2); \
+        DISPATCH(); \
+    } while (0)
+#define BRANCH(condition) do { \
+        if (condition) { RETIRE(COST_BRANCH_TAKEN); JUMP(pc + op->imm); } \
+        RETIRE(COST_BRANCH); NEXT(); \
+    } while (0)
+#define LOAD(type, align) do { \
+        uint32_t address = x[op->rs1] + op->imm; \
+        type value; \
+        if (address & (align)) TRAP(CAUSE_MISALIGNED_LOAD, address); \
+        if (!bus.load(address, value)) TRAP(CAUSE_LOAD_FAULT, address); \
+        x[op->rd] = static_cast<uint32_t>(value); \
+        RETIRE(COST_LOAD); NEXT(); \
+    } while (0)
+#define STORE(type, align) do { \
+        uint32_t address = x[op->rs1] + op->imm; \
+        if (address & (align)) TRAP(CAUSE_MISALIGNED_STORE, address); \
+        if (!bus.store(address, static_cast<type>(x[op->rs2]))) TRAP(CAUSE_STORE_FAULT, address); \
+        if (decodedPages[address >> Bus::PAGE_SHIFT]) invalidatePage(address >> Bus::PAGE_SHIFT); \
+        RETIRE(COST_STORE); NEXT(); \
+    } while (0)
+#define ALU(expression) do { x[op->rd] = (expression); RETIRE(COST_ALU); NEXT(); } while (0)
+#define CSR() do { \
+        if (!accessCsr(*op, spent)) TRAP(CAUSE_ILLEGAL, static_cast<uint32_t>(op->imm)); \
+        RETIRE(COST_CSR); pc += 4; goto out; \
+    } while (0)
+
+lookup:
+    if (pc & 3) {
+        TRAP(CAUSE_MISALIGNED_FETCH, pc);
+    }
+    pageNumber = pc >> Bus::PAGE_SHIFT;
+    pageOps = decodePage(pageNumber);
+    if (!pageOps) {
+        TRAP(CAUSE_FETCH_FAULT, pc);
+    }
+    op = pageOps + ((pc & Bus::PAGE_MASK) >> 2);
+    DISPATCH();
+
+#if !defined(__GNUC__)
+dispatch:
+    switch (op->kind) {
+#endif
+
+    CASE(DECODE) {
+        const Bus::Region* region = bus.findRegion(pc);
+        uint32_t word = 0;
+        std::memcpy(&word, region->host + (pc - region->base), sizeof(word));
+        decode(word, *op);
+        DISPATCH_NOW();
+    }
+    CASE(PAGE_END) {
+        // Fell through into the next page; pc already points there
+        goto lookup;
+    }
+    CASE(ILLEGAL) TRAP(CAUSE_ILLEGAL, static_cast<uint32_t>(op->imm));
+
+    CASE(LUI) ALU(static_cast<uint32_t>(op->imm));
+    CASE(AUIPC) ALU(pc + op->imm);
+    CASE(JAL) {
+        uint32_t target = pc + op->imm;
+        if (target & 3) TRAP(CAUSE_MISALIGNED_FETCH, target);
+        x[op->rd] = pc + 4;
+        RETIRE(COST_JUMP);
+        JUMP(target);
+    }
+    CASE(JALR) {
+        uint32_t target = (x[op->rs1] + op->imm) & ~1u;
+        if (target & 3) TRAP(CAUSE_MISALIGNED_FETCH, target);
+        x[op->rd] = pc + 4;
+        RETIRE(COST_JUMP);
+        JUMP(target);
+    }
+
+    CASE(BEQ) BRANCH(x[op->rs1] == x[op->rs2]);
+    CASE(BNE) BRANCH(x[op->rs1] != x[op->rs2]);
+    CASE(BLT) BRANCH(static_cast<int32_t>(x[op->rs1]) < static_cast<int32_t>(x[op->rs2]));
+    CASE(BGE) BRANCH(static_cast<int32_t>(x[op->rs1]) >= static_cast<int32_t>(x[op->rs2]));
+    CASE(BLTU) BRANCH(x[op->rs1] < x[op->rs2]);
+    CASE(BGEU) BRANCH(x[op->rs1] >= x[op->rs2]);
+
+    CASE(LB) LOAD(int8_t, 0);
+    CASE(LH) LOAD(int16_t, 1);
+    CASE(LW) LOAD(uint32_t, 3);
+    CASE(LBU) LOAD(uint8_t, 0);
+    CASE(LHU) LOAD(uint16_t, 1);
+    CASE(SB) STORE(uint8_t, 0);
+    CASE(SH) STORE(uint16_t, 1);
+    CASE(SW) STORE(uint32_t, 3);
+
+    CASE(ADDI) ALU(x[op->rs1] + op->imm);
+    CASE(SLTI) ALU(static_cast<int32_t>(x[op->rs1]) < op->imm ? 1u : 0u);
+    CASE(SLTIU) ALU(x[op->rs1] < static_cast<uint32_t>(op->imm) ? 1u : 0u);
+    CASE(XORI) ALU(x[op->rs1] ^ static_cast<uint32_t>(op->imm));
+    CASE(ORI) ALU(x[op->rs1] | static_cast<uint32_t>(op->imm));
+    CASE(ANDI) ALU(x[op->rs1] & static_cast<uint32_t>(op->imm));
+    CASE(SLLI) ALU(x[op->rs1] << op->imm);
+    CASE(SRLI) ALU(x[op->rs1] >> op->imm);
+    CASE(SRAI) ALU(static_cast<uint32_t>(static_cast<int32_t>(x[op->rs1]) >> op->imm));
+
+    CASE(ADD) ALU(x[op->rs1] + x[op->rs2]);
+    CASE(SUB) ALU(x[op->rs1] - x[op->rs2]);
+    CASE(SLL) ALU(x[op->rs1] << (x[op->rs2] & 31));
+    CASE(SLT) ALU(static_cast<int32_t>(x[op->rs1]) < static_cast<int32_t>(x[op->rs2]) ? 1u : 0u);
+    CASE(SLTU) ALU(x[op->rs1] < x[op->rs2] ? 1u : 0u);
+    CASE(XOR) ALU(x[op->rs1] ^ x[op->rs2]);
+    CASE(SRL) ALU(x[op->rs1] >> (x[op->rs2] & 31));
+    CASE(SRA) ALU(static_cast<uint32_t>(static_cast<int32_t>(x[op->rs1]) >> (x[op->rs2] & 31)));
+    CASE(OR) ALU(x[op->rs1] | x[op->rs2]);
+    CASE(AND) ALU(x[op->rs1] & x[op->rs2]);
+
+    CASE(MUL) {
+        x[op->rd] = x[op->rs1] * x[op->rs2];
+        RETIRE(COST_MUL);
+        NEXT();
+    }
+    CASE(MULH) {
+        int64_t product = static_cast<int64_t>(static_cast<int32_t>(x[op->rs1]))
+                          * static_cast<int64_t>(static_cast<int32_t>(x[op->rs2]));
+        x[op->rd] = static_cast<uint32_t>(static_cast<uint64_t>(product) >> 32);
+        RETIRE(COST_MUL);
+        NEXT();
+    }
+    CASE(MULHSU) {
+        int64_t product = static_cast<int64_t>(static_cast<int32_t>(x[op->rs1])) * static_cast<int64_t>(x[op->rs2]);
+        x[op->rd] = static_cast<uint32_t>(static_cast<uint64_t>(product) >> 32);
+        RETIRE(COST_MUL);
+        NEXT();
+    }
+    CASE(MULHU) {
+        uint64_t product = static_cast<uint64_t>(x[op->rs1]) * x[op->rs2];
+        x[op->rd] = static_cast<uint32_t>(product >> 32);
+        RETIRE(COST_MUL);
+        NEXT();
+    }
+    // Division by zero and overflow give the results the spec defines
+    // rather than trapping
+    CASE(DIV) {
+        int32_t dividend = static_cast<int32_t>(x[op->rs1]);
+        int32_t divisor = static_cast<int32_t>(x[op->rs2]);
+        if (divisor == 0) {
+            x[op->rd] = 0xFFFFFFFFu;
+        } else if (dividend == INT32_MIN && divisor == -1) {
+            x[op->rd] = static_cast<uint32_t>(dividend);
+        } else {
+            x[op->rd] = static_cast<uint32_t>(dividend / divisor);
+        }
+        RETIRE(COST_DIV);
+        NEXT();
+    }
+    CASE(DIVU) {
+        uint32_t divisor = x[op->rs2];
+        x[op->rd] = divisor == 0 ? 0xFFFFFFFFu : x[op->rs1] / divisor;
+        RETIRE(COST_DIV);
+        NEXT();
+    }
+    CASE(REM) {
+        int32_t dividend = static_cast<int32_t>(x[op->rs1]);
+        int32_t divisor = static_cast<int32_t>(x[op->rs2]);
+        if (divisor == 0) {
+            x[op->rd] = static_cast<uint32_t>(dividend);
+        } else if (dividend == INT32_MIN && divisor == -1) {
+            x[op->rd] = 0;
+        } else {
+            x[op->rd] = static_cast<uint32_t>(dividend % divisor);
+        }
+        RETIRE(COST_DIV);
+        NEXT();
+    }
+    CASE(REMU) {
+        uint32_t divisor = x[op->rs2];
+        x[op->rd] = divisor == 0 ? x[op->rs1] : x[op->rs1] % divisor;
+        RETIRE(COST_DIV);
+        NEXT();
+    }
+
+    CASE(FENCE) {
+        RETIRE(COST_ALU);
+        NEXT();
+    }
+    CASE(FENCE_I) {
+        invalidateAll();
+        RETIRE(COST_ALU);
+        pc += 4;
+        goto out;
+    }
+    CASE(ECALL) TRAP(CAUSE_ECALL, 0);
+    CASE(EBREAK) TRAP(CAUSE_BREAKPOINT, pc);
+    CASE(MRET) {
+        mstatus = (mstatus & ~MSTATUS_MIE) | ((mstatus & MSTATUS_MPIE) ? MSTATUS_MIE : 0) | MSTATUS_MPIE;
+        pc = mepc;
+        RETIRE(COST_MRET);
+        goto out;
+    }
+    CASE(WFI) {
+        if ((pendingLines.load(std::memory_order_relaxed) & (mie >> LOCAL_INTERRUPT_BASE)) == 0) {
+            waiting = true;
+        }
+        RETIRE(COST_ALU);
+        pc += 4;
+        goto out;
+    }
+
+    CASE(CSRRW) CSR();
+    CASE(CSRRS) CSR();
+    CASE(CSRRC) CSR();
+    CASE(CSRRWI) CSR();
+    CASE(CSRRSI) CSR();
+    CASE(CSRRCI) CSR();
+
+#if !defined(__GNUC__)
+        default:
+            goto out;
+    }
+#endif
+
+trap:
+    spent += COST_TRAP;
+    this->pc = pc;
+    if (!enterTrap(trapCause, trapValue)) {
+        instructions += retired;
+        return spent;
+    }
+    pc = this->pc;
+    if (spent >= budget) {
+        goto out;
+    }
+    goto lookup;
+
+out:
+    this->pc = pc;
+    instructions += retired;
+    return spent;
+
+#undef CASE
+#undef DISPATCH
+#undef DISPATCH_NOW
+#undef RETIRE
+#undef NEXT
+#undef TRAP
+#undef JUMP
+#undef BRANCH
+#undef LOAD
+#undef STORE
+#undef ALU
+#undef CSR
+}
@@ -0,0 +1,158 @@
+#ifndef RV32_CORE_HPP
+#define RV32_CORE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "bus.hpp"
+#include "clock.hpp"
+
+// RV32IM interpreter core, machine mode only, with Zicsr for the trap CSRs.
+//
+// Instructions are decoded once into a per-page cache of compact ops (4 KiB
+// of code becomes 1024 ops plus an end-of-page sentinel) and executed with
+// threaded dispatch: each op jumps straight to the next op's handler
+// through a label table (computed goto on GCC and Clang, a switch
+// elsewhere). Pages are decoded lazily, only for memory regions, and a
+// store into a decoded page, FENCE.I or invalidateCache() throws the
+// decoded ops away.
+//
+// Timing: every instruction costs a fixed number of core cycles (see the
+// COST_ constants) and the core runs at a fixed multiple of the system
+// clock, like a PLL. A clock cycle hook hands it each span of clock cycles
+// as a budget, so the core never runs ahead of simulated time; an
+// instruction that overshoots a budget is paid back from the next one.
+//
+// Interrupts: raiseInterrupt() latches one of 16 local interrupt lines,
+// visible as mip bits 16-31 and enabled by the matching mie bits. Pending
+// interrupts are taken between budget slices of at most POLL_CYCLES, and
+// taking one clears its pending bit. With mtvec left at zero, any trap
+// halts the core instead, which is the useful behaviour for bare tests.
+
+class Rv32Core
+{
+    public:
+        static const int INTERRUPT_LINES = 16;
+        static const uint32_t DEFAULT_CLOCK_MULTIPLIER = 1000;
+        static const uint64_t POLL_CYCLES = 256;
+
+        // Core cycles per instruction class
+        static const unsigned COST_ALU = 1;
+        static const unsigned COST_LOAD = 2;
+        static const unsigned COST_STORE = 1;
+        static const unsigned COST_BRANCH = 1;          // not taken
+        static const unsigned COST_BRANCH_TAKEN = 3;    // pipeline refill
+        static const unsigned COST_JUMP = 3;
+        static const unsigned COST_MUL = 3;
+        static const unsigned COST_DIV = 34;
+        static const unsigned COST_CSR = 1;
+        static const unsigned COST_MRET = 3;
+        static const unsigned COST_TRAP = 4;
+
+        struct Snapshot {
+            uint32_t pc;
+            uint32_t regs[32];
+            uint32_t mstatus;
+            uint32_t mcause;
+            uint32_t mepc;
+            uint64_t cycles;
+            uint64_t instructions;
+            bool running;
+            bool waiting;
+            std::string haltReason;
+        };
+
+        explicit Rv32Core(Bus& bus);
+        ~Rv32Core();
+
+        Rv32Core(const Rv32Core&) = delete;
+        Rv32Core& operator=(const Rv32Core&) = delete;
+
+        // Registers a cycle hook; call once, before the clock starts
+        void attach(Clock& clock);
+        void setClockMultiplier(uint32_t multiplier);
+        uint32_t getClockMultiplier() const {return clockMultiplier.load(); }
+
+        // Everything below is safe from any thread
+        void setResetState(uint32_t pc, uint32_t sp);
+        void reset();
+        void start();
+        void halt(const std::string& reason);
+        bool isRunning() const {return running.load(); }
+        void raiseInterrupt(int line);
+        void invalidateCache();
+
+        // Lock-free, so it also works from inside a bus access the core
+        // itself made (a watchpoint handler); the core stops at the end of
+        // the current slice
+        void requestHalt();
+        Snapshot getSnapshot() const;
+
+        // Advances the core by this many core cycles. The clock hook calls
+        // it; tests may call it directly when no clock is attached.
+        void run(uint64_t cycles);
+
+    private:
+        struct DecodedOp {
+            uint8_t kind;
+            uint8_t rd;     // SINK when the instruction targets x0
+            uint8_t rs1;
+            uint8_t rs2;
+            int32_t imm;    // or the CSR number, or the raw word when illegal
+        };
+
+        static const uint32_t OPS_PER_PAGE = Bus::PAGE_SIZE / 4;
+        static const uint8_t SINK = 32;
+
+        Bus& bus;
+        std::atomic<uint32_t> clockMultiplier{DEFAULT_CLOCK_MULTIPLIER};
+
+        // Core state, guarded by mutex; run() holds it for a whole budget
+        mutable std::mutex mutex;
+        uint32_t regs[33];     // x0-x31 plus the x0 write sink
+        uint32_t pc = 0;
+        uint32_t resetPc = 0;
+        uint32_t resetSp = 0;
+        uint32_t mstatus = 0;
+        uint32_t mie = 0;
+        uint32_t mtvec = 0;
+        uint32_t mscratch = 0;
+        uint32_t mepc = 0;
+        uint32_t mcause = 0;
+        uint32_t mtval = 0;
+        uint64_t cycles = 0;
+        uint64_t instructions = 0;
+        uint64_t overshoot = 0;
+        bool waiting = false;
+        std::string haltReason;
+
+        std::atomic<bool> running{false};
+        std::atomic<bool> haltRequested{false};
+        std::atomic<uint32_t> pendingLines{0};
+
+        // Decoded pages by page number; calloc'ed like the bus page table
+        DecodedOp** decodedPages = nullptr;
+        std::vector<std::unique_ptr<DecodedOp[]>> pageStore;
+        std::vector<uint32_t> decodedPageNumbers;
+
+        uint64_t execute(uint64_t budget);
+        DecodedOp* decodePage(uint32_t pageNumber);
+        void invalidatePage(uint32_t pageNumber);
+        void invalidateAll();
+        static void decode(uint32_t word, DecodedOp& op);
+
+        void resetLocked();
+        void haltLocked(const std::string& reason);
+        bool takeInterrupt();
+        bool enterTrap(uint32_t cause, uint32_t value);
+        bool accessCsr(const DecodedOp& op, uint64_t spent);
+        bool readCsr(uint32_t number, uint64_t spent, uint32_t& value) const;
+        bool writeCsr(uint32_t number, uint32_t value);
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+
+Scheduler::Scheduler()
+{
+    heap.reserve(64);
+}
+
+Scheduler::~Scheduler() {}
+
+EventId Scheduler::scheduleAt(uint64_t timeNs, std::function<void()> action)
+{
+    Event event;
+    event.timeNs = timeNs;
+    event.id = nextId++;
+    event.action = std::move(action);
+
+    EventId id = event.id;
+    heap.push_back(std::move(event));
+    std::push_heap(heap.begin(), heap.end(), Later());
+
+    return id;
+}
+
+bool Scheduler::cancel(EventId id)
+{
+    // Cancellation is a linear search. It is rare for one-shot events;
+    // anything cancelled frequently should not live on this heap.
+    for (size_t i = 0; i < heap.size(); ++i) {
+        if (heap[i].id == id) {
+            heap[i] = std::move(heap.back());
+            heap.pop_back();
+            std::make_heap(heap.begin(), heap.end(), Later());
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Scheduler::popDue(uint64_t nowNs, std::function<void()>& action)
+{
+    if (heap.empty() || heap.front().timeNs > nowNs) {
+        return false;
+    }
+
+    std::pop_heap(heap.begin(), heap.end(), Later());
+    action = std::move(heap.back().action);
+    heap.pop_back();
+
+    return true;
+}
+
+void Scheduler::clear()
+{
+    heap.clear();
+}
@@ -0,0 +1,57 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Discrete-event scheduler keyed on simulated time in nanoseconds.
+// Events live in a binary min-heap ordered by time, ties are broken by
+// insertion order so events scheduled for the same instant fire FIFO.
+
+typedef uint64_t EventId;
+
+class Scheduler
+{
+    public:
+        Scheduler();
+        ~Scheduler();
+
+        EventId scheduleAt(uint64_t timeNs, std::function<void()> action);
+        bool cancel(EventId id);
+
+        bool empty() const {return heap.empty(); }
+        size_t pendingCount() const {return heap.size(); }
+        uint64_t nextEventTime() const {return heap.front().timeNs; }
+
+        // Pops the earliest event if it is due at or before nowNs. The action
+        // is handed back to the caller so it can run without holding any lock
+        // that protects the scheduler.
+        bool popDue(uint64_t nowNs, std::function<void()>& action);
+
+        void clear();
+
+    private:
+        struct Event {
+            uint64_t timeNs;
+            EventId id;
+            std::function<void()> action;
+        };
+
+        // std heap algorithms build a max-heap, so invert the comparison
+        struct Later {
+            bool operator()(const Event& a, const Event& b) const
+            {
+                if (a.timeNs != b.timeNs) {
+                    return a.timeNs > b.timeNs;
+                }
+                return a.id > b.id;
+            }
+        };
+
+        std::vector<Event> heap;
+        EventId nextId = 1;
+};
+
+#endif
@@ -0,0 +1,190 @@
+#include "spi.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+const int SpiController::CHIP_SELECTS;
+const uint8_t SpiSensor::WHO_AM_I;
+const uint8_t SpiSensor::CTRL;
+const uint8_t SpiSensor::OUT_L;
+const uint8_t SpiSensor::OUT_H;
+const uint8_t SpiSensor::IDENTITY;
+
+SpiController::SpiController() : name("SPI") {}
+
+SpiController::SpiController(const std::string& name) : name(name) {}
+
+SpiController::~SpiController() {}
+
+void SpiController::attach(Clock& targetClock)
+{
+    clock = &targetClock;
+}
+
+void SpiController::setInterruptLine(InterruptController* controller, IrqNumber line)
+{
+    interrupts = controller;
+    irq = line;
+}
+
+void SpiController::setBitRate(uint32_t hz)
+{
+    if (hz > 0) {
+        bitRate = hz;
+    }
+}
+
+bool SpiController::attachDevice(int chipSelect, std::shared_ptr<SpiDevice> device)
+{
+    if (chipSelect < 0 || chipSelect >= CHIP_SELECTS) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    devices[chipSelect] = device;
+    return true;
+}
+
+std::string SpiController::describeDevice(int chipSelect) const
+{
+    if (chipSelect < 0 || chipSelect >= CHIP_SELECTS) {
+        return "";
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return devices[chipSelect] ? devices[chipSelect]->describe() : "none";
+}
+
+bool SpiController::transfer(int chipSelect, std::vector<uint8_t> mosi, Completion done)
+{
+    if (!clock || chipSelect < 0 || chipSelect >= CHIP_SELECTS || mosi.empty()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Pending pending;
+    pending.transfer.chipSelect = chipSelect;
+    pending.transfer.mosi = std::move(mosi);
+    pending.done = std::move(done);
+    queue.push_back(std::move(pending));
+
+    if (!busy) {
+        busy = true;
+        startNext();
+    }
+    return true;
+}
+
+bool SpiController::isBusy() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return busy;
+}
+
+SpiTransfer SpiController::getLastTransfer() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastTransfer;
+}
+
+// Called with mutex held and a transfer at the front of the queue
+void SpiController::startNext()
+{
+    SpiTransfer& next = queue.front().transfer;
+    uint64_t bits = 8ULL * next.mosi.size();
+    uint64_t rate = bitRate.load();
+
+    // Back to back with the previous transfer if the bus never went idle
+    next.startNs = std::max(busFreeNs, clock->getSimTimeNanoseconds());
+    next.endNs = next.startNs + (bits * 1000000000ULL + rate - 1) / rate;
+    busFreeNs = next.endNs;
+
+    clock->scheduleAt(next.endNs, [this]() {complete(); });
+}
+
+void SpiController::complete()
+{
+    Pending finished;
+    std::shared_ptr<SpiDevice> device;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = std::move(queue.front());
+        queue.pop_front();
+        device = devices[finished.transfer.chipSelect];
+    }
+
+    // The whole frame moves in one call; an empty chip select reads back 0xFF
+    SpiTransfer& transfer = finished.transfer;
+    transfer.miso.assign(transfer.mosi.size(), 0xFF);
+    if (device) {
+        device->transfer(transfer.mosi.data(), transfer.miso.data(), transfer.mosi.size());
+    }
+    transfers++;
+    bytes += transfer.mosi.size();
+
+    if (finished.done) {
+        finished.done(transfer);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        lastTransfer = std::move(transfer);
+        if (queue.empty()) {
+            busy = false;
+        } else {
+            startNext();
+        }
+    }
+
+    if (interrupts) {
+        interrupts->raise(irq);
+    }
+}
+
+SpiSensor::SpiSensor(std::unique_ptr<SampleSource> source) : source(std::move(source))
+{
+    std::memset(registers, 0, sizeof(registers));
+    registers[WHO_AM_I] = IDENTITY;
+}
+
+uint16_t SpiSensor::nextSample()
+{
+    if (position == sizeof(block) / sizeof(block[0])) {
+        if (source) {
+            source->read(block, sizeof(block) / sizeof(block[0]));
+        } else {
+            std::memset(block, 0, sizeof(block));
+        }
+        position = 0;
+    }
+    return block[position++];
+}
+
+void SpiSensor::transfer(const uint8_t* mosi, uint8_t* miso, size_t length)
+{
+    // Nothing is driven while the address byte is shifted in
+    miso[0] = 0xFF;
+    bool reading = (mosi[0] & 0x80) != 0;
+    uint8_t address = mosi[0] & 0x7F;
+
+    for (size_t i = 1; i < length; ++i, address = (address + 1) & 0x7F) {
+        if (reading) {
+            if (address == OUT_L) {
+                uint16_t sample = nextSample();
+                registers[OUT_L] = static_cast<uint8_t>(sample);
+                registers[OUT_H] = static_cast<uint8_t>(sample >> 8);
+            }
+            miso[i] = registers[address];
+        } else {
+            miso[i] = 0xFF;
+            if (address != WHO_AM_I && address != OUT_L && address != OUT_H) {
+                registers[address] = mosi[i];
+            }
+        }
+    }
+}
+
+std::string SpiSensor::describe() const
+{
+    return "sensor (" + (source ? source->describe() : std::string("no input")) + ")";
+}
@@ -0,0 +1,122 @@
+#ifndef SPI_HPP
+#define SPI_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "adc.hpp"
+#include "clock.hpp"
+#include "interrupt_controller.hpp"
+
+// A device on an SPI bus. Chip select frames each transfer, and the device
+// sees the whole frame at once: MOSI in, MISO out, same length.
+class SpiDevice
+{
+    public:
+        virtual ~SpiDevice() {}
+        virtual void transfer(const uint8_t* mosi, uint8_t* miso, size_t length) = 0;
+        virtual std::string describe() const = 0;
+};
+
+struct SpiTransfer {
+    int chipSelect = 0;
+    std::vector<uint8_t> mosi;
+    std::vector<uint8_t> miso;
+    uint64_t startNs = 0;
+    uint64_t endNs = 0;
+};
+
+// Transaction-level SPI controller.
+//
+// A transfer is one clock event: it is queued, given exactly the bus time
+// its bits would take (8 per byte at the configured bit rate, back to back
+// after the previous transfer), and when that time comes the device sees
+// all of its data in one call. Simulated timing is the same as clocking
+// every bit; the host pays per transfer, not per bit.
+class SpiController
+{
+    public:
+        typedef std::function<void(const SpiTransfer& transfer)> Completion;
+        static const int CHIP_SELECTS = 4;
+
+        SpiController();
+        SpiController(const std::string& name);
+        ~SpiController();
+
+        const std::string& getName() const {return name; }
+        void attach(Clock& clock);
+        void setInterruptLine(InterruptController* controller, IrqNumber irq);
+        void setBitRate(uint32_t hz);
+        uint32_t getBitRate() const {return bitRate.load(); }
+
+        bool attachDevice(int chipSelect, std::shared_ptr<SpiDevice> device);
+        std::string describeDevice(int chipSelect) const;
+
+        // Any thread; completion runs on the clock thread
+        bool transfer(int chipSelect, std::vector<uint8_t> mosi, Completion done = Completion());
+
+        bool isBusy() const;
+        SpiTransfer getLastTransfer() const;
+        uint64_t getTransferCount() const {return transfers.load(); }
+        uint64_t getByteCount() const {return bytes.load(); }
+
+    private:
+        struct Pending {
+            SpiTransfer transfer;
+            Completion done;
+        };
+
+        std::string name;
+        Clock* clock = nullptr;
+        InterruptController* interrupts = nullptr;
+        IrqNumber irq = -1;
+        std::atomic<uint32_t> bitRate{1000000};
+
+        mutable std::mutex mutex;
+        std::shared_ptr<SpiDevice> devices[CHIP_SELECTS];
+        std::deque<Pending> queue;
+        bool busy = false;
+        uint64_t busFreeNs = 0;
+        SpiTransfer lastTransfer;
+
+        std::atomic<uint64_t> transfers{0};
+        std::atomic<uint64_t> bytes{0};
+
+        void startNext();
+        void complete();
+};
+
+// Register-mapped sensor in the style of common SPI IMUs. The first byte
+// of a frame is a register address, with bit 7 set to read; the address
+// then auto-increments. Reading OUT_L latches a new sample from the source
+// so OUT_L/OUT_H always form one reading.
+class SpiSensor : public SpiDevice
+{
+    public:
+        static const uint8_t WHO_AM_I = 0x0F;
+        static const uint8_t CTRL = 0x20;
+        static const uint8_t OUT_L = 0x28;
+        static const uint8_t OUT_H = 0x29;
+        static const uint8_t IDENTITY = 0x6B;
+
+        explicit SpiSensor(std::unique_ptr<SampleSource> source);
+        void transfer(const uint8_t* mosi, uint8_t* miso, size_t length) override;
+        std::string describe() const override;
+
+    private:
+        std::unique_ptr<SampleSource> source;
+        uint8_t registers[128];
+        uint16_t block[64];
+        size_t position = 64;
+
+        uint16_t nextSample();
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+// Bounded single-producer single-consumer ring of trivially copyable values.
+//
+// Each side owns one index and only reads the other's, so a transfer is a
+// copy plus one release store with no CAS. Each side also caches the last
+// index it saw from the other and only reloads it when the ring looks full
+// or empty, which keeps the shared cache lines quiet under sustained
+// traffic. The bulk calls move as much as fits in one go, at most two
+// memcpys. Capacity is rounded up to a power of two.
+
+template <typename T>
+class SpscRing
+{
+    public:
+        explicit SpscRing(size_t capacity)
+        {
+            size_t size = 2;
+            while (size < capacity) {
+                size <<= 1;
+            }
+
+            mask = size - 1;
+            slots.reset(new T[size]);
+        }
+
+        SpscRing(const SpscRing&) = delete;
+        SpscRing& operator=(const SpscRing&) = delete;
+
+        // Producer side
+        bool tryPush(const T& value)
+        {
+            return pushBulk(&value, 1) == 1;
+        }
+
+        size_t pushBulk(const T* values, size_t count)
+        {
+            size_t tail = tailIndex.load(std::memory_order_relaxed);
+            size_t space = mask + 1 - (tail - cachedHead);
+            if (space < count) {
+                cachedHead = headIndex.load(std::memory_order_acquire);
+                space = mask + 1 - (tail - cachedHead);
+            }
+
+            count = count < space ? count : space;
+            copyIn(tail, values, count);
+            tailIndex.store(tail + count, std::memory_order_release);
+            return count;
+        }
+
+        // Consumer side
+        bool tryPop(T& value)
+        {
+            return popBulk(&value, 1) == 1;
+        }
+
+        size_t popBulk(T* values, size_t count)
+        {
+            size_t head = headIndex.load(std::memory_order_relaxed);
+            size_t available = cachedTail - head;
+            if (available < count) {
+                cachedTail = tailIndex.load(std::memory_order_acquire);
+                available = cachedTail - head;
+            }
+
+            count = count < available ? count : available;
+            copyOut(head, values, count);
+            headIndex.store(head + count, std::memory_order_release);
+            return count;
+        }
+
+        // Exact from either side's own point of view, a hint from anywhere else
+        size_t size() const
+        {
+            return tailIndex.load(std::memory_order_acquire) - headIndex.load(std::memory_order_acquire);
+        }
+        bool empty() const {return size() == 0; }
+        size_t capacity() const {return mask + 1; }
+
+    private:
+        std::unique_ptr<T[]> slots;
+        size_t mask = 0;
+
+        // Consumer line: its index and its view of the producer's
+        alignas(64) std::atomic<size_t> headIndex{0};
+        size_t cachedTail = 0;
+
+        // Producer line
+        alignas(64) std::atomic<size_t> tailIndex{0};
+        size_t cachedHead = 0;
+
+        void copyIn(size_t tail, const T* values, size_t count)
+        {
+            size_t start = tail & mask;
+            size_t first = count < mask + 1 - start ? count : mask + 1 - start;
+            std::memcpy(&slots[start], values, first * sizeof(T));
+            std::memcpy(&slots[0], values + first, (count - first) * sizeof(T));
+        }
+
+        void copyOut(size_t head, T* values, size_t count) const
+        {
+            size_t start = head & mask;
+            size_t first = count < mask + 1 - start ? count : mask + 1 - start;
+            std::memcpy(values, &slots[start], first * sizeof(T));
+            std::memcpy(values + first, &slots[0], (count - first) * sizeof(T));
+        }
+};
+
+#endif
@@ -0,0 +1,226 @@
+#include "stimulus.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+static const char STIMULUS_MAGIC[8] = {'E', 'M', 'B', 'S', 'T', 'I', 'M', '1'};
+static const uint32_t STIMULUS_VERSION = 1;
+
+struct StimulusHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t recordCount;
+};
+
+static_assert(sizeof(StimulusHeader) == 24, "Stimulus header must be packed to 24 bytes");
+
+StimulusPlayer::StimulusPlayer() {}
+
+StimulusPlayer::~StimulusPlayer()
+{
+    stop();
+}
+
+bool StimulusPlayer::load(const std::string& path, std::string& error)
+{
+    stop();
+
+    MappedFile mapped;
+    if (!mapped.open(path, error)) {
+        return false;
+    }
+
+    StimulusHeader header;
+    if (mapped.getSize() < sizeof(header)) {
+        error = path + ": too short for a stimulus header";
+        return false;
+    }
+    std::memcpy(&header, mapped.getData(), sizeof(header));
+
+    if (std::memcmp(header.magic, STIMULUS_MAGIC, sizeof(STIMULUS_MAGIC)) != 0 ||
+        header.version != STIMULUS_VERSION || header.recordSize != sizeof(StimulusRecord)) {
+        error = path + ": not a version 1 stimulus file";
+        return false;
+    }
+    if (header.recordCount > (mapped.getSize() - sizeof(header)) / sizeof(StimulusRecord)) {
+        error = path + ": truncated, header promises " + std::to_string(header.recordCount) + " records";
+        return false;
+    }
+
+    // The header is 24 bytes, so records stay 8-byte aligned in the mapping
+    const StimulusRecord* data = reinterpret_cast<const StimulusRecord*>(mapped.getData() + sizeof(header));
+    size_t count = static_cast<size_t>(header.recordCount);
+
+    // One sequential pass; playback relies on the order
+    for (size_t i = 1; i < count; ++i) {
+        if (data[i].cycle < data[i - 1].cycle) {
+            error = path + ": record " + std::to_string(i) + " is out of cycle order";
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    file = std::move(mapped);
+    records = data;
+    recordCount = count;
+    cursor = 0;
+    return true;
+}
+
+void StimulusPlayer::start(Clock& targetClock, Sink targetSink)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (playing || !records) {
+        return;
+    }
+
+    clock = &targetClock;
+    sink = std::move(targetSink);
+    playing = true;
+    scheduleNext();
+}
+
+void StimulusPlayer::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!playing) {
+        return;
+    }
+
+    generation++;
+    playing = false;
+    if (pendingEvent != 0) {
+        clock->cancelEvent(pendingEvent);
+        pendingEvent = 0;
+    }
+}
+
+void StimulusPlayer::scheduleNext()
+{
+    if (cursor >= recordCount) {
+        playing = false;
+        pendingEvent = 0;
+        return;
+    }
+
+    // Capturing only this and a counter keeps the action inside
+    // std::function's small buffer, so re-arming never allocates
+    unsigned eventGeneration = generation;
+    pendingEvent = clock->scheduleAtCycle(static_cast<long long>(records[cursor].cycle), [this, eventGeneration]() {
+        onEvent(eventGeneration);
+    });
+}
+
+void StimulusPlayer::onEvent(unsigned eventGeneration)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!playing || eventGeneration != generation) {
+        return;
+    }
+
+    // Everything due by now, including records for cycles already passed
+    uint64_t now = static_cast<uint64_t>(clock->getClockCycles());
+    size_t end = cursor;
+    while (end < recordCount && records[end].cycle <= now) {
+        end++;
+    }
+
+    if (end > cursor) {
+        sink(records + cursor, end - cursor);
+        cursor = end;
+    }
+    scheduleNext();
+}
+
+bool StimulusPlayer::isPlaying() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return playing;
+}
+
+size_t StimulusPlayer::getRecordCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return recordCount;
+}
+
+size_t StimulusPlayer::getPlayedCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return cursor;
+}
+
+std::string StimulusPlayer::getPath() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return file.getPath();
+}
+
+bool StimulusPlayer::convertText(const std::string& textPath, const std::string& binaryPath, std::string& error)
+{
+    std::ifstream input(textPath);
+    if (!input) {
+        error = textPath + ": cannot open";
+        return false;
+    }
+
+    std::vector<StimulusRecord> parsed;
+    std::string line;
+    size_t lineNumber = 0;
+
+    while (std::getline(input, line)) {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+
+        std::istringstream iss(line);
+        long long cycle = 0;
+        long long pin = 0;
+        long long value = 0;
+        std::string extra;
+
+        if (!(iss >> cycle)) {
+            continue;   // Blank or comment-only line
+        }
+        if (!(iss >> pin >> value) || (iss >> extra) || cycle < 0 || pin < 0 || pin > UINT32_MAX ||
+            value < 0 || value > UINT32_MAX) {
+            error = textPath + ":" + std::to_string(lineNumber) + ": expected \"cycle pin value\"";
+            return false;
+        }
+
+        StimulusRecord record;
+        record.cycle = static_cast<uint64_t>(cycle);
+        record.pin = static_cast<uint32_t>(pin);
+        record.value = static_cast<uint32_t>(value);
+        parsed.push_back(record);
+    }
+
+    // Stable so transitions listed for the same cycle keep their order
+    std::stable_sort(parsed.begin(), parsed.end(), [](const StimulusRecord& a, const StimulusRecord& b) {
+        return a.cycle < b.cycle;
+    });
+
+    StimulusHeader header;
+    std::memcpy(header.magic, STIMULUS_MAGIC, sizeof(STIMULUS_MAGIC));
+    header.version = STIMULUS_VERSION;
+    header.recordSize = sizeof(StimulusRecord);
+    header.recordCount = parsed.size();
+
+    std::ofstream output(binaryPath, std::ios::binary | std::ios::trunc);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!parsed.empty()) {
+        output.write(reinterpret_cast<const char*>(parsed.data()), parsed.size() * sizeof(StimulusRecord));
+    }
+    if (!output) {
+        error = binaryPath + ": write failed";
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,80 @@
+#ifndef STIMULUS_HPP
+#define STIMULUS_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "clock.hpp"
+#include "mapped_file.hpp"
+
+// Pre-recorded input stimulus.
+//
+// A stimulus file is a 24-byte header followed by fixed-size records sorted
+// by cycle. Everything is little-endian, matching the hosts we build on:
+//
+//   header:  char magic[8] = "EMBSTIM1", uint32 version = 1,
+//            uint32 recordSize = 16, uint64 recordCount
+//   record:  uint64 cycle, uint32 pin, uint32 value
+//
+// Pins are IO button handles, i.e. the order buttons were added in; a
+// non-zero value presses the button. The text form accepted by
+// convertText() is one "cycle pin value" triple per line, with blank
+// lines and '#' comments ignored. Records need not be sorted there.
+
+struct StimulusRecord {
+    uint64_t cycle;
+    uint32_t pin;
+    uint32_t value;
+};
+
+static_assert(sizeof(StimulusRecord) == 16, "Stimulus records must be packed to 16 bytes");
+
+// Replays a mapped stimulus file through the clock's scheduler. Only one
+// event is ever outstanding: it applies every record due at its cycle and
+// re-arms itself for the next record, so playback allocates nothing.
+
+class StimulusPlayer
+{
+    public:
+        // Receives each batch of records due at the same cycle, on the clock thread
+        typedef std::function<void(const StimulusRecord* records, size_t count)> Sink;
+
+        StimulusPlayer();
+        ~StimulusPlayer();
+
+        // Maps and validates a file, replacing any loaded one
+        bool load(const std::string& path, std::string& error);
+        void start(Clock& clock, Sink sink);
+        void stop();
+
+        bool isPlaying() const;
+        size_t getRecordCount() const;
+        size_t getPlayedCount() const;
+        std::string getPath() const;
+
+        static bool convertText(const std::string& textPath, const std::string& binaryPath, std::string& error);
+
+    private:
+        mutable std::mutex mutex;
+        MappedFile file;
+        const StimulusRecord* records = nullptr;
+        size_t recordCount = 0;
+        size_t cursor = 0;
+
+        Clock* clock = nullptr;
+        Sink sink;
+        EventId pendingEvent = 0;
+        bool playing = false;
+
+        // Bumped on every stop so a stale event that is already running
+        // cannot re-arm itself
+        unsigned generation = 0;
+
+        void scheduleNext();
+        void onEvent(unsigned eventGeneration);
+};
+
+#endif
@@ -2,11 +2,40 @@
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <cstdlib>
+#include <algorithm>
 
 // Constructors
-System::System() : clock(10e4, false) {
+System::System() : System(false) {}
+
+System::System(bool headless) : clock(10e4, false), headless(headless) {
     std::cout << "DEBUG: System constructor started" << std::endl;
     
+    // Interrupt latency is measured against the simulated cycle count
+    interrupts.setCycleSource(&clock.getCycleCounter());
+    uart0.attach(clock);
+    adc1.attach(clock);
+    spi1.attach(clock);
+    i2c1.attach(clock);
+    
+    // Stock bus devices: a sensor on SPI1 and a 4 KiB EEPROM on I2C1
+    spi1.attachDevice(0, std::make_shared<SpiSensor>(
+        std::unique_ptr<SampleSource>(new NoiseSampleSource(2048.0, 64.0))));
+    i2c1.attachDevice(0x50, std::make_shared<I2cEeprom>(4096, 32, 5000000));
+    buildMemoryMap();
+    
+    // Reset vector at the start of flash, stack at the top of SRAM
+    cpu.setResetState(0x08000000, 0x20020000);
+    cpu.reset();
+    cpu.attach(clock);
+    
+    if (headless) {
+        std::cout << "DEBUG: Headless mode, skipping QApplication and display" << std::endl;
+        return;
+    }
+    
     // Create QApplication first
     int argc = 1;
     char* argv[] = {(char*)"embedsim"};
@@ -38,6 +67,11 @@ System::~System() {
     stopCLIThread();
     std::cout << "DEBUG: CLI thread stopped" << std::endl;
     
+    // The CPU's cycle hook uses the bus and register files, which are
+    // declared after the clock and so destroyed before it
+    clock.stop();
+    stopSimulationThread();
+    
     // Clean up Qt resources
     if (display) {
         std::cout << "DEBUG: Closing display" << std::endl;
@@ -54,7 +88,10 @@ System::~System() {
     }
     
     // Clear interrupt handlers to prevent dangling references
-    interruptHandlers.clear();
+    for (const auto& entry : irqNumbers) {
+        interrupts.setHandler(entry.second, nullptr);
+    }
+    irqNumbers.clear();
     std::cout << "DEBUG: Interrupt handlers cleared" << std::endl;
     
     std::cout << "DEBUG: System destructor completed" << std::endl;
@@ -62,60 +99,1384 @@ System::~System() {
 
 void System::configureIO(IO io)
 {
-    this->io = io;
+    this->io = io;
+    
+    // Resolved once so the polling path never looks up names
+    aButton = this->io.getButtonHandle("aButton");
+    gpioA.connectButtons(&this->io, 0, 0, static_cast<int>(this->io.getButtonCount()));
+    declareTraceSignals();
+}
+
+IrqNumber System::registerInterrupt(const std::string& name, std::function<void()> handler, uint8_t priority)
+{
+    IrqNumber irq;
+    auto it = irqNumbers.find(name);
+    if (it != irqNumbers.end()) {
+        irq = it->second;
+    } else if (nextIrq < InterruptController::MAX_IRQS) {
+        irq = nextIrq++;
+        irqNumbers[name] = irq;
+    } else {
+        std::cout << "Error: No free IRQ for interrupt " << name << "\n";
+        return -1;
+    }
+    
+    interrupts.setHandler(irq, handler);
+    interrupts.setPriority(irq, priority);
+    interrupts.enable(irq);
+    return irq;
+}
+
+void System::triggerInterrupt(const std::string& name)
+{
+    auto it = irqNumbers.find(name);
+    if (it != irqNumbers.end()) {
+        triggerInterrupt(it->second);
+    }
+}
+
+void System::triggerInterrupt(IrqNumber irq)
+{
+    // Handlers run on the simulation thread, never on the caller's
+    if (!interrupts.raise(irq)) {
+        std::cout << "Error: Could not raise IRQ " << irq << "\n";
+    }
+}
+
+void System::stopClock()
+{
+    // Runs on the simulation thread, which the clock may be waiting on to
+    // drain edges, so only ask the clock thread to stop
+    std::cout << "Interrupt: Stopping clock\n";
+    clock.requestStop();
+    shouldStop = true;
+}
+
+void System::startClock()
+{
+    std::cout << "Interrupt: Starting clock\n";
+    clock.beginTicking(false);
+    shouldStop = false;
+}
+
+void System::pauseClock()
+{
+    std::cout << "Interrupt: Pausing clock\n";
+    clockPaused = true;
+}
+
+void System::resumeClock()
+{
+    std::cout << "Interrupt: Resuming clock\n";
+    clockPaused = false;
+}
+
+void System::setSpeedRatio(double ratio)
+{
+    clock.setSpeedRatio(ratio);
+}
+
+bool System::parseSpeedRatio(const std::string& text, double& ratio)
+{
+    if (text == "max" || text == "MAX") {
+        ratio = Clock::UNTHROTTLED;
+        return true;
+    }
+    
+    // Accept both "10" and "10x"
+    std::string value = text;
+    if (!value.empty() && (value.back() == 'x' || value.back() == 'X')) {
+        value.pop_back();
+    }
+    
+    std::istringstream iss(value);
+    double parsed = 0.0;
+    if (!(iss >> parsed) || !iss.eof() || parsed <= 0.0) {
+        return false;
+    }
+    
+    ratio = parsed;
+    return true;
+}
+
+std::string System::describeSpeed() const
+{
+    std::ostringstream oss;
+    double nominal = clock.getNominalMHz();
+    double achieved = clock.getAchievedMHz();
+    
+    oss << "Speed: ";
+    if (clock.isUnthrottled()) {
+        oss << "max";
+    } else {
+        oss << clock.getSpeedRatio() << "x";
+    }
+    oss << std::fixed << std::setprecision(4)
+        << " (achieved " << achieved << " MHz, nominal " << nominal << " MHz";
+    if (nominal > 0.0) {
+        oss << ", " << std::setprecision(2) << achieved / nominal << "x real time";
+    }
+    oss << ")";
+    
+    return oss.str();
+}
+
+std::string System::describeTiming() const
+{
+    std::ostringstream oss;
+    bool hybrid = clock.getPacingMode() == Clock::PacingMode::Hybrid;
+    
+    oss << "Pacing: " << (clock.isUnthrottled() ? "off (unthrottled)" : (hybrid ? "hybrid sleep/spin" : "sleep")) << "\n";
+    oss << "Drift: " << clock.getDriftNanoseconds() << " ns (max " << clock.getMaxDriftNanoseconds() << " ns)\n";
+    oss << "Wake-up jitter: " << clock.getPacingJitter().format(" ns");
+    
+    return oss.str();
+}
+
+bool System::applyTimingCommand(const std::string& option)
+{
+    if (option == "reset") {
+        clock.resetTimingStats();
+    } else if (option == "hybrid") {
+        clock.setPacingMode(Clock::PacingMode::Hybrid);
+    } else if (option == "sleep") {
+        clock.setPacingMode(Clock::PacingMode::Sleep);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool System::applyBankCommand(const std::string& countText, const std::string& periodText)
+{
+    long long count = 0;
+    long long period = 1000;
+    
+    if (countText != "off") {
+        std::istringstream countStream(countText);
+        if (!(countStream >> count) || !countStream.eof() || count <= 0) {
+            return false;
+        }
+        if (!periodText.empty()) {
+            std::istringstream periodStream(periodText);
+            if (!(periodStream >> period) || !periodStream.eof() || period <= 0 || period > UINT32_MAX / 2) {
+                return false;
+            }
+        }
+    }
+    
+    if (timerBankHook != 0) {
+        clock.removeCycleHook(timerBankHook);
+        timerBankHook = 0;
+    }
+    timerBank.reset();
+    
+    if (count == 0) {
+        return true;
+    }
+    
+    // Spread reload values over [period, 2 * period) so rollovers don't all
+    // land on the same cycle
+    std::shared_ptr<TimerBank> bank = std::make_shared<TimerBank>();
+    for (long long i = 0; i < count; ++i) {
+        TimerBank::Index index = bank->addTimer(static_cast<uint32_t>(period + i % period), true);
+        bank->startTimer(index);
+    }
+    
+    // The hook keeps its own reference, so the bank outlives a hook call
+    // that is still running when the bank is replaced
+    timerBankHook = clock.addCycleHook([bank](long long, long long cycles) {
+        for (long long i = 0; i < cycles; ++i) {
+            bank->tick();
+        }
+    });
+    timerBank = bank;
+    
+    return true;
+}
+
+std::string System::describeTimerBank() const
+{
+    std::ostringstream oss;
+    
+    if (!timerBank) {
+        oss << "Timer bank: none";
+    } else {
+        oss << "Timer bank: " << timerBank->size() << " timers (" << timerBank->getKernelName()
+            << " kernel), " << timerBank->getTotalRollovers() << " rollovers";
+    }
+    
+    return oss.str();
+}
+
+bool System::resolveIrq(const std::string& text, IrqNumber& irq) const
+{
+    auto it = irqNumbers.find(text);
+    if (it != irqNumbers.end()) {
+        irq = it->second;
+        return true;
+    }
+    
+    std::istringstream iss(text);
+    int parsed = -1;
+    if (!(iss >> parsed) || !iss.eof() || parsed < 0 || parsed >= InterruptController::MAX_IRQS) {
+        return false;
+    }
+    
+    irq = parsed;
+    return true;
+}
+
+std::string System::applyIrqCommand(std::istringstream& iss)
+{
+    std::ostringstream oss;
+    std::string action, target;
+    IrqNumber irq = -1;
+    iss >> action;
+    
+    if (action.empty() || action == "list") {
+        oss << "IRQ  Name             Prio  Cost  Enabled  Pending  Dispatched";
+        for (const auto& entry : irqNumbers) {
+            IrqNumber number = entry.second;
+            oss << "\n" << std::setw(3) << number << "  " << std::left << std::setw(15) << entry.first << std::right
+                << "  " << std::setw(4) << static_cast<int>(interrupts.getPriority(number))
+                << "  " << std::setw(4) << interrupts.getHandlerCost(number)
+                << "  " << std::setw(7) << (interrupts.isEnabled(number) ? "yes" : "no")
+                << "  " << std::setw(7) << (interrupts.isPending(number) ? "yes" : "no")
+                << "  " << interrupts.getDispatchCount(number);
+        }
+        oss << "\nActive depth: " << interrupts.getActiveDepth() << " (max " << interrupts.getMaxActiveDepth() << ")"
+            << ", preemptions: " << interrupts.getPreemptions()
+            << ", tail-chains: " << interrupts.getTailChains()
+            << ", late arrivals: " << interrupts.getLateArrivals();
+        if (interrupts.isGloballyMasked()) {
+            oss << "\nAll interrupts masked";
+        }
+        if (interrupts.getOverflowRaises() > 0) {
+            oss << "\nRaises past a full ring: " << interrupts.getOverflowRaises();
+        }
+    }
+    else if (action == "mask" || action == "unmask") {
+        interrupts.setGlobalMask(action == "mask");
+        oss << (action == "mask" ? "All interrupts masked" : "Interrupts unmasked");
+    }
+    else if (action == "timing") {
+        long long entry = -1, tailChain = -1;
+        if (!(iss >> entry >> tailChain) || entry < 0 || tailChain < 0 || entry > UINT32_MAX || tailChain > UINT32_MAX) {
+            oss << "Usage: irq timing <entry_cycles> <tailchain_cycles>";
+        } else {
+            interrupts.setExceptionTiming(static_cast<uint32_t>(entry), static_cast<uint32_t>(tailChain));
+            oss << "Exception entry " << entry << " cycles, tail-chain " << tailChain << " cycles";
+        }
+    }
+    else if (!(iss >> target) || !resolveIrq(target, irq)) {
+        oss << "Usage: irq [list|mask|unmask|timing <entry> <tailchain>|raise|enable|disable <irq>|priority <irq> <0-255>|cost <irq> <cycles>]";
+    }
+    else if (action == "raise") {
+        triggerInterrupt(irq);
+        oss << "Raised IRQ " << irq;
+    }
+    else if (action == "enable") {
+        interrupts.enable(irq);
+        oss << "Enabled IRQ " << irq;
+    }
+    else if (action == "disable") {
+        interrupts.disable(irq);
+        oss << "Disabled IRQ " << irq << " (raises stay pending)";
+    }
+    else if (action == "priority") {
+        int priority = -1;
+        if (!(iss >> priority) || priority < 0 || priority > 255) {
+            oss << "Usage: irq priority <irq> <0-255>";
+        } else {
+            interrupts.setPriority(irq, static_cast<uint8_t>(priority));
+            oss << "IRQ " << irq << " priority set to " << priority;
+        }
+    }
+    else if (action == "cost") {
+        long long cycles = -1;
+        if (!(iss >> cycles) || cycles < 0 || cycles > UINT32_MAX) {
+            oss << "Usage: irq cost <irq> <cycles>";
+        } else {
+            interrupts.setHandlerCost(irq, static_cast<uint32_t>(cycles));
+            oss << "IRQ " << irq << " handler cost set to " << cycles << " cycles";
+        }
+    }
+    else {
+        oss << "Usage: irq [list|mask|unmask|timing <entry> <tailchain>|raise|enable|disable <irq>|priority <irq> <0-255>|cost <irq> <cycles>]";
+    }
+    
+    return oss.str();
+}
+
+std::string System::describeIrqStats() const
+{
+    std::ostringstream oss;
+    bool any = false;
+    
+    oss << "Interrupt latency, raise to handler start:";
+    for (const auto& entry : irqNumbers) {
+        IrqNumber irq = entry.second;
+        if (interrupts.getCycleLatency(irq).getCount() == 0) {
+            continue;
+        }
+        any = true;
+        oss << "\nIRQ " << irq << " (" << entry.first << ")";
+        oss << "\n cycles: " << interrupts.getCycleLatency(irq).format(" cyc");
+        oss << "\n wall:   " << interrupts.getWallLatency(irq).format(" ns");
+    }
+    if (!any) {
+        oss << "\n(no interrupts dispatched yet)";
+    }
+    
+    return oss.str();
+}
+
+bool System::writeIrqStats(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file) {
+        return false;
+    }
+    
+    file << "Clock cycles: " << clock.getClockCycles() << "\n";
+    file << describeSpeed() << "\n";
+    file << describeIrqStats() << "\n";
+    return static_cast<bool>(file);
+}
+
+std::string System::describeGpio() const
+{
+    std::ostringstream oss;
+    oss << std::hex << std::setfill('0');
+    
+    oss << gpioA.getName() << ":"
+        << " MODER=0x" << std::setw(8) << gpioA.readRegister(GpioPort::MODER)
+        << " IDR=0x" << std::setw(8) << gpioA.readRegister(GpioPort::IDR)
+        << " ODR=0x" << std::setw(8) << gpioA.readRegister(GpioPort::ODR)
+        << "\n       RTSR=0x" << std::setw(8) << gpioA.readRegister(GpioPort::RTSR)
+        << " FTSR=0x" << std::setw(8) << gpioA.readRegister(GpioPort::FTSR)
+        << " PR=0x" << std::setw(8) << gpioA.readRegister(GpioPort::PR);
+    
+    return oss.str();
+}
+
+std::string System::applyGpioCommand(std::istringstream& iss)
+{
+    static const std::map<std::string, uint32_t> registers = {
+        {"moder", GpioPort::MODER}, {"odr", GpioPort::ODR}, {"bsrr", GpioPort::BSRR},
+        {"brr", GpioPort::BRR}, {"rtsr", GpioPort::RTSR}, {"ftsr", GpioPort::FTSR}, {"pr", GpioPort::PR}
+    };
+    const std::string usage = "Usage: gpio [write <moder|odr|bsrr|brr|rtsr|ftsr|pr> <hex>|drive <pin> <0|1>]";
+    
+    std::string action;
+    if (!(iss >> action)) {
+        return describeGpio();
+    }
+    
+    if (action == "write") {
+        std::string reg;
+        uint32_t value = 0;
+        iss >> reg >> std::hex >> value >> std::dec;
+        auto it = registers.find(reg);
+        if (!iss || it == registers.end()) {
+            return usage;
+        }
+        gpioA.writeRegister(it->second, value);
+        return describeGpio();
+    }
+    
+    if (action == "drive") {
+        int pin = -1;
+        int level = -1;
+        if (!(iss >> pin >> level) || pin < 0 || pin >= GpioPort::PIN_COUNT || (level != 0 && level != 1)) {
+            return usage;
+        }
+        uint32_t bit = 1U << pin;
+        gpioA.driveInputs(bit, level ? bit : 0);
+        return describeGpio();
+    }
+    
+    return usage;
+}
+
+bool System::startStimulus(const std::string& path, std::string& error)
+{
+    if (!stimulus.load(path, error)) {
+        return false;
+    }
+    
+    // Each batch holds every transition due at one cycle; pins are button
+    // handles. They are queued behind the edges before that cycle.
+    stimulus.start(clock, [this](const StimulusRecord* records, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            EdgeBatch change{EDGE_BUTTON, 0, 0, static_cast<int>(records[i].pin), records[i].value != 0};
+            pushEdges(change);
+        }
+    });
+    return true;
+}
+
+std::string System::describeStimulus() const
+{
+    size_t total = stimulus.getRecordCount();
+    if (total == 0 && stimulus.getPath().empty()) {
+        return "Stimulus: none loaded";
+    }
+    
+    std::ostringstream oss;
+    oss << "Stimulus: " << stimulus.getPath() << ", " << stimulus.getPlayedCount() << "/" << total
+        << " records played" << (stimulus.isPlaying() ? "" : " (stopped)");
+    return oss.str();
+}
+
+std::string System::applyStimulusCommand(std::istringstream& iss)
+{
+    const std::string usage = "Usage: stim [load <file>|convert <text> <file>|stop]";
+    
+    std::string action;
+    if (!(iss >> action)) {
+        return describeStimulus();
+    }
+    
+    std::string error;
+    if (action == "load") {
+        std::string path;
+        if (!(iss >> path)) {
+            return usage;
+        }
+        if (!startStimulus(path, error)) {
+            return "Error: " + error;
+        }
+        return describeStimulus();
+    }
+    
+    if (action == "convert") {
+        std::string textPath;
+        std::string binaryPath;
+        if (!(iss >> textPath >> binaryPath)) {
+            return usage;
+        }
+        if (!StimulusPlayer::convertText(textPath, binaryPath, error)) {
+            return "Error: " + error;
+        }
+        return "Wrote stimulus file " + binaryPath;
+    }
+    
+    if (action == "stop") {
+        stimulus.stop();
+        return describeStimulus();
+    }
+    
+    return usage;
+}
+
+void System::declareTraceSignals()
+{
+    if (clockSignal == VcdWriter::INVALID_SIGNAL) {
+        clockSignal = trace.addSignal("clk", 1);
+        gpioSignal = trace.addSignal(gpioA.getName() + "_IDR", GpioPort::PIN_COUNT);
+        rolloverSignal = trace.addSignal("timer_rollovers", 32);
+    }
+    
+    // Button states are 2-bit ButtonState values, one signal per handle
+    std::vector<Button> buttons = io.getButtons();
+    for (size_t i = buttonSignals.size(); i < buttons.size(); ++i) {
+        buttonSignals.push_back(trace.addSignal(buttons[i].name + "_state", 2));
+    }
+}
+
+bool System::startTrace(const std::string& path, std::string& error)
+{
+    stopTrace();
+    
+    // The trace starts on a cycle boundary, where the clock is at its start
+    // value. The simulation thread may still be stepping earlier cycles;
+    // it writes nothing before this one.
+    long long startCycle = clock.getClockCycles();
+    uint64_t period = static_cast<uint64_t>(clock.getSystemClockPeriodInNanoseconds());
+    uint64_t now = static_cast<uint64_t>(startCycle) * period;
+    traceStartCycle = startCycle;
+    trace.change(clockSignal, clock.getStartPulseValue() ? 1 : 0, now);
+    {
+        std::lock_guard<std::mutex> ioLock(ioMutex);
+        traceIO(now);
+    }
+    return trace.open(path, now, error);
+}
+
+void System::stopTrace()
+{
+    trace.close();
+}
+
+// Caller holds ioMutex; the writer drops values that have not changed.
+// Changes are stamped with the rising edge they were sampled on.
+void System::traceIO(uint64_t now)
+{
+    tracedButtons.resize(buttonSignals.size());
+    for (size_t i = 0; i < buttonSignals.size(); ++i) {
+        tracedButtons[i] = io.getButtonState(static_cast<ButtonHandle>(i));
+        trace.change(buttonSignals[i], static_cast<uint64_t>(tracedButtons[i]), now);
+    }
+    tracedPins = gpioA.readPins();
+    trace.change(gpioSignal, tracedPins, now);
+}
+
+// Caller holds ioMutex. Lets the simulation thread skip cycles where
+// traceIO() would write nothing.
+bool System::ioChangedSinceTrace() const
+{
+    if (gpioA.readPins() != tracedPins || tracedButtons.size() != buttonSignals.size()) {
+        return true;
+    }
+    for (size_t i = 0; i < tracedButtons.size(); ++i) {
+        if (io.getButtonState(static_cast<ButtonHandle>(i)) != tracedButtons[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Simulation thread. Each cycle in [fromCycle, toCycle) adds its
+// mid-period toggle and the next cycle's start edge.
+void System::traceClock(long long fromCycle, long long toCycle)
+{
+    if (toCycle <= fromCycle) {
+        return;
+    }
+    uint64_t period = static_cast<uint64_t>(clock.getSystemClockPeriodInNanoseconds());
+    uint64_t firstEdge = static_cast<uint64_t>(fromCycle) * period + period / 2;
+    trace.clockEdges(clockSignal, firstEdge, period / 2, 2 * (toCycle - fromCycle),
+                     !clock.getStartPulseValue());
+}
+
+std::string System::describeTrace() const
+{
+    if (!trace.isOpen()) {
+        return "Trace: off";
+    }
+    
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1)
+        << "Trace: " << trace.getPath() << ", "
+        << static_cast<double>(trace.getBytesWritten()) / (1024.0 * 1024.0) << " MiB written";
+    return oss.str();
+}
+
+// Moves serial output to the display terminal (or stdout) in one batch per
+// step, so fast traffic costs the GUI one append rather than one per byte
+void System::bridgeUart()
+{
+    if (uart0.isPtyOpen()) {
+        return;
+    }
+    
+    char chunk[4096];
+    size_t count = 0;
+    std::string text;
+    while (text.size() < 65536 && (count = uart0.drainHost(chunk, sizeof(chunk))) > 0) {
+        text.append(chunk, count);
+    }
+    if (text.empty()) {
+        return;
+    }
+    
+    if (!display) {
+        std::cout << text << std::flush;
+        return;
+    }
+    
+    // The terminal appends whole lines; hold back a partial one unless it gets long
+    uartLine += text;
+    size_t lastNewline = uartLine.rfind('\n');
+    if (lastNewline == std::string::npos && uartLine.size() < 4096) {
+        return;
+    }
+    size_t end = lastNewline == std::string::npos ? uartLine.size() : lastNewline;
+    display->appendTerminalOutput(QString::fromStdString(uartLine.substr(0, end)));
+    uartLine.erase(0, lastNewline == std::string::npos ? end : end + 1);
+}
+
+std::string System::describeUart() const
+{
+    std::ostringstream oss;
+    oss << uart0.getName() << ": " << uart0.getBaudRate() << " baud, "
+        << uart0.getTxCount() << " sent, " << uart0.getRxCount() << " received, "
+        << uart0.getOverruns() << " overruns, bridged to "
+        << (uart0.isPtyOpen() ? uart0.getPtyPath() : std::string(display ? "the terminal" : "stdout"));
+    if (uart0.getHostDrops() > 0) {
+        oss << " (" << uart0.getHostDrops() << " bytes dropped on the host side)";
+    }
+    return oss.str();
+}
+
+std::string System::applyUartCommand(std::istringstream& iss)
+{
+    const std::string usage = "Usage: uart [baud <rate>|send <text>|pty [close]]";
+    
+    std::string action;
+    if (!(iss >> action)) {
+        return describeUart();
+    }
+    
+    if (action == "baud") {
+        uint32_t baud = 0;
+        if (!(iss >> baud) || baud == 0) {
+            return usage;
+        }
+        uart0.setBaudRate(baud);
+        return describeUart();
+    }
+    
+    if (action == "send") {
+        if (uart0.isPtyOpen()) {
+            return "Error: " + uart0.getName() + " input comes from " + uart0.getPtyPath();
+        }
+        std::string text;
+        std::getline(iss >> std::ws, text);
+        text += '\n';
+        size_t sent = uart0.feedHost(text.data(), text.size());
+        return "Queued " + std::to_string(sent) + " bytes for " + uart0.getName();
+    }
+    
+    if (action == "pty") {
+        std::string option;
+        if (iss >> option) {
+            if (option != "close") {
+                return usage;
+            }
+            uart0.closePty();
+            return describeUart();
+        }
+        std::string path;
+        std::string error;
+        if (!uart0.openPty(path, error)) {
+            return "Error: " + error;
+        }
+        return uart0.getName() + " bridged to " + path;
+    }
+    
+    return usage;
+}
+
+std::string System::describeAdc() const
+{
+    std::ostringstream oss;
+    uint32_t scan = adc1.getScanMask();
+    oss << adc1.getName() << ": " << (adc1.isBusy() ? "converting" : "idle")
+        << ", " << adc1.getConversionCycles() << " cycles per conversion, "
+        << adc1.getConversions() << " conversions, " << adcResultsRead.load() << " read, "
+        << adc1.getOverruns() << " overruns";
+    for (int channel = 0; channel < Adc::CHANNELS; ++channel) {
+        std::string source = adc1.describeSource(channel);
+        if (source == "none" && !((scan >> channel) & 1)) {
+            continue;
+        }
+        oss << "\n  ch" << channel << ((scan >> channel) & 1 ? "*" : " ")
+            << " = " << adc1.getChannelResult(channel) << "  (" << source << ")";
+    }
+    return oss.str();
+}
+
+std::string System::applyAdcCommand(std::istringstream& iss)
+{
+    const std::string usage = "Usage: adc [source <ch> <sine <period> [amp] [offset]|noise <mean> <amp>|ramp <step>|file <path>|none>"
+                              "|scan <hex mask>|time <cycles>|start [cont]|stop]";
+    
+    std::string action;
+    if (!(iss >> action)) {
+        return describeAdc();
+    }
+    
+    if (action == "source") {
+        int channel = -1;
+        std::string kind;
+        if (!(iss >> channel >> kind) || channel < 0 || channel >= Adc::CHANNELS) {
+            return usage;
+        }
+        
+        std::unique_ptr<SampleSource> source;
+        if (kind == "sine") {
+            double period = 0.0;
+            double amplitude = 2000.0;
+            double offset = 2048.0;
+            if (!(iss >> period)) {
+                return usage;
+            }
+            iss >> amplitude >> offset;
+            source.reset(new SineSampleSource(period, amplitude, offset));
+        } else if (kind == "noise") {
+            double mean = 0.0;
+            double amplitude = 0.0;
+            if (!(iss >> mean >> amplitude)) {
+                return usage;
+            }
+            source.reset(new NoiseSampleSource(mean, amplitude));
+        } else if (kind == "ramp") {
+            int step = 0;
+            if (!(iss >> step) || step <= 0 || step > SampleSource::FULL_SCALE) {
+                return usage;
+            }
+            source.reset(new RampSampleSource(static_cast<uint16_t>(step)));
+        } else if (kind == "file") {
+            std::string path;
+            std::string error;
+            if (!(iss >> path)) {
+                return usage;
+            }
+            std::unique_ptr<FileSampleSource> file(new FileSampleSource());
+            if (!file->open(path, error)) {
+                return "Error: " + error;
+            }
+            source = std::move(file);
+        } else if (kind != "none") {
+            return usage;
+        }
+        
+        adc1.setSource(channel, std::move(source));
+        return describeAdc();
+    }
+    
+    if (action == "scan") {
+        uint32_t mask = 0;
+        if (!(iss >> std::hex >> mask >> std::dec)) {
+            return usage;
+        }
+        adc1.writeRegister(Adc::SQR, mask);
+        return describeAdc();
+    }
+    
+    if (action == "time") {
+        uint32_t cycles = 0;
+        if (!(iss >> cycles) || cycles == 0) {
+            return usage;
+        }
+        adc1.writeRegister(Adc::SMPR, cycles);
+        return describeAdc();
+    }
+    
+    if (action == "start") {
+        std::string mode;
+        iss >> mode;
+        uint32_t control = Adc::CR_START | Adc::CR_EOCIE | (mode == "cont" ? Adc::CR_CONT : 0);
+        adc1.writeRegister(Adc::CR, control);
+        return describeAdc();
+    }
+    
+    if (action == "stop") {
+        adc1.writeRegister(Adc::CR, Adc::CR_STOP | Adc::CR_EOCIE);
+        return describeAdc();
+    }
+    
+    return usage;
+}
+
+// One register of a peripheral's interface. Writes to a strobe register
+// act on the bits written (write 1 to set or clear, FIFO pushes) or are
+// ignored, so narrow writes pass through as they are; any other register
+// merges a narrow write into its live value first.
+struct PeripheralRegister {
+    const char* name;
+    uint32_t offset;
+    bool strobe;
+};
+
+// Exposes a peripheral's existing register interface on the bus; every
+// register is hooked, since reads and writes all have side effects
+template <typename Peripheral>
+static void addPeripheralRegisters(RegisterFile& file, Peripheral& peripheral,
+                                   std::initializer_list<PeripheralRegister> registers)
+{
+    for (const PeripheralRegister& entry : registers) {
+        uint32_t offset = entry.offset;
+        bool strobe = entry.strobe;
+        file.addHooked(entry.name, offset, 4,
+                       [&peripheral, offset]() {return peripheral.readRegister(offset); },
+                       [&peripheral, offset, strobe](uint32_t value, uint32_t mask) {
+            if (!strobe && mask != 0xFFFFFFFFu) {
+                value |= peripheral.readRegister(offset) & ~mask;
+            }
+            peripheral.writeRegister(offset, value);
+        });
+    }
+}
+
+void System::buildMemoryMap()
+{
+    // System control: identity, a 64-bit cycle counter (reading CYCLES_LO
+    // latches CYCLES_HI) and plain scratch registers
+    sysctrlRegisters.addReadOnly("ID", 0x00, 0x454D4253);
+    sysctrlRegisters.addHooked("CYCLES_LO", 0x04, 4, [this]() {
+        uint64_t cycles = static_cast<uint64_t>(clock.getClockCycles());
+        cycleLatchHigh = static_cast<uint32_t>(cycles >> 32);
+        return static_cast<uint32_t>(cycles);
+    }, RegisterFile::WriteHook());
+    sysctrlRegisters.addHooked("CYCLES_HI", 0x08, 4, [this]() {return cycleLatchHigh.load(); },
+                               RegisterFile::WriteHook());
+    for (uint32_t i = 0; i < 4; ++i) {
+        sysctrlRegisters.add<uint32_t>("SCRATCH" + std::to_string(i), 0x10 + 4 * i);
+    }
+
+    addPeripheralRegisters(uartRegisters, uart0, {
+        {"DR", Uart::DR, true}, {"SR", Uart::SR, true}, {"CR", Uart::CR, false}, {"BRR", Uart::BRR, false}
+    });
+    addPeripheralRegisters(adcRegisters, adc1, {
+        {"CR", Adc::CR, false}, {"SR", Adc::SR, true}, {"SQR", Adc::SQR, false}, {"SMPR", Adc::SMPR, false},
+        {"DR", Adc::DR, true}, {"FDR", Adc::FDR, true},
+        {"CDR0", Adc::CDR, true}, {"CDR1", Adc::CDR + 4, true}, {"CDR2", Adc::CDR + 8, true}, {"CDR3", Adc::CDR + 12, true},
+        {"CDR4", Adc::CDR + 16, true}, {"CDR5", Adc::CDR + 20, true}, {"CDR6", Adc::CDR + 24, true}, {"CDR7", Adc::CDR + 28, true}
+    });
+    addPeripheralRegisters(gpioRegisters, gpioA, {
+        {"MODER", GpioPort::MODER, false}, {"IDR", GpioPort::IDR, true}, {"ODR", GpioPort::ODR, false},
+        {"BSRR", GpioPort::BSRR, true}, {"BRR", GpioPort::BRR, true}, {"RTSR", GpioPort::RTSR, false},
+        {"FTSR", GpioPort::FTSR, false}, {"PR", GpioPort::PR, true}
+    });
+
+    // 4 MiB of flash; SRAM and CCM RAM share one arena
+    std::string error;
+    uint8_t* sram = nullptr;
+    uint8_t* ccmram = nullptr;
+    if (!flash.reserve(4 << 20, error) || !sramArena.reserve(192 << 10, error) ||
+        !(sram = sramArena.allocate(128 << 10)) || !(ccmram = sramArena.allocate(64 << 10))) {
+        std::cout << "Error: " << (error.empty() ? "SRAM arena too small" : error) << "\n";
+        return;
+    }
+
+    if (!bus.mapMemory("FLASH", Bus::FLASH, 0x08000000, flash.getData(), static_cast<uint32_t>(flash.getSize()), true, error) ||
+        !bus.mapMemory("CCMRAM", Bus::SRAM, 0x10000000, ccmram, 64 << 10, false, error) ||
+        !bus.mapMemory("SRAM", Bus::SRAM, 0x20000000, sram, 128 << 10, false, error) ||
+        !bus.mapRegisters(0x40000000, sysctrlRegisters, error) || !bus.mapRegisters(0x40011000, uartRegisters, error) ||
+        !bus.mapRegisters(0x40012000, adcRegisters, error) || !bus.mapRegisters(0x40020000, gpioRegisters, error)) {
+        std::cout << "Error: " << error << "\n";
+    }
+    
+    bus.setWatchHandler([this](const Bus::WatchHit& hit) {
+        onWatchHit(hit);
+    });
+}
+
+bool System::loadFlash(const std::string& path, std::string& error)
+{
+    // A failure part way through can still have replaced some of flash
+    bool loaded = flash.load(path, error);
+    cpu.invalidateCache();
+    return loaded;
+}
+
+std::string System::describeFlash() const
+{
+    std::ostringstream oss;
+    oss << "Flash: " << flash.getSize() / 1024 << " KiB at 0x08000000, ";
+    if (flash.getPath().empty()) {
+        oss << "erased";
+    } else {
+        oss << flash.getPath() << " (" << flash.getImageSize() << " bytes, copy-on-write)";
+    }
+    return oss.str();
+}
+
+std::string System::applyFlashCommand(std::istringstream& iss)
+{
+    const std::string usage = "Usage: flash [load <file>|erase]";
+    
+    std::string action;
+    if (!(iss >> action)) {
+        return describeFlash();
+    }
+    
+    if (action == "load") {
+        std::string path;
+        std::string error;
+        if (!(iss >> path)) {
+            return usage;
+        }
+        if (!loadFlash(path, error)) {
+            return "Error: " + error;
+        }
+        return describeFlash();
+    }
+    
+    if (action == "erase") {
+        std::string error;
+        bool erased = flash.unload(error);
+        cpu.invalidateCache();
+        if (!erased) {
+            return "Error: " + error;
+        }
+        return describeFlash();
+    }
+    
+    return usage;
+}
+
+std::string System::describeBusAddress(uint32_t address) const
+{
+    std::ostringstream oss;
+    oss << "0x" << std::hex << std::setw(8) << std::setfill('0') << address << std::dec;
+    const Bus::Region* region = bus.findRegion(address);
+    if (!region) {
+        return oss.str();
+    }
+
+    uint32_t offset = address - region->base;
+    oss << " (" << region->name;
+    if (region->registers) {
+        for (const RegisterFile::Info& info : region->registers->getRegisters()) {
+            if (offset >= info.offset && offset < info.offset + info.width) {
+                oss << "." << info.name;
+                break;
+            }
+        }
+    } else {
+        oss << "+0x" << std::hex << offset << std::dec;
+    }
+    oss << ")";
+    return oss.str();
+}
+
+std::string System::describeBus() const
+{
+    return bus.describeMap() + "\n" + std::to_string(bus.getFaultCount()) + " bus faults";
+}
+
+// Runs on the thread that made the access; a breaking watchpoint halts the
+// CPU and pauses the simulation through the same interrupt as the pause
+// command
+void System::onWatchHit(const Bus::WatchHit& hit)
+{
+    std::ostringstream oss;
+    oss << "Watchpoint " << hit.id << ": " << (hit.write ? "write " : "read ") << describeBusAddress(hit.address)
+        << (hit.write ? " <- 0x" : " -> 0x") << std::hex << std::setw(2 * hit.width) << std::setfill('0') << hit.value
+        << std::dec << " at cycle " << clock.getClockCycles() << "\n";
+    std::cout << oss.str();
+    if (hit.breaks) {
+        cpu.requestHalt();
+        interrupts.raise(pauseIrq);
+    }
+}
+
+std::string System::describeWatchpoints() const
+{
+    std::vector<Bus::Watchpoint> watchpoints = bus.getWatchpoints();
+    if (watchpoints.empty()) {
+        return "No watchpoints";
+    }
+
+    std::ostringstream oss;
+    for (size_t i = 0; i < watchpoints.size(); ++i) {
+        const Bus::Watchpoint& watchpoint = watchpoints[i];
+        oss << (i > 0 ? "\n" : "") << watchpoint.id << ": " << describeBusAddress(watchpoint.address)
+            << ", " << watchpoint.length << " bytes, "
+            << ((watchpoint.kinds & Bus::WATCH_READ) ? "r" : "") << ((watchpoint.kinds & Bus::WATCH_WRITE) ? "w" : "")
+            << (watchpoint.breaks ? ", break" : ", log") << ", " << watchpoint.hits << " hits";
+    }
+    return oss.str();
+}
+
+std::string System::applyWatchCommand(std::istringstream& iss)
+{
+    const std::string usage = "Usage: watch [add <hex addr|REGION.REGISTER> [length] [r|w|rw] [break]|list|remove <id>]";
+    
+    std::string action;
+    if (!(iss >> action) || action == "list") {
+        return describeWatchpoints();
+    }
+    
+    if (action == "add") {
+        std::string target;
+        if (!(iss >> target)) {
+            return usage;
+        }
+        
+        // Either a register by name, which also gives the length, or an address
+        uint32_t address = 0;
+        uint32_t length = 4;
+        size_t dot = target.find('.');
+        if (dot != std::string::npos) {
+            const Bus::Region* region = bus.findRegion(target.substr(0, dot));
+            const RegisterFile::Info* info = (region && region->registers)
+                ? region->registers->findRegister(target.substr(dot + 1)) : nullptr;
+            if (!info) {
+                return "Error: no register " + target;
+            }
+            address = region->base + info->offset;
+            length = info->width;
+        } else {
+            char* end = nullptr;
+            unsigned long long value = std::strtoull(target.c_str(), &end, 16);
+            if (*end != '\0' || value > 0xFFFFFFFFull) {
+                return usage;
+            }
+            address = static_cast<uint32_t>(value);
+        }
+        
+        unsigned kinds = Bus::WATCH_WRITE;
+        bool breaks = false;
+        std::string option;
+        while (iss >> option) {
+            if (option == "r") {
+                kinds = Bus::WATCH_READ;
+            } else if (option == "w") {
+                kinds = Bus::WATCH_WRITE;
+            } else if (option == "rw") {
+                kinds = Bus::WATCH_READ | Bus::WATCH_WRITE;
+            } else if (option == "break") {
+                breaks = true;
+            } else {
+                char* end = nullptr;
+                unsigned long value = std::strtoul(option.c_str(), &end, 0);
+                if (*end != '\0' || value == 0 || value > 0xFFFFFFFFul) {
+                    return usage;
+                }
+                length = static_cast<uint32_t>(value);
+            }
+        }
+        
+        std::string error;
+        int id = bus.addWatchpoint(address, length, kinds, breaks, error);
+        if (id < 0) {
+            return "Error: " + error;
+        }
+        return "Watchpoint " + std::to_string(id) + " on " + describeBusAddress(address);
+    }
+    
+    if (action == "remove") {
+        int id = 0;
+        if (!(iss >> id)) {
+            return usage;
+        }
+        return bus.removeWatchpoint(id) ? "Removed watchpoint " + std::to_string(id) : "Error: no watchpoint " + std::to_string(id);
+    }
+    
+    return usage;
+}
+
+// Peripheral handlers call this first with their EMBEDSIM_IRQ_ line; with
+// firmware running, on the core or natively, the interrupt is the
+// firmware's to service
+bool System::forwardToFirmware(int line)
+{
+    if (cpu.isRunning()) {
+        cpu.raiseInterrupt(line);
+        return true;
+    }
+    if (firmware.isRunning()) {
+        firmware.raiseInterrupt(line);
+        return true;
+    }
+    return false;
+}
+
+std::string System::describeCpu() const
+{
+    static const char* const names[32] = {
+        "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+        "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"
+    };
+    
+    Rv32Core::Snapshot snapshot = cpu.getSnapshot();
+    std::ostringstream oss;
+    oss << "CPU: RV32IM at " << cpu.getClockMultiplier() << "x the system clock, ";
+    if (snapshot.running) {
+        oss << (snapshot.waiting ? "waiting for interrupt" : "running");
+    } else {
+        oss << "halted (" << snapshot.haltReason << ")";
+    }
+    oss << "\n" << snapshot.instructions << " instructions in " << snapshot.cycles << " cycles";
+    if (snapshot.instructions > 0) {
+        oss << std::fixed << std::setprecision(2) << ", CPI " << static_cast<double>(snapshot.cycles) / snapshot.instructions;
+    }
+    oss << std::hex << std::setfill('0');
+    oss << "\npc " << std::setw(8) << snapshot.pc << "  mstatus " << std::setw(8) << snapshot.mstatus
+        << "  mcause " << std::setw(8) << snapshot.mcause << "  mepc " << std::setw(8) << snapshot.mepc;
+    for (int i = 0; i < 32; ++i) {
+        oss << (i % 4 == 0 ? "\n" : "  ") << std::setfill(' ') << std::left << std::setw(5) << names[i] << std::right
+            << std::setfill('0') << std::setw(8) << snapshot.regs[i];
+    }
+    return oss.str();
+}
+
+std::string System::applyCpuCommand(std::istringstream& iss)
+{
+    const std::string usage = "Usage: cpu [start|stop|reset|clock <multiplier>]";
+    
+    std::string action;
+    if (!(iss >> action)) {
+        return describeCpu();
+    }
+    
+    if (action == "start") {
+        cpu.start();
+        return "CPU started";
+    }
+    
+    if (action == "stop") {
+        cpu.halt("stopped from the CLI");
+        return describeCpu();
+    }
+    
+    if (action == "reset") {
+        cpu.reset();
+        return "CPU reset";
+    }
+    
+    if (action == "clock") {
+        uint32_t multiplier = 0;
+        if (!(iss >> multiplier) || multiplier == 0) {
+            return usage;
+        }
+        cpu.setClockMultiplier(multiplier);
+        return "CPU clock set to " + std::to_string(multiplier) + "x the system clock";
+    }
+    
+    return usage;
+}
+
+std::string System::applyFirmwareCommand(std::istringstream& iss)
+{
+    const std::string usage = "Usage: firmware [load <file.so>|unload]";
+    
+    std::string action;
+    if (!(iss >> action)) {
+        return firmware.describe();
+    }
+    
+    if (action == "load") {
+        std::string path;
+        std::string error;
+        if (!(iss >> path)) {
+            return usage;
+        }
+        if (!firmware.load(path, error)) {
+            return "Error: " + error;
+        }
+        return firmware.describe();
+    }
+    
+    if (action == "unload") {
+        std::string error;
+        if (!firmware.unload(error)) {
+            return "Error: " + error + "; still loaded, unload again to keep waiting";
+        }
+        return firmware.describe();
+    }
+    
+    return usage;
+}
+
+std::string System::applyBusCommand(std::istringstream& iss)
+{
+    const std::string usage = "Usage: bus [read <hex addr> [1|2|4]|write <hex addr> <hex value> [1|2|4]]";
+    
+    std::string action;
+    if (!(iss >> action)) {
+        return describeBus();
+    }
+    
+    uint32_t address = 0;
+    uint32_t value = 0;
+    unsigned width = 4;
+    if (action == "read") {
+        if (!(iss >> std::hex >> address >> std::dec)) {
+            return usage;
+        }
+        iss >> width;
+        if (width != 1 && width != 2 && width != 4) {
+            return usage;
+        }
+        if (!bus.read(address, width, value)) {
+            return "Bus fault reading " + describeBusAddress(address);
+        }
+        std::ostringstream oss;
+        oss << describeBusAddress(address) << " = 0x" << std::hex << std::setw(2 * width) << std::setfill('0') << value;
+        return oss.str();
+    }
+    
+    if (action == "write") {
+        if (!(iss >> std::hex >> address >> value >> std::dec)) {
+            return usage;
+        }
+        iss >> width;
+        if (width != 1 && width != 2 && width != 4) {
+            return usage;
+        }
+        if (!bus.write(address, width, value)) {
+            return "Bus fault writing " + describeBusAddress(address);
+        }
+        cpu.invalidateCache();
+        return "Wrote " + describeBusAddress(address);
+    }
+    
+    return usage;
+}
+
+static bool readHexBytes(std::istringstream& iss, std::vector<uint8_t>& bytes)
+{
+    std::string token;
+    while (iss >> token) {
+        char* end = nullptr;
+        unsigned long value = std::strtoul(token.c_str(), &end, 16);
+        if (*end != '\0' || value > 0xFF) {
+            return false;
+        }
+        bytes.push_back(static_cast<uint8_t>(value));
+    }
+    return true;
 }
 
-void System::registerInterrupt(const std::string& name, std::function<void()> handler)
+static std::string formatBytes(const std::vector<uint8_t>& bytes)
 {
-    interruptHandlers[name] = handler;
+    std::ostringstream oss;
+    oss << std::hex << std::setfill('0');
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        oss << (i > 0 ? " " : "") << std::setw(2) << static_cast<int>(bytes[i]);
+    }
+    return oss.str();
 }
 
-void System::triggerInterrupt(const std::string& name)
+std::string System::describeSpi() const
 {
-    auto it = interruptHandlers.find(name);
-    if (it != interruptHandlers.end()) {
-        it->second();
+    std::ostringstream oss;
+    oss << spi1.getName() << ": " << spi1.getBitRate() << " Hz, " << (spi1.isBusy() ? "busy" : "idle") << ", "
+        << spi1.getTransferCount() << " transfers, " << spi1.getByteCount() << " bytes";
+    for (int chipSelect = 0; chipSelect < SpiController::CHIP_SELECTS; ++chipSelect) {
+        std::string device = spi1.describeDevice(chipSelect);
+        if (device != "none") {
+            oss << "\n  cs" << chipSelect << ": " << device;
+        }
     }
+    return oss.str();
 }
 
-void System::stopClock()
+std::string System::applySpiCommand(std::istringstream& iss)
 {
-    std::cout << "Interrupt: Stopping clock\n";
-    clock.stop();
-    shouldStop = true;
+    const std::string usage = "Usage: spi [speed <hz>|xfer <cs> <hex bytes...>]";
+    
+    std::string action;
+    if (!(iss >> action)) {
+        return describeSpi();
+    }
+    
+    if (action == "speed") {
+        uint32_t hz = 0;
+        if (!(iss >> hz) || hz == 0) {
+            return usage;
+        }
+        spi1.setBitRate(hz);
+        return describeSpi();
+    }
+    
+    if (action == "xfer") {
+        int chipSelect = -1;
+        std::vector<uint8_t> mosi;
+        if (!(iss >> chipSelect) || !readHexBytes(iss, mosi) || mosi.empty() ||
+            !spi1.transfer(chipSelect, std::move(mosi))) {
+            return usage;
+        }
+        return "Queued transfer on " + spi1.getName() + " cs" + std::to_string(chipSelect);
+    }
+    
+    return usage;
 }
 
-void System::startClock()
+std::string System::describeI2c() const
 {
-    std::cout << "Interrupt: Starting clock\n";
-    clock.beginTicking(false);
-    shouldStop = false;
+    std::ostringstream oss;
+    oss << i2c1.getName() << ": " << i2c1.getBitRate() << " Hz, " << (i2c1.isBusy() ? "busy" : "idle") << ", "
+        << i2c1.getTransactionCount() << " transactions, " << i2c1.getNackCount() << " NACKed, "
+        << i2c1.getByteCount() << " bytes";
+    for (uint8_t address : i2c1.getDeviceAddresses()) {
+        oss << "\n  0x" << std::hex << static_cast<int>(address) << std::dec << ": " << i2c1.describeDevice(address);
+    }
+    return oss.str();
 }
 
-void System::pauseClock()
+std::string System::applyI2cCommand(std::istringstream& iss)
 {
-    std::cout << "Interrupt: Pausing clock\n";
-    clockPaused = true;
+    const std::string usage = "Usage: i2c [speed <hz>|write <addr> <hex bytes...>|read <addr> <count> [hex bytes to write first...]]";
+    
+    std::string action;
+    if (!(iss >> action)) {
+        return describeI2c();
+    }
+    
+    if (action == "speed") {
+        uint32_t hz = 0;
+        if (!(iss >> hz) || hz == 0) {
+            return usage;
+        }
+        i2c1.setBitRate(hz);
+        return describeI2c();
+    }
+    
+    if (action == "write" || action == "read") {
+        unsigned int address = 0;
+        long long readLength = 0;
+        std::vector<uint8_t> data;
+        if (!(iss >> std::hex >> address >> std::dec) || address > 0x7F) {
+            return usage;
+        }
+        if (action == "read" && (!(iss >> readLength) || readLength <= 0)) {
+            return usage;
+        }
+        if (readLength > static_cast<long long>(I2cController::MAX_READ_LENGTH)) {
+            return "Read count is limited to " + std::to_string(I2cController::MAX_READ_LENGTH) + " bytes";
+        }
+        if (!readHexBytes(iss, data) || (action == "write" && data.empty())) {
+            return usage;
+        }
+        i2c1.transact(static_cast<uint8_t>(address), std::move(data), static_cast<size_t>(readLength));
+        return "Queued transaction on " + i2c1.getName();
+    }
+    
+    return usage;
 }
 
-void System::resumeClock()
+std::string System::applyTraceCommand(std::istringstream& iss)
 {
-    std::cout << "Interrupt: Resuming clock\n";
-    clockPaused = false;
+    const std::string usage = "Usage: trace [start <file>|stop]";
+    
+    std::string action;
+    if (!(iss >> action)) {
+        return describeTrace();
+    }
+    
+    if (action == "start") {
+        std::string path;
+        std::string error;
+        if (!(iss >> path)) {
+            return usage;
+        }
+        if (!startTrace(path, error)) {
+            return "Error: " + error;
+        }
+        return describeTrace();
+    }
+    
+    if (action == "stop") {
+        std::string path = trace.getPath();
+        bool wasOpen = trace.isOpen();
+        stopTrace();
+        return wasOpen ? "Trace written to " + path : describeTrace();
+    }
+    
+    return usage;
 }
 
 void System::setupInterruptHandlers()
 {
-    // Register interrupt handlers for clock control
+    // Register interrupt handlers for clock control. Stop requests get the
+    // highest priority so they win over anything raised alongside them.
     registerInterrupt("stop_clock", [this]() {
         stopClock();
-    });
+    }, 0);
     
     registerInterrupt("start_clock", [this]() {
-        startClock();
+        deferredWork.fetch_or(DEFER_START_CLOCK);
     });
     
-    registerInterrupt("pause_clock", [this]() {
+    pauseIrq = registerInterrupt("pause_clock", [this]() {
         pauseClock();
     });
     
@@ -126,12 +1487,79 @@ void System::setupInterruptHandlers()
     registerInterrupt("user_stop", [this]() {
         std::cout << "Interrupt: User requested stop\n";
         shouldStop = true;
+    }, 0);
+    
+    // Raised from the clock thread whenever a managed timer rolls over
+    timerIrq = registerInterrupt("timer_rollover", [this]() {
+        deferredWork.fetch_or(DEFER_TIMER_DISPLAY);
     });
     
     registerInterrupt("toggle_flag", [this]() {
         std::cout << "Interrupt: Toggling global flag\n";
         globalInterruptFlag = !globalInterruptFlag;
     });
+    
+    // Edge interrupt for port A; acknowledges the pins it reports
+    IrqNumber gpioIrq = registerInterrupt("gpioa", [this]() {
+        if (forwardToFirmware(EMBEDSIM_IRQ_GPIOA)) {
+            return;
+        }
+        uint32_t edges = gpioA.getPending();
+        std::cout << "Interrupt: GPIOA edge on pins 0x" << std::hex << edges << std::dec << "\n";
+        gpioA.writeRegister(GpioPort::PR, edges);
+    });
+    gpioA.setInterruptLine(&interrupts, gpioIrq);
+    
+    // Stand-in firmware for the serial console: echo whatever arrives
+    IrqNumber uartIrq = registerInterrupt("uart0", [this]() {
+        if (forwardToFirmware(EMBEDSIM_IRQ_UART0)) {
+            return;
+        }
+        char received[Uart::FIFO_DEPTH];
+        size_t count = uart0.read(received, sizeof(received));
+        uart0.write(received, count);
+    });
+    uart0.setInterruptLine(&interrupts, uartIrq);
+    uart0.writeRegister(Uart::CR, Uart::CR_RXIE);
+    
+    // Drain conversions in bulk, as a DMA channel would
+    IrqNumber adcIrq = registerInterrupt("adc1", [this]() {
+        if (forwardToFirmware(EMBEDSIM_IRQ_ADC1)) {
+            return;
+        }
+        AdcResult results[256];
+        size_t count = 0;
+        while ((count = adc1.readResults(results, 256)) > 0) {
+            adcResultsRead += count;
+        }
+    });
+    adc1.setInterruptLine(&interrupts, adcIrq);
+    
+    // Report finished bus transfers; interrupts that arrive together
+    // coalesce, so only the latest is shown
+    IrqNumber spiIrq = registerInterrupt("spi1", [this]() {
+        if (forwardToFirmware(EMBEDSIM_IRQ_SPI1)) {
+            return;
+        }
+        SpiTransfer transfer = spi1.getLastTransfer();
+        std::cout << "Interrupt: " << spi1.getName() << " cs" << transfer.chipSelect
+                  << " received " << formatBytes(transfer.miso) << "\n";
+    });
+    spi1.setInterruptLine(&interrupts, spiIrq);
+    
+    IrqNumber i2cIrq = registerInterrupt("i2c1", [this]() {
+        if (forwardToFirmware(EMBEDSIM_IRQ_I2C1)) {
+            return;
+        }
+        I2cTransaction transaction = i2c1.getLastTransaction();
+        std::cout << "Interrupt: " << i2c1.getName() << " 0x" << std::hex << static_cast<int>(transaction.address)
+                  << std::dec << (transaction.acked ? " ACK" : " NACK");
+        if (!transaction.read.empty()) {
+            std::cout << ", read " << formatBytes(transaction.read);
+        }
+        std::cout << "\n";
+    });
+    i2c1.setInterruptLine(&interrupts, i2cIrq);
 }
 
 void System::startCLIThread()
@@ -190,6 +1618,7 @@ void System::handleUserInput(const std::string& input)
         std::string buttonName;
         iss >> buttonName;
         if (!buttonName.empty()) {
+            std::lock_guard<std::mutex> ioLock(ioMutex);
             io.setButtonPressed(buttonName, true);
             std::cout << "Simulated button press for: " << buttonName << "\n";
         }
@@ -198,6 +1627,7 @@ void System::handleUserInput(const std::string& input)
         std::string buttonName;
         iss >> buttonName;
         if (!buttonName.empty()) {
+            std::lock_guard<std::mutex> ioLock(ioMutex);
             io.setButtonPressed(buttonName, false);
             std::cout << "Simulated button release for: " << buttonName << "\n";
         }
@@ -206,6 +1636,7 @@ void System::handleUserInput(const std::string& input)
         std::string buttonName;
         iss >> buttonName;
         if (!buttonName.empty()) {
+            std::lock_guard<std::mutex> ioLock(ioMutex);
             io.resetButton(buttonName);
             std::cout << "Reset button: " << buttonName << "\n";
         }
@@ -215,9 +1646,18 @@ void System::handleUserInput(const std::string& input)
         std::cout << "Clock paused: " << (clockPaused.load() ? "YES" : "NO") << "\n";
         std::cout << "Global flag: " << (globalInterruptFlag.load() ? "ON" : "OFF") << "\n";
         std::cout << "Clock cycles: " << clock.getClockCycles() << "\n";
+        std::cout << describeSpeed() << "\n";
+        std::cout << describeTimerBank() << "\n";
+        std::cout << describeTrace() << "\n";
+        std::cout << describeEdges() << "\n";
         
         // Show button states
-        for (const auto& button : io.getButtons()) {
+        std::vector<Button> buttons;
+        {
+            std::lock_guard<std::mutex> ioLock(ioMutex);
+            buttons = io.getButtons();
+        }
+        for (const auto& button : buttons) {
             std::cout << "Button " << button.name << ": ";
             std::cout << "Input=" << (button.inputState ? "HIGH" : "LOW") << ", ";
             std::cout << "State=";
@@ -230,6 +1670,93 @@ void System::handleUserInput(const std::string& input)
             std::cout << "\n";
         }
     }
+    else if (command == "speed") {
+        std::string value;
+        double ratio = 0.0;
+        if (!(iss >> value)) {
+            std::cout << describeSpeed() << "\n";
+        } else if (parseSpeedRatio(value, ratio)) {
+            setSpeedRatio(ratio);
+            std::cout << "Speed set to " << value << "\n";
+        } else {
+            std::cout << "Usage: speed [<ratio>|max]\n";
+        }
+    }
+    else if (command == "timing") {
+        std::string option;
+        if (!(iss >> option)) {
+            std::cout << describeTiming() << "\n";
+        } else if (applyTimingCommand(option)) {
+            std::cout << "Timing: " << option << "\n";
+        } else {
+            std::cout << "Usage: timing [reset|hybrid|sleep]\n";
+        }
+    }
+    else if (command == "irq") {
+        std::cout << applyIrqCommand(iss) << "\n";
+    }
+    else if (command == "gpio") {
+        std::cout << applyGpioCommand(iss) << "\n";
+    }
+    else if (command == "stim") {
+        std::cout << applyStimulusCommand(iss) << "\n";
+    }
+    else if (command == "trace") {
+        std::cout << applyTraceCommand(iss) << "\n";
+    }
+    else if (command == "uart") {
+        std::cout << applyUartCommand(iss) << "\n";
+    }
+    else if (command == "adc") {
+        std::cout << applyAdcCommand(iss) << "\n";
+    }
+    else if (command == "spi") {
+        std::cout << applySpiCommand(iss) << "\n";
+    }
+    else if (command == "bus") {
+        std::cout << applyBusCommand(iss) << "\n";
+    }
+    else if (command == "flash") {
+        std::cout << applyFlashCommand(iss) << "\n";
+    }
+    else if (command == "watch") {
+        std::cout << applyWatchCommand(iss) << "\n";
+    }
+    else if (command == "cpu") {
+        std::cout << applyCpuCommand(iss) << "\n";
+    }
+    else if (command == "firmware") {
+        std::cout << applyFirmwareCommand(iss) << "\n";
+    }
+    else if (command == "i2c") {
+        std::cout << applyI2cCommand(iss) << "\n";
+    }
+    else if (command == "irqstats") {
+        std::string option;
+        if (!(iss >> option)) {
+            std::cout << describeIrqStats() << "\n";
+        } else if (option == "reset") {
+            interrupts.resetLatencyStats();
+            std::cout << "Interrupt latency stats reset\n";
+        } else if (writeIrqStats(option)) {
+            std::cout << "Interrupt latency stats written to " << option << "\n";
+        } else {
+            std::cout << "Error: Could not write " << option << "\n";
+        }
+    }
+    else if (command == "bank") {
+        std::string countText, periodText;
+        if (!(iss >> countText)) {
+            std::cout << describeTimerBank() << "\n";
+        } else {
+            iss >> periodText;
+            if (applyBankCommand(countText, periodText)) {
+                std::cout << describeTimerBank() << "\n";
+            } else {
+                std::cout << "Usage: bank [<count> [period_cycles]|off]\n";
+            }
+        }
+    }
     else if (command == "close") {
         std::cout << "Closing display window...\n";
         
@@ -251,6 +1778,23 @@ void System::handleUserInput(const std::string& input)
         std::cout << "  release <name> - Simulate button release\n";
         std::cout << "  reset <name> - Reset button to IDLE state\n";
         std::cout << "  status - Show system status\n";
+        std::cout << "  speed [<ratio>|max] - Show or set simulated-to-real-time ratio\n";
+        std::cout << "  timing [reset|hybrid|sleep] - Show pacing jitter and drift, or change pacing\n";
+        std::cout << "  bank [<count> [period_cycles]|off] - Run a bank of SIMD-ticked timers\n";
+        std::cout << "  irq [list|mask|unmask|timing|raise|enable|disable|priority|cost] - Inspect or drive the interrupt controller\n";
+        std::cout << "  irqstats [reset|<file>] - Show, reset or dump interrupt latency histograms\n";
+        std::cout << "  gpio [write <reg> <hex>|drive <pin> <0|1>] - Show or poke GPIO port A registers\n";
+        std::cout << "  stim [load <file>|convert <text> <file>|stop] - Replay recorded button input\n";
+        std::cout << "  trace [start <file>|stop] - Record a VCD waveform of the clock, buttons and GPIO\n";
+        std::cout << "  uart [baud <rate>|send <text>|pty [close]] - Show UART0, set its baud rate, type into it, or bridge it to a PTY\n";
+        std::cout << "  adc [source <ch> <kind> ...|scan <mask>|time <cycles>|start [cont]|stop] - Configure and run ADC1\n";
+        std::cout << "  spi [speed <hz>|xfer <cs> <hex bytes...>] - Show SPI1 or run a transfer\n";
+        std::cout << "  i2c [speed <hz>|write <addr> <hex...>|read <addr> <count> [hex...]] - Show I2C1 or run a transaction\n";
+        std::cout << "  bus [read <addr> [1|2|4]|write <addr> <value> [1|2|4]] - Show the memory map or access it\n";
+        std::cout << "  flash [load <file>|erase] - Show flash, map a firmware image into it, or erase it\n";
+        std::cout << "  watch [add <addr|REGION.REG> [length] [r|w|rw] [break]|list|remove <id>] - Log or break on bus accesses\n";
+        std::cout << "  cpu [start|stop|reset|clock <multiplier>] - Show the RV32 core's registers or control it\n";
+        std::cout << "  firmware [load <file.so>|unload] - Run host-compiled firmware against the C HAL\n";
         std::cout << "  close - Close the display window\n";
         std::cout << "  exit - Exit the program\n";
         std::cout << "  help - Show this help\n";
@@ -386,6 +1930,7 @@ void System::handleCircleButtonClick()
 {
     std::cout << "Circle button clicked in GUI!\n";
 
+    std::lock_guard<std::mutex> ioLock(ioMutex);
     io.setButtonPressed("guiButton", true);
 }
 
@@ -444,6 +1989,7 @@ void System::handleUserInputWithDisplay(const std::string& input)
         std::string buttonName;
         iss >> buttonName;
         if (!buttonName.empty()) {
+            std::lock_guard<std::mutex> ioLock(ioMutex);
             io.setButtonPressed(buttonName, true);
             sendToDisplay("Simulated button press for: " + buttonName);
         } else {
@@ -454,6 +2000,7 @@ void System::handleUserInputWithDisplay(const std::string& input)
         std::string buttonName;
         iss >> buttonName;
         if (!buttonName.empty()) {
+            std::lock_guard<std::mutex> ioLock(ioMutex);
             io.setButtonPressed(buttonName, false);
             sendToDisplay("Simulated button release for: " + buttonName);
         } else {
@@ -464,6 +2011,7 @@ void System::handleUserInputWithDisplay(const std::string& input)
         std::string buttonName;
         iss >> buttonName;
         if (!buttonName.empty()) {
+            std::lock_guard<std::mutex> ioLock(ioMutex);
             io.resetButton(buttonName);
             sendToDisplay("Reset button: " + buttonName);
         } else {
@@ -476,9 +2024,18 @@ void System::handleUserInputWithDisplay(const std::string& input)
         sendToDisplay("Clock paused: " + std::string(clockPaused.load() ? "YES" : "NO"));
         sendToDisplay("Global flag: " + std::string(globalInterruptFlag.load() ? "ON" : "OFF"));
         sendToDisplay("Clock cycles: " + std::to_string(clock.getClockCycles()));
+        sendToDisplay(describeSpeed());
+        sendToDisplay(describeTimerBank());
+        sendToDisplay(describeTrace());
+        sendToDisplay(describeEdges());
         
         // Show button states
-        for (const auto& button : io.getButtons()) {
+        std::vector<Button> buttons;
+        {
+            std::lock_guard<std::mutex> ioLock(ioMutex);
+            buttons = io.getButtons();
+        }
+        for (const auto& button : buttons) {
             std::string buttonStatus = "Button " + button.name + ": ";
             buttonStatus += "Input=" + std::string(button.inputState ? "HIGH" : "LOW") + ", ";
             buttonStatus += "State=";
@@ -492,6 +2049,93 @@ void System::handleUserInputWithDisplay(const std::string& input)
         }
         sendToDisplay("===================");
     }
+    else if (command == "speed") {
+        std::string value;
+        double ratio = 0.0;
+        if (!(iss >> value)) {
+            sendToDisplay(describeSpeed());
+        } else if (parseSpeedRatio(value, ratio)) {
+            setSpeedRatio(ratio);
+            sendToDisplay("Speed set to " + value);
+        } else {
+            sendToDisplay("Usage: speed [<ratio>|max]");
+        }
+    }
+    else if (command == "timing") {
+        std::string option;
+        if (!(iss >> option)) {
+            sendToDisplay(describeTiming());
+        } else if (applyTimingCommand(option)) {
+            sendToDisplay("Timing: " + option);
+        } else {
+            sendToDisplay("Usage: timing [reset|hybrid|sleep]");
+        }
+    }
+    else if (command == "irq") {
+        sendToDisplay(applyIrqCommand(iss));
+    }
+    else if (command == "gpio") {
+        sendToDisplay(applyGpioCommand(iss));
+    }
+    else if (command == "stim") {
+        sendToDisplay(applyStimulusCommand(iss));
+    }
+    else if (command == "trace") {
+        sendToDisplay(applyTraceCommand(iss));
+    }
+    else if (command == "uart") {
+        sendToDisplay(applyUartCommand(iss));
+    }
+    else if (command == "adc") {
+        sendToDisplay(applyAdcCommand(iss));
+    }
+    else if (command == "spi") {
+        sendToDisplay(applySpiCommand(iss));
+    }
+    else if (command == "bus") {
+        sendToDisplay(applyBusCommand(iss));
+    }
+    else if (command == "flash") {
+        sendToDisplay(applyFlashCommand(iss));
+    }
+    else if (command == "watch") {
+        sendToDisplay(applyWatchCommand(iss));
+    }
+    else if (command == "cpu") {
+        sendToDisplay(applyCpuCommand(iss));
+    }
+    else if (command == "firmware") {
+        sendToDisplay(applyFirmwareCommand(iss));
+    }
+    else if (command == "i2c") {
+        sendToDisplay(applyI2cCommand(iss));
+    }
+    else if (command == "irqstats") {
+        std::string option;
+        if (!(iss >> option)) {
+            sendToDisplay(describeIrqStats());
+        } else if (option == "reset") {
+            interrupts.resetLatencyStats();
+            sendToDisplay("Interrupt latency stats reset");
+        } else if (writeIrqStats(option)) {
+            sendToDisplay("Interrupt latency stats written to " + option);
+        } else {
+            sendToDisplay("Error: Could not write " + option);
+        }
+    }
+    else if (command == "bank") {
+        std::string countText, periodText;
+        if (!(iss >> countText)) {
+            sendToDisplay(describeTimerBank());
+        } else {
+            iss >> periodText;
+            if (applyBankCommand(countText, periodText)) {
+                sendToDisplay(describeTimerBank());
+            } else {
+                sendToDisplay("Usage: bank [<count> [period_cycles]|off]");
+            }
+        }
+    }
     else if (command == "close") {
         sendToDisplay("Closing display window...");
         
@@ -513,6 +2157,23 @@ void System::handleUserInputWithDisplay(const std::string& input)
         sendToDisplay("  release <name> - Simulate button release");
         sendToDisplay("  reset <name> - Reset button to IDLE state");
         sendToDisplay("  status - Show system status");
+        sendToDisplay("  speed [<ratio>|max] - Show or set simulated-to-real-time ratio");
+        sendToDisplay("  timing [reset|hybrid|sleep] - Show pacing jitter and drift, or change pacing");
+        sendToDisplay("  bank [<count> [period_cycles]|off] - Run a bank of SIMD-ticked timers");
+        sendToDisplay("  irq [list|mask|unmask|timing|raise|enable|disable|priority|cost] - Inspect or drive the interrupt controller");
+        sendToDisplay("  irqstats [reset|<file>] - Show, reset or dump interrupt latency histograms");
+        sendToDisplay("  gpio [write <reg> <hex>|drive <pin> <0|1>] - Show or poke GPIO port A registers");
+        sendToDisplay("  stim [load <file>|convert <text> <file>|stop] - Replay recorded button input");
+        sendToDisplay("  trace [start <file>|stop] - Record a VCD waveform of the clock, buttons and GPIO");
+        sendToDisplay("  uart [baud <rate>|send <text>|pty [close]] - Show UART0, set its baud rate, type into it, or bridge it to a PTY");
+        sendToDisplay("  adc [source <ch> <kind> ...|scan <mask>|time <cycles>|start [cont]|stop] - Configure and run ADC1");
+        sendToDisplay("  spi [speed <hz>|xfer <cs> <hex bytes...>] - Show SPI1 or run a transfer");
+        sendToDisplay("  i2c [speed <hz>|write <addr> <hex...>|read <addr> <count> [hex...]] - Show I2C1 or run a transaction");
+        sendToDisplay("  bus [read <addr> [1|2|4]|write <addr> <value> [1|2|4]] - Show the memory map or access it");
+        sendToDisplay("  flash [load <file>|erase] - Show flash, map a firmware image into it, or erase it");
+        sendToDisplay("  watch [add <addr|REGION.REG> [length] [r|w|rw] [break]|list|remove <id>] - Log or break on bus accesses");
+        sendToDisplay("  cpu [start|stop|reset|clock <multiplier>] - Show the RV32 core's registers or control it");
+        sendToDisplay("  firmware [load <file.so>|unload] - Run host-compiled firmware against the C HAL");
         sendToDisplay("  close - Close the display window");
         sendToDisplay("  exit - Exit the program");
         sendToDisplay("  help - Show this help");
@@ -719,7 +2380,7 @@ void System::addTimer(const std::string& name, int timeMs)
     
     // Create new timer with system clock period
     int systemClockPeriodNs = clock.getSystemClockPeriodInNanoseconds();
-    auto timer = std::make_shared<Timer>(timeMs, systemClockPeriodNs, true);
+    auto timer = std::make_shared<Timer>(timeMs, systemClockPeriodNs, true, &clock.getCycleCounter());
     
     ManagedTimer managedTimer;
     managedTimer.name = name;
@@ -741,9 +2402,25 @@ void System::startTimer(const std::string& name)
     
     for (auto& managedTimer : managedTimers) {
         if (managedTimer.name == name) {
-            if (managedTimer.timer) {
+            if (managedTimer.timer && !managedTimer.isRunning) {
+                // Count and rollovers are computed from the clock cycle count on read
                 managedTimer.timer->startTimer();
                 managedTimer.isRunning = true;
+                
+                // A wheel entry raises the rollover interrupt; nothing is polled
+                long long period = managedTimer.timer->getPeriodCycles();
+                if (period > 0 && timerIrq >= 0) {
+                    IrqNumber irq = timerIrq;
+                    long long untilRollover = period - managedTimer.timer->getCurrentCycles();
+                    managedTimer.rolloverTimer = clock.armTimer(untilRollover, period, [this, irq]() {
+                        interrupts.raise(irq);
+                        // Traced behind the edges up to this cycle
+                        if (trace.isOpen()) {
+                            EdgeBatch rollover{EDGE_ROLLOVER, clock.getClockCycles(), 0, 0, false};
+                            pushEdges(rollover);
+                        }
+                    });
+                }
                 std::cout << "Started timer '" << name << "'" << std::endl;
             }
             break;
@@ -760,8 +2437,10 @@ void System::stopTimer(const std::string& name)
     for (auto& managedTimer : managedTimers) {
         if (managedTimer.name == name) {
             if (managedTimer.timer) {
-                // Note: Timer class doesn't have a stop method, so we'll just mark it as not running
+                managedTimer.timer->stopTimer();
                 managedTimer.isRunning = false;
+                clock.cancelTimer(managedTimer.rolloverTimer);
+                managedTimer.rolloverTimer = TimingWheel::INVALID_HANDLE;
                 std::cout << "Stopped timer '" << name << "'" << std::endl;
             }
             break;
@@ -775,6 +2454,12 @@ void System::removeTimer(const std::string& name)
 {
     std::lock_guard<std::mutex> lock(timerMutex);
     
+    for (const auto& managedTimer : managedTimers) {
+        if (managedTimer.name == name) {
+            clock.cancelTimer(managedTimer.rolloverTimer);
+        }
+    }
+    
     managedTimers.erase(
         std::remove_if(managedTimers.begin(), managedTimers.end(),
             [&name](const ManagedTimer& timer) { return timer.name == name; }),
@@ -816,6 +2501,242 @@ void System::updateTimerDisplay()
     display->updateTimerStatus(displayItems);
 }
 
+// Clock thread. Every span the clock advances over becomes one batch; if
+// the simulation thread is a whole ring behind, the clock waits for it
+// rather than drop edges.
+void System::pushEdges(const EdgeBatch& batch)
+{
+    bool stalled = false;
+    while (!edgeBatches.tryPush(batch)) {
+        if (!simulationThreadRunning.load()) {
+            return;
+        }
+        if (!stalled) {
+            edgeProducerStalls++;
+            stalled = true;
+        }
+        std::this_thread::yield();
+    }
+    
+    if (simulationThreadWaiting.load()) {
+        std::lock_guard<std::mutex> lock(edgeMutex);
+        edgesReady.notify_one();
+    }
+}
+
+// Simulation thread. Each cycle's rising edge debounces the buttons and
+// samples them into port A; nothing is clocked on the falling edge.
+// The trace is written here too, clock edges interleaved with the IO
+// changes, so the writer sees one time-ordered stream.
+void System::stepEdges(const EdgeBatch& batch)
+{
+    uint64_t period = static_cast<uint64_t>(clock.getSystemClockPeriodInNanoseconds());
+    if (batch.kind == EDGE_BUTTON) {
+        std::lock_guard<std::mutex> ioLock(ioMutex);
+        io.setButtonPressed(static_cast<ButtonHandle>(batch.button), batch.pressed);
+        return;
+    }
+    if (batch.kind == EDGE_ROLLOVER) {
+        if (trace.isOpen() && batch.firstCycle >= traceStartCycle.load()) {
+            trace.change(rolloverSignal, ++traceRollovers, static_cast<uint64_t>(batch.firstCycle) * period);
+        }
+        return;
+    }
+    
+    // Clock edges are written up to the start of cycle 'traced'
+    long long end = batch.firstCycle + batch.count;
+    bool tracing = trace.isOpen();
+    long long traced = std::max(batch.firstCycle, traceStartCycle.load());
+    
+    if (!clockPaused.load()) {
+        bool aPressed = false;
+        {
+            // The CLI drives the same buttons from other threads
+            std::lock_guard<std::mutex> ioLock(ioMutex);
+            for (long long cycle = batch.firstCycle; cycle < end; ++cycle) {
+                io.pollButtonsWithStates();
+                gpioA.sample();
+                aPressed = aPressed || io.isButtonPressed(aButton);
+                if (tracing && cycle >= traced && ioChangedSinceTrace()) {
+                    traceClock(traced, cycle);
+                    traced = cycle;
+                    traceIO(static_cast<uint64_t>(cycle) * period);
+                }
+            }
+        }
+        
+        if (aPressed) {
+            handleButtonPress();
+        }
+    }
+    if (tracing) {
+        traceClock(traced, end);
+    }
+    
+    // Interrupts raised up to the end of this span, including by the IO
+    // just stepped, are serviced at its boundary
+    edgeCycle = end;
+    interrupts.dispatch(edgeCycle);
+    
+    edgeCyclesProcessed += static_cast<uint64_t>(batch.count);
+    edgeBatchesProcessed++;
+}
+
+void System::simulationLoop()
+{
+    EdgeBatch batches[64];
+    for (;;) {
+        size_t count = edgeBatches.popBulk(batches, 64);
+        if (count == 0) {
+            // Edges already pushed are still processed after a stop
+            if (!simulationThreadRunning.load()) {
+                break;
+            }
+            // Interrupts raised while the clock is stopped or slow still
+            // get serviced, at the last cycle stepped
+            std::unique_lock<std::mutex> lock(edgeMutex);
+            simulationThreadWaiting = true;
+            bool woken = edgesReady.wait_for(lock, std::chrono::milliseconds(1), [this]() {
+                return !edgeBatches.empty() || !simulationThreadRunning.load();
+            });
+            simulationThreadWaiting = false;
+            if (!woken) {
+                lock.unlock();
+                interrupts.dispatch(edgeCycle);
+            }
+            continue;
+        }
+        
+        for (size_t i = 0; i < count; ++i) {
+            stepEdges(batches[i]);
+        }
+    }
+}
+
+void System::startSimulationThread()
+{
+    if (simulationThreadRunning.load()) {
+        return;
+    }
+    
+    simulationThreadRunning = true;
+    edgeCycle = clock.getClockCycles();
+    simulationThread = std::thread(&System::simulationLoop, this);
+    edgeHook = clock.addCycleHook([this](long long firstCycle, long long count) {
+        EdgeBatch batch{EDGE_CYCLES, firstCycle, count, 0, false};
+        pushEdges(batch);
+    });
+}
+
+// Stop the clock first so every edge it produced gets processed
+void System::stopSimulationThread()
+{
+    if (edgeHook != 0) {
+        clock.removeCycleHook(edgeHook);
+        edgeHook = 0;
+    }
+    if (!simulationThreadRunning.exchange(false)) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(edgeMutex);
+        edgesReady.notify_all();
+    }
+    if (simulationThread.joinable()) {
+        simulationThread.join();
+    }
+}
+
+std::string System::describeEdges() const
+{
+    uint64_t cycles = edgeCyclesProcessed.load();
+    uint64_t batches = edgeBatchesProcessed.load();
+    std::ostringstream oss;
+    oss << "Clock edges: " << 2 * cycles << " processed (" << cycles << " rising) in " << batches << " batches";
+    if (batches > 0) {
+        oss << std::fixed << std::setprecision(1) << ", " << static_cast<double>(cycles) / batches << " cycles per batch";
+    }
+    oss << ", " << edgeBatches.size() << " batches queued, " << edgeProducerStalls.load() << " clock stalls";
+    return oss.str();
+}
+
+// Per-sample simulation logic, driven by the Qt timer or the headless loop
+void System::simulationStep()
+{
+    // Interrupts are dispatched on the simulation thread; only the work
+    // their handlers cannot do there is left for here
+    unsigned work = deferredWork.exchange(0);
+    if (work & DEFER_START_CLOCK) {
+        startClock();
+    }
+    if (work & DEFER_TIMER_DISPLAY) {
+        std::lock_guard<std::mutex> timerLock(timerMutex);
+        updateTimerDisplay();
+    }
+    
+    std::lock_guard<std::mutex> lock(systemMutex);
+    
+    bridgeUart();
+    
+    // IO itself is stepped edge by edge on the simulation thread; this only
+    // keeps the display and flags current
+    if (clock.isRunning() && !shouldStop.load()) {
+        if (!clockPaused.load()) {
+            // Update timer display periodically
+            static int displayUpdateCounter = 0;
+            if (++displayUpdateCounter >= 10) { // Update every 10 cycles
+                updateTimerDisplay();
+                displayUpdateCounter = 0;
+            }
+            
+            // Check interrupt flags
+            if (globalInterruptFlag.load()) {
+                std::cout << "Global flag is ON - performing special action\n";
+            }
+        }
+    } else if (shouldStop.load()) {
+        // Exit is now handled directly in the exit handler
+        // This prevents hanging issues with Qt quit
+    }
+}
+
+void System::runHeadless()
+{
+    std::cout << "Running headless. " << describeSpeed() << "\n";
+    
+    auto wallStart = std::chrono::steady_clock::now();
+    
+    // No event loop and no CLI: sample the simulation until the clock stops
+    while (clock.isRunning() && !shouldStop.load()) {
+        simulationStep();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    
+    clock.stop();
+    stopSimulationThread();
+    stopTrace();
+    
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    long long cycles = clock.getClockCycles();
+    double achievedMHz = wallSeconds > 0.0 ? static_cast<double>(cycles) / (wallSeconds * 1e6) : 0.0;
+    double nominalMHz = clock.getNominalMHz();
+    
+    std::cout << std::fixed << std::setprecision(4)
+              << "Headless run complete: " << cycles << " cycles in " << wallSeconds << " s, "
+              << achievedMHz << " MHz simulated";
+    if (nominalMHz > 0.0) {
+        std::cout << " (" << std::setprecision(2) << achievedMHz / nominalMHz << "x real time)";
+    }
+    std::cout << std::endl;
+    if (!flashPath.empty()) {
+        std::cout << describeCpu() << std::endl;
+    }
+    std::cout << describeEdges() << std::endl;
+    if (firmware.isLoaded()) {
+        std::cout << firmware.describe() << std::endl;
+    }
+}
 
 // Main function
 void System::run()
@@ -831,12 +2752,55 @@ void System::run()
     this->configureIO(anIO);
     std::cout << "DEBUG: IO configuration complete" << std::endl;
     
+    if (!stimulusPath.empty()) {
+        std::string error;
+        if (!startStimulus(stimulusPath, error)) {
+            std::cout << "Error: " << error << "\n";
+        }
+    }
+    
+    // A firmware image boots the CPU as soon as the clock starts
+    if (!flashPath.empty()) {
+        std::string error;
+        if (!loadFlash(flashPath, error)) {
+            std::cout << "Error: " << error << "\n";
+        } else {
+            cpu.reset();
+            cpu.start();
+        }
+    }
+    
+    if (!firmwarePath.empty()) {
+        std::string error;
+        if (!firmware.load(firmwarePath, error)) {
+            std::cout << "Error: " << error << "\n";
+        }
+    }
+    
+    if (!tracePath.empty()) {
+        std::string error;
+        if (!startTrace(tracePath, error)) {
+            std::cout << "Error: " << error << "\n";
+        }
+    }
+    
     // Configure clock module
+    if (headless && headlessCycleLimit > 0) {
+        clock.scheduleAfterCycles(headlessCycleLimit, [this]() {
+            clock.requestStop();
+        });
+    }
     clock.createCountUpTimer(1000, true);
+    startSimulationThread();
     clock.beginTicking(false);
     clock.startCountUpTimer(0);
     std::cout << "DEBUG: Clock configuration complete" << std::endl;
     
+    if (headless) {
+        runHeadless();
+        return;
+    }
+    
     startCLIThread();
     std::cout << "DEBUG: CLI thread started" << std::endl;
     
@@ -845,43 +2809,7 @@ void System::run()
     std::cout << "DEBUG: QTimer created" << std::endl;
     
     QObject::connect(systemTimer, &QTimer::timeout, [this]() {
-        std::lock_guard<std::mutex> lock(systemMutex);
-        
-        if (clock.isRunning() && !shouldStop.load()) {
-            if (clock.getCurrentClockState() && !clockPaused.load()) {
-                this->io.pollButtonsWithStates();
-                
-                // Handle button press logic
-                if (this->io.isButtonPressed("aButton")) {
-                    handleButtonPress();
-                }
-                
-                // Poll managed timers
-                {
-                    std::lock_guard<std::mutex> timerLock(timerMutex);
-                    for (auto& managedTimer : managedTimers) {
-                        if (managedTimer.isRunning && managedTimer.timer) {
-                            managedTimer.timer->pollTimer();
-                        }
-                    }
-                }
-                
-                // Update timer display periodically
-                static int displayUpdateCounter = 0;
-                if (++displayUpdateCounter >= 10) { // Update every 10 cycles
-                    updateTimerDisplay();
-                    displayUpdateCounter = 0;
-                }
-                
-                // Check interrupt flags
-                if (globalInterruptFlag.load()) {
-                    std::cout << "Global flag is ON - performing special action\n";
-                }
-            }
-        } else if (shouldStop.load()) {
-            // Exit is now handled directly in the exit handler
-            // This prevents hanging issues with Qt quit
-        }
+        simulationStep();
     });
     
     // Start timer with appropriate interval (adjust as needed)
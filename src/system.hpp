@@ -8,26 +8,65 @@
 #include <functional>
 #include <map>
 #include <mutex>
+#include <condition_variable>
 #include <vector>
 #include <memory>
+#include <sstream>
 #include "clock.hpp"
 #include "io.hpp"
 #include "display.hpp"
 #include "timer.hpp"
+#include "timer_bank.hpp"
+#include "interrupt_controller.hpp"
+#include "gpio.hpp"
+#include "stimulus.hpp"
+#include "vcd_writer.hpp"
+#include "uart.hpp"
+#include "adc.hpp"
+#include "i2c.hpp"
+#include "spi.hpp"
+#include "bus.hpp"
+#include "spsc_ring.hpp"
+#include "memory.hpp"
+#include "rv32_core.hpp"
+#include "native_firmware.hpp"
 #include <QApplication>
 #include <QTimer>
 
 class System {
 public:
     System();
+    explicit System(bool headless);
     ~System();
     
     void configureIO(IO io);
     void run();
     
-    // Interrupt-like functionality
-    void registerInterrupt(const std::string& name, std::function<void()> handler);
+    // Simulation speed control (ratio <= 0 runs unthrottled)
+    void setSpeedRatio(double ratio);
+    
+    // Parses "10", "10x" or "max"; rejects anything else and non-positive ratios
+    static bool parseSpeedRatio(const std::string& text, double& ratio);
+    void setHeadlessCycleLimit(long long cycles) { headlessCycleLimit = cycles; }
+    
+    // Replays a binary stimulus file into the IO buttons, from run() onwards
+    void setStimulusFile(const std::string& path) { stimulusPath = path; }
+    
+    // Writes a VCD waveform of the clock, buttons, port A and timer rollovers
+    void setTraceFile(const std::string& path) { tracePath = path; }
+    
+    // Firmware image for flash, mapped copy-on-write at run()
+    void setFlashFile(const std::string& path) { flashPath = path; }
+    
+    // Host-compiled firmware library against embedsim_hal.h, started at run()
+    void setFirmwareLibrary(const std::string& path) { firmwarePath = path; }
+    
+    // Interrupts. Named handlers get the next free IRQ number; raising is
+    // lock-free and handlers run on the simulation thread, in priority order.
+    IrqNumber registerInterrupt(const std::string& name, std::function<void()> handler,
+                                uint8_t priority = InterruptController::LOWEST_PRIORITY);
     void triggerInterrupt(const std::string& name);
+    void triggerInterrupt(IrqNumber irq);
     void startCLIThread();
     void stopCLIThread();
     
@@ -59,23 +98,137 @@ public:
     std::atomic<int> userCommand{0};
 
 private:
+    // Declared before the clock so clock-thread callbacks that raise
+    // interrupts never outlive the controller
+    InterruptController interrupts;
+    
+    // Likewise for the waveform trace. Only the simulation thread writes
+    // changes, in edge order; the CLI opens and closes it.
+    VcdWriter trace;
+    VcdWriter::SignalId clockSignal = VcdWriter::INVALID_SIGNAL;
+    VcdWriter::SignalId gpioSignal = VcdWriter::INVALID_SIGNAL;
+    VcdWriter::SignalId rolloverSignal = VcdWriter::INVALID_SIGNAL;
+    std::vector<VcdWriter::SignalId> buttonSignals;
+    std::atomic<uint32_t> traceRollovers{0};
+    std::atomic<long long> traceStartCycle{0};
+    uint32_t tracedPins = 0;
+    std::vector<ButtonState> tracedButtons;
+    std::string tracePath;
+    
+    // Serial console; its character events run on the clock thread
+    Uart uart0{"UART0"};
+    std::string uartLine;
+    
+    // Converts from a clock cycle hook; the handler drains its results
+    Adc adc1{"ADC1"};
+    std::atomic<uint64_t> adcResultsRead{0};
+    
+    // Serial buses; each transfer completes as one clock event
+    SpiController spi1{"SPI1"};
+    I2cController i2c1{"I2C1"};
+    
+    // Clock edges, handed from a cycle hook to the simulation thread as
+    // batches of whole cycles (a rising and a falling edge each). IO steps
+    // once per rising edge, however far behind the thread runs. Stimulus
+    // transitions travel in the same stream (EDGE_BUTTON) so they land between
+    // the right edges, as do timer rollovers for the trace. Interrupts are
+    // dispatched at the end of every batch, and at the last cycle stepped
+    // while no batches arrive.
+    enum EdgeKind {
+        EDGE_CYCLES,
+        EDGE_BUTTON,
+        EDGE_ROLLOVER
+    };
+    struct EdgeBatch {
+        EdgeKind kind;
+        long long firstCycle;
+        long long count;
+        int button;
+        bool pressed;
+    };
+    SpscRing<EdgeBatch> edgeBatches{1024};
+    int edgeHook = 0;
+    std::thread simulationThread;
+    std::atomic<bool> simulationThreadRunning{false};
+    std::atomic<bool> simulationThreadWaiting{false};
+    std::mutex edgeMutex;
+    std::condition_variable edgesReady;
+    std::atomic<uint64_t> edgeCyclesProcessed{0};
+    std::atomic<uint64_t> edgeBatchesProcessed{0};
+    std::atomic<uint64_t> edgeProducerStalls{0};
+    long long edgeCycle = 0;
+    
+    // Handler work that has to happen off the simulation thread: starting
+    // the clock, and anything touching the display. simulationStep() does it.
+    enum DeferredWork : unsigned {
+        DEFER_START_CLOCK = 1u << 0,
+        DEFER_TIMER_DISPLAY = 1u << 1
+    };
+    std::atomic<unsigned> deferredWork{0};
     Clock clock;
     IO io;
+    ButtonHandle aButton = INVALID_BUTTON;
+    
+    // Port A input pins follow the IO buttons, in the order they were added
+    GpioPort gpioA{"GPIOA"};
+    
+    // Native firmware calls straight into the clock, port A and the ADC from
+    // its own thread, so it is declared after them and unloaded first
+    NativeFirmware firmware{clock, gpioA, adc1};
+    std::string firmwarePath;
+    
+    // Memory map. Peripheral register files forward to the peripherals'
+    // own atomic registers through hooks, so they are declared after them.
+    RegisterFile sysctrlRegisters{"SYSCTRL", 0x20};
+    RegisterFile uartRegisters{"UART0", Uart::REGISTER_WINDOW};
+    RegisterFile adcRegisters{"ADC1", Adc::REGISTER_WINDOW};
+    RegisterFile gpioRegisters{"GPIOA", GpioPort::REGISTER_WINDOW};
+    std::atomic<uint32_t> cycleLatchHigh{0};
+    
+    // Flash and SRAM; the bus keeps host pointers into these, so they are
+    // declared before it
+    FlashImage flash;
+    MemoryArena sramArena;
+    std::string flashPath;
+    Bus bus;
+    IrqNumber pauseIrq = -1;
+    
+    // Firmware core, run from a clock cycle hook. While it runs, peripheral
+    // interrupts go to it instead of the stand-in handlers.
+    Rv32Core cpu{bus};
+    
+    // Recorded button transitions, queued into the edge stream on the clock
+    // thread.
+    // Declared after the clock and IO so playback stops before they go away.
+    StimulusPlayer stimulus;
+    std::string stimulusPath;
     std::unique_ptr<DisplayApp> display;
     std::unique_ptr<QApplication> qtApp;
     
+    // Headless runs skip Qt entirely and stop after headlessCycleLimit cycles
+    bool headless = false;
+    long long headlessCycleLimit = 0;
+    
     // Timer management
     struct ManagedTimer {
         std::string name;
         int timeMs;
         std::shared_ptr<Timer> timer;
         bool isRunning;
+        Clock::TimerId rolloverTimer = TimingWheel::INVALID_HANDLE;
     };
     std::vector<ManagedTimer> managedTimers;
     std::mutex timerMutex;
     
-    // Interrupt system
-    std::map<std::string, std::function<void()>> interruptHandlers;
+    // Optional bank of SIMD-ticked timers, stepped from a clock cycle hook
+    std::shared_ptr<TimerBank> timerBank;
+    int timerBankHook = 0;
+    
+    // Interrupt system. Names only exist for the CLI, everything else uses
+    // IRQ numbers.
+    std::map<std::string, IrqNumber> irqNumbers;
+    IrqNumber nextIrq = 0;
+    IrqNumber timerIrq = -1;
     std::thread cliThread;
     std::atomic<bool> cliThreadRunning{false};
     
@@ -88,6 +241,59 @@ private:
     void handleUserInputWithDisplay(const std::string& input);
     void setupInterruptHandlers();
     void setupTimerCallbacks();
+    void simulationStep();
+    void startSimulationThread();
+    void stopSimulationThread();
+    void simulationLoop();
+    void pushEdges(const EdgeBatch& batch);
+    void stepEdges(const EdgeBatch& batch);
+    std::string describeEdges() const;
+    void runHeadless();
+    std::string describeSpeed() const;
+    std::string describeTiming() const;
+    bool applyTimingCommand(const std::string& option);
+    bool applyBankCommand(const std::string& countText, const std::string& periodText);
+    std::string describeTimerBank() const;
+    std::string applyIrqCommand(std::istringstream& iss);
+    bool resolveIrq(const std::string& text, IrqNumber& irq) const;
+    std::string describeIrqStats() const;
+    bool writeIrqStats(const std::string& path) const;
+    std::string describeGpio() const;
+    std::string applyGpioCommand(std::istringstream& iss);
+    bool startStimulus(const std::string& path, std::string& error);
+    std::string describeStimulus() const;
+    std::string applyStimulusCommand(std::istringstream& iss);
+    void declareTraceSignals();
+    bool startTrace(const std::string& path, std::string& error);
+    void stopTrace();
+    void traceIO(uint64_t timeNs);
+    bool ioChangedSinceTrace() const;
+    void traceClock(long long fromCycle, long long toCycle);
+    std::string describeTrace() const;
+    std::string applyTraceCommand(std::istringstream& iss);
+    void bridgeUart();
+    std::string describeUart() const;
+    std::string applyUartCommand(std::istringstream& iss);
+    std::string describeAdc() const;
+    std::string applyAdcCommand(std::istringstream& iss);
+    void buildMemoryMap();
+    bool loadFlash(const std::string& path, std::string& error);
+    std::string describeFlash() const;
+    std::string applyFlashCommand(std::istringstream& iss);
+    std::string describeBus() const;
+    std::string describeBusAddress(uint32_t address) const;
+    std::string applyBusCommand(std::istringstream& iss);
+    void onWatchHit(const Bus::WatchHit& hit);
+    std::string describeWatchpoints() const;
+    std::string applyWatchCommand(std::istringstream& iss);
+    bool forwardToFirmware(int line);
+    std::string describeCpu() const;
+    std::string applyCpuCommand(std::istringstream& iss);
+    std::string applyFirmwareCommand(std::istringstream& iss);
+    std::string describeSpi() const;
+    std::string applySpiCommand(std::istringstream& iss);
+    std::string describeI2c() const;
+    std::string applyI2cCommand(std::istringstream& iss);
 
 };
 
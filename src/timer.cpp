@@ -1,63 +1,86 @@
 #include "timer.hpp"
 
-Timer::Timer() : clockCycles(0), systemClockPeriodInNanoseconds(0)
+Timer::Timer() : systemClockPeriodInNanoseconds(0), clockCycles(0)
 {
     cout << "Warning: Default constructor called, timer clock cycles not initialized (0). \n";
 }
 
-Timer::Timer(int milliseconds, int systemClockPeriodInNanoseconds, bool continuousRun) : 
-    systemClockPeriodInNanoseconds(systemClockPeriodInNanoseconds), continuousRun(continuousRun)
+Timer::Timer(int milliseconds, int systemClockPeriodInNanoseconds, bool continuousRun) :
+    Timer(milliseconds, systemClockPeriodInNanoseconds, continuousRun, nullptr)
+{}
+
+Timer::Timer(int milliseconds, int systemClockPeriodInNanoseconds, bool continuousRun,
+             const std::atomic<long long>* cycleSource) :
+    cycleSource(cycleSource), systemClockPeriodInNanoseconds(systemClockPeriodInNanoseconds),
+    continuousRun(continuousRun)
 {
     // Using the system clock period, configure the timer to run
     // for the amount of time configured
 
     // Cycles (#) = time (s) / period (s)
-    const int NS_PER_MS = 1'000'000;
-    clockCycles = (milliseconds * NS_PER_MS) / systemClockPeriodInNanoseconds;
+    const long long NS_PER_MS = 1'000'000;
+    if (systemClockPeriodInNanoseconds > 0) {
+        clockCycles = (milliseconds * NS_PER_MS) / systemClockPeriodInNanoseconds;
+    }
 
 }
 
 Timer::~Timer() {}
 
-bool Timer::isRunning()
+long long Timer::now() const
+{
+    return cycleSource ? cycleSource->load(std::memory_order_relaxed) : 0;
+}
+
+long long Timer::elapsedCycles() const
+{
+    return elapsedBeforeStart + (running ? now() - startCycle : 0);
+}
+
+bool Timer::isRunning() const
 {
     return running;
 }
 
 void Timer::startTimer()
 {
-    running = true;
+    if (!running) {
+        startCycle = now();
+        running = true;
+    }
 }
 
-void Timer::pollTimer()
+void Timer::stopTimer()
 {
     if (running) {
-        if (continuousRun && hasRolledOver) {
-            hasRolledOver = false;
-        }
-
-        if (currentCycles == clockCycles && !hasRolledOver) {
-            hasRolledOver = true;
-            rolloverCount++;
-            currentCycles = 0;
-        }
-
-        else {
-            currentCycles++;
-        }
-    }
-
-    else {
-        // Do nothing
+        elapsedBeforeStart += now() - startCycle;
+        running = false;
     }
 }
 
-int Timer::getCurrentCycles()
+long long Timer::getCurrentCycles() const
 {
-    return currentCycles;
+    long long elapsed = elapsedCycles();
+    if (clockCycles <= 0) {
+        return elapsed;
+    }
+
+    // One-shot timers count up to their period and hold there
+    if (!continuousRun) {
+        return elapsed < clockCycles ? elapsed : clockCycles;
+    }
+    return elapsed % clockCycles;
 }
 
-int Timer::getRolloverCount()
+long long Timer::getRolloverCount() const
 {
-    return rolloverCount;
-}
\ No newline at end of file
+    long long elapsed = elapsedCycles();
+    if (clockCycles <= 0) {
+        return 0;
+    }
+
+    if (!continuousRun) {
+        return elapsed >= clockCycles ? 1 : 0;
+    }
+    return elapsed / clockCycles;
+}
@@ -1,33 +1,50 @@
 #include <iostream>
+#include <atomic>
 
 using namespace std;
 
 #ifndef TIMER_HPP
 #define TIMER_HPP
 
+// A count-up timer whose state is computed on demand from a global cycle
+// counter. Nothing advances it per tick: it records the cycle it started
+// at and derives its count and rollovers from the current cycle.
+
 class Timer
 {
     public:
         Timer();
         Timer(int milliseconds, int systemClockPeriodInNanoseconds, bool continuousRun);
+        Timer(int milliseconds, int systemClockPeriodInNanoseconds, bool continuousRun,
+              const std::atomic<long long>* cycleSource);
         ~Timer();
 
+        void attachCycleSource(const std::atomic<long long>* source) {cycleSource = source; }
+
         void startTimer();
-        bool isRunning();
-        void pollTimer();
+        void stopTimer();
+        bool isRunning() const;
+
+        long long getPeriodCycles() const {return clockCycles; }
+        bool isContinuous() const {return continuousRun; }
 
-        int getCurrentCycles();
-        int getRolloverCount();
+        long long getCurrentCycles() const;
+        long long getRolloverCount() const;
 
     private:
+        const std::atomic<long long>* cycleSource = nullptr;
         int systemClockPeriodInNanoseconds = 0;
         long long int clockCycles = 0;
-        int currentCycles = 0;
-        int rolloverCount = 0;
+
+        // Cycles counted by earlier runs, and where the current run began
+        long long elapsedBeforeStart = 0;
+        long long startCycle = 0;
 
         bool running = false;
-        bool hasRolledOver = false;
         bool continuousRun = false;
+
+        long long now() const;
+        long long elapsedCycles() const;
 };
 
-#endif
\ No newline at end of file
+#endif
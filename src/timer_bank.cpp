@@ -0,0 +1,221 @@
+#include "timer_bank.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define TIMER_BANK_X86 1
+#include <immintrin.h>
+#endif
+
+static const size_t LANES_PER_WORD = 64;
+
+TimerBank::TimerBank()
+{
+#if defined(TIMER_BANK_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernel = Kernel::Avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernel = Kernel::Sse2;
+    }
+#endif
+}
+
+TimerBank::~TimerBank() {}
+
+const char* TimerBank::getKernelName() const
+{
+    switch (kernel) {
+        case Kernel::Avx2: return "avx2";
+        case Kernel::Sse2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+TimerBank::Index TimerBank::addTimer(uint32_t reloadCycles, bool isContinuous)
+{
+    Index index = static_cast<Index>(timerCount++);
+
+    // Grow a whole mask word at a time so kernels never need a tail loop
+    if (timerCount > counters.size()) {
+        size_t lanes = counters.size() + LANES_PER_WORD;
+        counters.resize(lanes, 0);
+        reloads.resize(lanes, 1);
+        rollovers.resize(lanes, 0);
+        running.resize(lanes, 0);
+        continuous.resize(lanes, 0);
+        rolled.resize(lanes / LANES_PER_WORD, 0);
+    }
+
+    counters[index] = 0;
+    reloads[index] = reloadCycles > 0 ? reloadCycles : 1;
+    rollovers[index] = 0;
+    running[index] = 0;
+    continuous[index] = isContinuous ? UINT32_MAX : 0;
+
+    return index;
+}
+
+void TimerBank::startTimer(Index index)
+{
+    if (index < timerCount) {
+        running[index] = UINT32_MAX;
+    }
+}
+
+void TimerBank::stopTimer(Index index)
+{
+    if (index < timerCount) {
+        running[index] = 0;
+    }
+}
+
+void TimerBank::clear()
+{
+    counters.clear();
+    reloads.clear();
+    rollovers.clear();
+    running.clear();
+    continuous.clear();
+    rolled.clear();
+    timerCount = 0;
+    totalRollovers.store(0, std::memory_order_relaxed);
+}
+
+size_t TimerBank::tick()
+{
+    size_t count = 0;
+
+    switch (kernel) {
+        case Kernel::Avx2: count = tickAvx2(); break;
+        case Kernel::Sse2: count = tickSse2(); break;
+        default: count = tickScalar(); break;
+    }
+
+    // Only the ticking thread writes, other threads just read the total
+    totalRollovers.store(totalRollovers.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    return count;
+}
+
+size_t TimerBank::tickScalar()
+{
+    size_t count = 0;
+
+    for (size_t word = 0; word < rolled.size(); ++word) {
+        uint64_t bits = 0;
+        size_t base = word * LANES_PER_WORD;
+
+        for (size_t lane = 0; lane < LANES_PER_WORD; ++lane) {
+            size_t i = base + lane;
+            uint32_t run = running[i];
+            uint32_t counter = counters[i] + (run & 1);
+            uint32_t hit = (counter == reloads[i]) ? run : 0;
+
+            counters[i] = counter & ~hit;
+            rollovers[i] += hit & 1;
+            running[i] = run & ~(hit & ~continuous[i]);
+            bits |= static_cast<uint64_t>(hit & 1) << lane;
+        }
+
+        rolled[word] = bits;
+        count += __builtin_popcountll(bits);
+    }
+
+    return count;
+}
+
+#if defined(TIMER_BANK_X86)
+
+__attribute__((target("sse2")))
+size_t TimerBank::tickSse2()
+{
+    size_t count = 0;
+    const __m128i one = _mm_set1_epi32(1);
+
+    for (size_t word = 0; word < rolled.size(); ++word) {
+        uint64_t bits = 0;
+        size_t base = word * LANES_PER_WORD;
+
+        for (size_t lane = 0; lane < LANES_PER_WORD; lane += 4) {
+            size_t i = base + lane;
+            __m128i* counterPtr = reinterpret_cast<__m128i*>(&counters[i]);
+            __m128i* rolloverPtr = reinterpret_cast<__m128i*>(&rollovers[i]);
+            __m128i* runPtr = reinterpret_cast<__m128i*>(&running[i]);
+
+            __m128i run = _mm_loadu_si128(runPtr);
+            __m128i counter = _mm_add_epi32(_mm_loadu_si128(counterPtr), _mm_and_si128(run, one));
+            __m128i reload = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&reloads[i]));
+
+            // Counters only ever step by one, so equality is the rollover test
+            __m128i hit = _mm_and_si128(_mm_cmpeq_epi32(counter, reload), run);
+
+            _mm_storeu_si128(counterPtr, _mm_andnot_si128(hit, counter));
+
+            // Rollovers are rare, skip the remaining traffic when none hit
+            int hitBits = _mm_movemask_ps(_mm_castsi128_ps(hit));
+            if (hitBits != 0) {
+                _mm_storeu_si128(rolloverPtr, _mm_sub_epi32(_mm_loadu_si128(rolloverPtr), hit));
+                __m128i cont = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&continuous[i]));
+                _mm_storeu_si128(runPtr, _mm_andnot_si128(_mm_andnot_si128(cont, hit), run));
+                bits |= static_cast<uint64_t>(hitBits) << lane;
+            }
+        }
+
+        rolled[word] = bits;
+        count += __builtin_popcountll(bits);
+    }
+
+    return count;
+}
+
+__attribute__((target("avx2")))
+size_t TimerBank::tickAvx2()
+{
+    size_t count = 0;
+    const __m256i one = _mm256_set1_epi32(1);
+
+    for (size_t word = 0; word < rolled.size(); ++word) {
+        uint64_t bits = 0;
+        size_t base = word * LANES_PER_WORD;
+
+        for (size_t lane = 0; lane < LANES_PER_WORD; lane += 8) {
+            size_t i = base + lane;
+            __m256i* counterPtr = reinterpret_cast<__m256i*>(&counters[i]);
+            __m256i* rolloverPtr = reinterpret_cast<__m256i*>(&rollovers[i]);
+            __m256i* runPtr = reinterpret_cast<__m256i*>(&running[i]);
+
+            __m256i run = _mm256_loadu_si256(runPtr);
+            __m256i counter = _mm256_add_epi32(_mm256_loadu_si256(counterPtr), _mm256_and_si256(run, one));
+            __m256i reload = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&reloads[i]));
+
+            __m256i hit = _mm256_and_si256(_mm256_cmpeq_epi32(counter, reload), run);
+
+            _mm256_storeu_si256(counterPtr, _mm256_andnot_si256(hit, counter));
+
+            int hitBits = _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+            if (hitBits != 0) {
+                __m256i cont = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&continuous[i]));
+                _mm256_storeu_si256(rolloverPtr, _mm256_sub_epi32(_mm256_loadu_si256(rolloverPtr), hit));
+                _mm256_storeu_si256(runPtr, _mm256_andnot_si256(_mm256_andnot_si256(cont, hit), run));
+                bits |= static_cast<uint64_t>(hitBits) << lane;
+            }
+        }
+
+        rolled[word] = bits;
+        count += __builtin_popcountll(bits);
+    }
+
+    return count;
+}
+
+#else
+
+size_t TimerBank::tickSse2()
+{
+    return tickScalar();
+}
+
+size_t TimerBank::tickAvx2()
+{
+    return tickScalar();
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef TIMER_BANK_HPP
+#define TIMER_BANK_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// A structure-of-arrays bank of count-up timers for scenarios that need
+// every timer evaluated on every tick. Counters, reload values, run and
+// mode flags sit in parallel arrays so one tick is a streaming pass that
+// vectorises: AVX2 (8 lanes) or SSE2 (4 lanes) when the host supports it,
+// scalar otherwise. Each tick leaves a bitmask of the timers that rolled
+// over, one bit per timer, 64 timers per word.
+//
+// Semantics match Timer: a running timer counts up by one per tick and
+// rolls over when it reaches its reload value; continuous timers restart
+// from zero, one-shot timers stop.
+
+class TimerBank
+{
+    public:
+        typedef uint32_t Index;
+
+        TimerBank();
+        ~TimerBank();
+
+        Index addTimer(uint32_t reloadCycles, bool continuous);
+        void startTimer(Index index);
+        void stopTimer(Index index);
+        void clear();
+
+        // Advance all running timers by one cycle, returns how many rolled over
+        size_t tick();
+
+        size_t size() const {return timerCount; }
+        const uint64_t* rolledMask() const {return rolled.data(); }
+        size_t rolledMaskWords() const {return rolled.size(); }
+        bool hasRolledOver(Index index) const {return (rolled[index / 64] >> (index % 64)) & 1; }
+
+        uint32_t getCurrentCycles(Index index) const {return counters[index]; }
+        uint32_t getRolloverCount(Index index) const {return rollovers[index]; }
+        bool isRunning(Index index) const {return running[index] != 0; }
+        uint64_t getTotalRollovers() const {return totalRollovers.load(std::memory_order_relaxed); }
+
+        // Name of the kernel selected for this host: "avx2", "sse2" or "scalar"
+        const char* getKernelName() const;
+
+    private:
+        // Lanes are padded to a multiple of 64 so kernels always produce whole
+        // mask words; padding lanes never run. Flags are 0 or all-ones.
+        std::vector<uint32_t> counters;
+        std::vector<uint32_t> reloads;
+        std::vector<uint32_t> rollovers;
+        std::vector<uint32_t> running;
+        std::vector<uint32_t> continuous;
+        std::vector<uint64_t> rolled;
+
+        size_t timerCount = 0;
+        std::atomic<uint64_t> totalRollovers{0};
+
+        enum class Kernel { Scalar, Sse2, Avx2 };
+        Kernel kernel = Kernel::Scalar;
+
+        size_t tickScalar();
+        size_t tickSse2();
+        size_t tickAvx2();
+};
+
+#endif
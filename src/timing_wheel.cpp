@@ -0,0 +1,302 @@
+#include "timing_wheel.hpp"
+
+const TimingWheel::Handle TimingWheel::INVALID_HANDLE;
+const uint64_t TimingWheel::NO_EXPIRY;
+
+TimingWheel::TimingWheel()
+{
+    for (int level = 0; level < LEVELS; ++level) {
+        occupied[level] = 0;
+        for (int slot = 0; slot < SLOTS; ++slot) {
+            heads[level][slot] = NIL;
+        }
+    }
+    expired.reserve(64);
+}
+
+TimingWheel::~TimingWheel() {}
+
+TimingWheel::Handle TimingWheel::makeHandle(uint32_t index, uint32_t generation)
+{
+    return (static_cast<uint64_t>(generation) << 32) | index;
+}
+
+TimingWheel::Node* TimingWheel::resolve(Handle handle)
+{
+    uint32_t index = static_cast<uint32_t>(handle & 0xFFFFFFFFu);
+    uint32_t generation = static_cast<uint32_t>(handle >> 32);
+
+    if (index >= nodes.size()) {
+        return nullptr;
+    }
+
+    Node& node = nodes[index];
+    if (node.generation != generation || node.state == NodeState::Free) {
+        return nullptr;
+    }
+    return &node;
+}
+
+uint32_t TimingWheel::allocateNode()
+{
+    if (!freeNodes.empty()) {
+        uint32_t index = freeNodes.back();
+        freeNodes.pop_back();
+        return index;
+    }
+
+    nodes.push_back(Node());
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void TimingWheel::releaseNode(uint32_t index)
+{
+    Node& node = nodes[index];
+    node.action = nullptr;
+    node.state = NodeState::Free;
+    node.prev = NIL;
+    node.next = NIL;
+
+    // Bump the generation so stale handles no longer resolve; 0 is never used
+    node.generation++;
+    if (node.generation == 0) {
+        node.generation = 1;
+    }
+
+    freeNodes.push_back(index);
+}
+
+void TimingWheel::link(uint32_t index)
+{
+    Node& node = nodes[index];
+
+    if (node.expiry <= currentTime) {
+        node.state = NodeState::Expired;
+        expired.push_back(makeHandle(index, node.generation));
+        return;
+    }
+
+    // The highest differing 6-bit digit picks the level, that digit the slot
+    uint64_t diff = node.expiry ^ currentTime;
+    int level = (63 - __builtin_clzll(diff)) / LEVEL_BITS;
+    int slot = static_cast<int>((node.expiry >> (level * LEVEL_BITS)) & (SLOTS - 1));
+
+    node.level = static_cast<uint8_t>(level);
+    node.slot = static_cast<uint8_t>(slot);
+    node.state = NodeState::Linked;
+    node.prev = NIL;
+    node.next = heads[level][slot];
+
+    if (node.next != NIL) {
+        nodes[node.next].prev = index;
+    }
+    heads[level][slot] = index;
+    occupied[level] |= (1ULL << slot);
+}
+
+void TimingWheel::unlink(uint32_t index)
+{
+    Node& node = nodes[index];
+
+    if (node.prev != NIL) {
+        nodes[node.prev].next = node.next;
+    } else {
+        heads[node.level][node.slot] = node.next;
+    }
+    if (node.next != NIL) {
+        nodes[node.next].prev = node.prev;
+    }
+
+    if (heads[node.level][node.slot] == NIL) {
+        occupied[node.level] &= ~(1ULL << node.slot);
+    }
+
+    node.prev = NIL;
+    node.next = NIL;
+}
+
+TimingWheel::Handle TimingWheel::schedule(uint64_t expiry, uint64_t period, std::function<void()> action)
+{
+    uint32_t index = allocateNode();
+    Node& node = nodes[index];
+    node.expiry = expiry;
+    node.period = period;
+    node.action = std::move(action);
+
+    link(index);
+    armedCount++;
+
+    return makeHandle(index, node.generation);
+}
+
+bool TimingWheel::cancel(Handle handle)
+{
+    Node* node = resolve(handle);
+    if (!node) {
+        return false;
+    }
+
+    uint32_t index = static_cast<uint32_t>(handle & 0xFFFFFFFFu);
+
+    switch (node->state) {
+        case NodeState::Linked:
+            unlink(index);
+            releaseNode(index);
+            break;
+
+        case NodeState::Expired:
+            // Its handle in the expired list no longer resolves once released
+            releaseNode(index);
+            break;
+
+        case NodeState::Firing:
+            // Callback is running, finishExpired() releases it afterwards
+            node->state = NodeState::Cancelled;
+            break;
+
+        default:
+            return false;
+    }
+
+    armedCount--;
+    return true;
+}
+
+void TimingWheel::expireSlot(int slot)
+{
+    uint32_t index = heads[0][slot];
+    heads[0][slot] = NIL;
+    occupied[0] &= ~(1ULL << slot);
+
+    while (index != NIL) {
+        Node& node = nodes[index];
+        uint32_t next = node.next;
+
+        node.state = NodeState::Expired;
+        node.prev = NIL;
+        node.next = NIL;
+        expired.push_back(makeHandle(index, node.generation));
+
+        index = next;
+    }
+}
+
+void TimingWheel::cascade(int level, int slot)
+{
+    uint32_t index = heads[level][slot];
+    heads[level][slot] = NIL;
+    occupied[level] &= ~(1ULL << slot);
+
+    // Re-linking relative to the new current time moves each entry down
+    while (index != NIL) {
+        uint32_t next = nodes[index].next;
+        link(index);
+        index = next;
+    }
+}
+
+void TimingWheel::advance(uint64_t now)
+{
+    while (true) {
+        int level = 0;
+        while (level < LEVELS && occupied[level] == 0) {
+            level++;
+        }
+
+        if (level == LEVELS) {
+            break;
+        }
+
+        // Every entry on the lowest occupied level shares the current time's
+        // upper digits, so the first occupied slot bounds the next expiry
+        int slot = __builtin_ctzll(occupied[level]);
+        int shift = level * LEVEL_BITS;
+        int upperShift = shift + LEVEL_BITS;
+        uint64_t bound = (upperShift >= 64) ? 0 : ((currentTime >> upperShift) << upperShift);
+        bound |= static_cast<uint64_t>(slot) << shift;
+
+        if (bound > now) {
+            break;
+        }
+
+        currentTime = bound;
+        if (level == 0) {
+            expireSlot(slot);
+        } else {
+            cascade(level, slot);
+        }
+    }
+
+    if (now > currentTime) {
+        currentTime = now;
+    }
+}
+
+bool TimingWheel::popExpired(Handle& handle, std::function<void()>& action)
+{
+    while (expiredRead < expired.size()) {
+        Handle candidate = expired[expiredRead++];
+        Node* node = resolve(candidate);
+
+        if (node && node->state == NodeState::Expired) {
+            node->state = NodeState::Firing;
+            action = std::move(node->action);
+            handle = candidate;
+            return true;
+        }
+    }
+
+    expired.clear();
+    expiredRead = 0;
+    return false;
+}
+
+void TimingWheel::finishExpired(Handle handle, std::function<void()> action)
+{
+    Node* node = resolve(handle);
+    if (!node) {
+        return;
+    }
+
+    uint32_t index = static_cast<uint32_t>(handle & 0xFFFFFFFFu);
+
+    if (node->state == NodeState::Cancelled) {
+        releaseNode(index);
+        return;
+    }
+
+    if (node->state != NodeState::Firing) {
+        return;
+    }
+
+    if (node->period > 0) {
+        // Periodic entries re-arm from their previous expiry, not from now
+        node->expiry += node->period;
+        node->action = std::move(action);
+        link(index);
+    } else {
+        releaseNode(index);
+        armedCount--;
+    }
+}
+
+uint64_t TimingWheel::nextExpiry() const
+{
+    if (expiredRead < expired.size()) {
+        return currentTime;
+    }
+
+    for (int level = 0; level < LEVELS; ++level) {
+        if (occupied[level] == 0) {
+            continue;
+        }
+
+        int slot = __builtin_ctzll(occupied[level]);
+        int shift = level * LEVEL_BITS;
+        int upperShift = shift + LEVEL_BITS;
+        uint64_t bound = (upperShift >= 64) ? 0 : ((currentTime >> upperShift) << upperShift);
+        return bound | (static_cast<uint64_t>(slot) << shift);
+    }
+
+    return NO_EXPIRY;
+}
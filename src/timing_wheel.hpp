@@ -0,0 +1,91 @@
+#ifndef TIMING_WHEEL_HPP
+#define TIMING_WHEEL_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Hierarchical timing wheel keyed on clock cycles.
+//
+// Each level has 64 slots covering 6 bits of the expiry time; an entry sits
+// on the level of the highest 6-bit digit in which its expiry differs from
+// the wheel's current time. A per-level occupancy bitmap finds the next
+// non-empty slot in O(1), so advancing over an idle stretch only touches
+// the slots that actually hold entries. Insert and cancel are O(1), and an
+// entry is cascaded to a lower level at most once per level.
+//
+// Expired entries are handed out one at a time through popExpired() and
+// returned with finishExpired(), so callbacks can run outside whatever lock
+// protects the wheel and may freely arm or cancel other entries.
+
+class TimingWheel
+{
+    public:
+        typedef uint64_t Handle;
+        static const Handle INVALID_HANDLE = 0;
+        static const uint64_t NO_EXPIRY = UINT64_MAX;
+
+        TimingWheel();
+        ~TimingWheel();
+
+        // Period 0 makes a one-shot entry, otherwise it re-arms itself
+        Handle schedule(uint64_t expiry, uint64_t period, std::function<void()> action);
+        bool cancel(Handle handle);
+
+        // Moves time forward, collecting every entry due at or before now
+        void advance(uint64_t now);
+        bool popExpired(Handle& handle, std::function<void()>& action);
+        void finishExpired(Handle handle, std::function<void()> action);
+
+        // Earliest time at which an entry may expire; for entries on upper
+        // levels this is a lower bound that advance() refines by cascading
+        uint64_t nextExpiry() const;
+
+        uint64_t getCurrentTime() const {return currentTime; }
+        size_t size() const {return armedCount; }
+
+    private:
+        static const int LEVEL_BITS = 6;
+        static const int SLOTS = 1 << LEVEL_BITS;
+        static const int LEVELS = (64 + LEVEL_BITS - 1) / LEVEL_BITS;
+        static const uint32_t NIL = UINT32_MAX;
+
+        enum class NodeState : uint8_t { Free, Linked, Expired, Firing, Cancelled };
+
+        struct Node {
+            uint64_t expiry = 0;
+            uint64_t period = 0;
+            uint32_t generation = 1;
+            uint32_t prev = NIL;
+            uint32_t next = NIL;
+            uint8_t level = 0;
+            uint8_t slot = 0;
+            NodeState state = NodeState::Free;
+            std::function<void()> action;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<uint32_t> freeNodes;
+        uint32_t heads[LEVELS][SLOTS];
+        uint64_t occupied[LEVELS];
+
+        // Entries already due, waiting to be popped
+        std::vector<Handle> expired;
+        size_t expiredRead = 0;
+
+        uint64_t currentTime = 0;
+        size_t armedCount = 0;
+
+        uint32_t allocateNode();
+        void releaseNode(uint32_t index);
+        void link(uint32_t index);
+        void unlink(uint32_t index);
+        void cascade(int level, int slot);
+        void expireSlot(int slot);
+
+        static Handle makeHandle(uint32_t index, uint32_t generation);
+        Node* resolve(Handle handle);
+};
+
+#endif
@@ -0,0 +1,384 @@
+#include "uart.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+const uint32_t Uart::REGISTER_WINDOW;
+const uint32_t Uart::SR_RXNE;
+const uint32_t Uart::SR_TXE;
+const uint32_t Uart::SR_TC;
+const uint32_t Uart::SR_TXNF;
+const uint32_t Uart::SR_ORE;
+const uint32_t Uart::CR_RXIE;
+const uint32_t Uart::CR_TXIE;
+const uint32_t Uart::CR_ORECLR;
+const size_t Uart::FIFO_DEPTH;
+const size_t Uart::HOST_BUFFER;
+
+Uart::Uart() : name("UART") {}
+
+Uart::Uart(const std::string& name) : name(name) {}
+
+Uart::~Uart()
+{
+    closePty();
+}
+
+void Uart::attach(Clock& targetClock)
+{
+    clock = &targetClock;
+}
+
+void Uart::setBaudRate(uint32_t baud)
+{
+    if (baud > 0) {
+        baudRate = baud;
+    }
+}
+
+void Uart::setInterruptLine(InterruptController* controller, IrqNumber line)
+{
+    interrupts = controller;
+    irq = line;
+}
+
+uint64_t Uart::characterNs() const
+{
+    // Start bit, eight data bits and a stop bit
+    uint64_t ns = 10ULL * 1000000000ULL / baudRate.load();
+    return ns > 0 ? ns : 1;
+}
+
+uint32_t Uart::readRegister(uint32_t offset)
+{
+    switch (offset) {
+        case DR: {
+            char c = 0;
+            read(&c, 1);
+            return static_cast<uint8_t>(c);
+        }
+        case SR: {
+            uint32_t status = 0;
+            size_t queued = txFifo.size();
+            if (!rxFifo.empty()) status |= SR_RXNE;
+            if (queued == 0) status |= SR_TXE;
+            if (queued == 0 && txComplete.load()) status |= SR_TC;
+            if (queued < txFifo.capacity()) status |= SR_TXNF;
+            if (overrun.load()) status |= SR_ORE;
+            return status;
+        }
+        case CR: return control.load();
+        case BRR: return baudRate.load();
+        default: return 0;
+    }
+}
+
+void Uart::writeRegister(uint32_t offset, uint32_t value)
+{
+    switch (offset) {
+        case DR: {
+            char c = static_cast<char>(value);
+            write(&c, 1);
+            break;
+        }
+        case CR: {
+            if (value & CR_ORECLR) {
+                overrun = false;
+            }
+            uint32_t enabled = value & (CR_RXIE | CR_TXIE);
+            uint32_t previous = control.exchange(enabled);
+
+            // The interrupts are level-like: enabling one whose condition
+            // already holds raises it straight away
+            uint32_t newlyEnabled = enabled & ~previous;
+            if (((newlyEnabled & CR_RXIE) && !rxFifo.empty()) || ((newlyEnabled & CR_TXIE) && txFifo.empty())) {
+                if (interrupts) {
+                    interrupts->raise(irq);
+                }
+            }
+            break;
+        }
+        case BRR: setBaudRate(value); break;
+        default: break;   // SR is read-only
+    }
+}
+
+size_t Uart::write(const char* data, size_t length)
+{
+    size_t written = 0;
+    {
+        std::lock_guard<std::mutex> lock(firmwareMutex);
+        written = txFifo.pushBulk(data, length);
+    }
+    if (written > 0) {
+        kickTransmitter();
+    }
+    return written;
+}
+
+size_t Uart::read(char* data, size_t length)
+{
+    std::lock_guard<std::mutex> lock(firmwareMutex);
+    return rxFifo.popBulk(data, length);
+}
+
+size_t Uart::drainHost(char* data, size_t length)
+{
+    std::lock_guard<std::mutex> lock(hostMutex);
+    if (ptyOpen.load()) {
+        return 0;
+    }
+
+    size_t held = heldTx.size() < length ? heldTx.size() : length;
+    if (held > 0) {
+        heldTx.copy(data, held);
+        heldTx.erase(0, held);
+    }
+    return held + hostTx.popBulk(data + held, length - held);
+}
+
+size_t Uart::feedHost(const char* data, size_t length)
+{
+    std::lock_guard<std::mutex> lock(hostMutex);
+    if (ptyOpen.load()) {
+        return 0;
+    }
+    return pushHostRx(data, length);
+}
+
+size_t Uart::pushHostRx(const char* data, size_t length)
+{
+    size_t fed = hostRx.pushBulk(data, length);
+    if (fed > 0) {
+        kickReceiver();
+    }
+    return fed;
+}
+
+void Uart::raiseIf(uint32_t enableBit)
+{
+    if ((control.load() & enableBit) && interrupts) {
+        interrupts->raise(irq);
+    }
+}
+
+void Uart::kickTransmitter()
+{
+    // Whoever flips the busy flag owns starting the service event
+    if (clock && !txBusy.exchange(true)) {
+        clock->scheduleAt(clock->getSimTimeNanoseconds(), [this]() {serviceTransmitter(); });
+    }
+}
+
+void Uart::kickReceiver()
+{
+    if (clock && !rxBusy.exchange(true)) {
+        clock->scheduleAt(clock->getSimTimeNanoseconds(), [this]() {serviceReceiver(); });
+    }
+}
+
+void Uart::serviceTransmitter()
+{
+    uint64_t now = clock->getSimTimeNanoseconds();
+    uint64_t charNs = characterNs();
+    uint64_t lineFreeNs = now;
+
+    while (true) {
+        if (txShifting) {
+            if (txDoneNs > now) {
+                break;
+            }
+            if (!hostTx.tryPush(txShift)) {
+                hostDrops++;   // Nobody is draining the host side
+            }
+            txCount++;
+            txShifting = false;
+            lineFreeNs = txDoneNs;
+        }
+
+        // A character already waiting starts on the previous stop bit
+        if (!txFifo.tryPop(txShift)) {
+            break;
+        }
+        txShifting = true;
+        txComplete = false;
+        txDoneNs = lineFreeNs + charNs;
+        if (txFifo.empty()) {
+            raiseIf(CR_TXIE);
+        }
+    }
+
+    if (txShifting) {
+        clock->scheduleAt(txDoneNs, [this]() {serviceTransmitter(); });
+        return;
+    }
+
+    txComplete = true;
+    txBusy = false;
+
+    // A write may have landed between the last pop and clearing the flag
+    if (!txFifo.empty()) {
+        kickTransmitter();
+    }
+}
+
+void Uart::serviceReceiver()
+{
+    uint64_t now = clock->getSimTimeNanoseconds();
+    uint64_t charNs = characterNs();
+    uint64_t lineFreeNs = now;
+
+    while (true) {
+        if (rxShifting) {
+            if (rxDoneNs > now) {
+                break;
+            }
+            if (rxFifo.tryPush(rxShift)) {
+                rxCount++;
+                raiseIf(CR_RXIE);
+            } else {
+                overrun = true;
+                overruns++;
+            }
+            rxShifting = false;
+            lineFreeNs = rxDoneNs;
+        }
+
+        if (!hostRx.tryPop(rxShift)) {
+            break;
+        }
+        rxShifting = true;
+        rxDoneNs = lineFreeNs + charNs;
+    }
+
+    if (rxShifting) {
+        clock->scheduleAt(rxDoneNs, [this]() {serviceReceiver(); });
+        return;
+    }
+
+    rxBusy = false;
+    if (!hostRx.empty()) {
+        kickReceiver();
+    }
+}
+
+bool Uart::openPty(std::string& slavePath, std::string& error)
+{
+    if (ptyRunning.load()) {
+        slavePath = ptyPath;
+        return true;
+    }
+
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+        error = name + ": cannot create a pseudo-terminal: " + std::strerror(errno);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+
+    // Raw, so bytes pass through exactly as the firmware sent them
+    struct termios settings;
+    if (tcgetattr(fd, &settings) == 0) {
+        cfmakeraw(&settings);
+        tcsetattr(fd, TCSANOW, &settings);
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    ptyMaster = fd;
+    ptyPath = ptsname(fd);
+    slavePath = ptyPath;
+
+    // Waits out a drainHost() or feedHost() already in progress
+    {
+        std::lock_guard<std::mutex> lock(hostMutex);
+        ptyOpen = true;
+    }
+    ptyRunning = true;
+    ptyThread = std::thread(&Uart::ptyLoop, this);
+    return true;
+}
+
+void Uart::closePty()
+{
+    if (!ptyRunning.exchange(false)) {
+        return;
+    }
+
+    // The host side only goes back once the thread can no longer touch it
+    ptyThread.join();
+    {
+        std::lock_guard<std::mutex> lock(hostMutex);
+        ptyOpen = false;
+    }
+    ::close(ptyMaster);
+    ptyMaster = -1;
+    ptyPath.clear();
+}
+
+void Uart::ptyLoop()
+{
+    // Whatever the terminal has not taken yet stays here, so nothing the
+    // firmware sent is lost to a slow reader
+    char outgoing[4096];
+    size_t outStart = 0;
+    size_t outEnd = 0;
+    char incoming[4096];
+
+    // Output left over from an earlier PTY goes first. It is never more
+    // than one buffer, since only this loop fills heldTx.
+    {
+        std::lock_guard<std::mutex> lock(hostMutex);
+        outEnd = heldTx.copy(outgoing, sizeof(outgoing));
+        heldTx.erase(0, outEnd);
+    }
+
+    while (ptyRunning.load()) {
+        if (outStart == outEnd) {
+            outStart = 0;
+            outEnd = hostTx.popBulk(outgoing, sizeof(outgoing));
+        }
+
+        size_t space = hostRx.capacity() - hostRx.size();
+        struct pollfd descriptor;
+        descriptor.fd = ptyMaster;
+        descriptor.events = static_cast<short>((space > 0 ? POLLIN : 0) | (outStart < outEnd ? POLLOUT : 0));
+        descriptor.revents = 0;
+
+        // Short timeout: new output shows up in hostTx without waking us
+        int ready = poll(&descriptor, 1, 2);
+        if (ready <= 0) {
+            continue;
+        }
+
+        if (descriptor.revents & POLLHUP) {
+            // No terminal attached yet; output waits in the host ring
+            usleep(2000);
+            continue;
+        }
+
+        if ((descriptor.revents & POLLOUT) && outStart < outEnd) {
+            ssize_t sent = ::write(ptyMaster, outgoing + outStart, outEnd - outStart);
+            if (sent > 0) {
+                outStart += static_cast<size_t>(sent);
+            }
+        }
+
+        if (descriptor.revents & POLLIN) {
+            size_t want = space < sizeof(incoming) ? space : sizeof(incoming);
+            ssize_t got = ::read(ptyMaster, incoming, want);
+            if (got > 0) {
+                pushHostRx(incoming, static_cast<size_t>(got));
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(hostMutex);
+    heldTx.assign(outgoing + outStart, outEnd - outStart);
+}
@@ -0,0 +1,162 @@
+#ifndef UART_HPP
+#define UART_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "clock.hpp"
+#include "interrupt_controller.hpp"
+#include "spsc_ring.hpp"
+
+// 8N1 UART with 16550-style FIFOs and a host-side bridge.
+//
+// Characters move on the wire at the configured baud rate in simulated
+// time: each takes ten bit times, and back-to-back characters are timed
+// from the end of the previous one rather than from when the clock got
+// round to them. Transmit and receive each run off a single clock event
+// that finishes every character due and re-arms itself while there is
+// more to do, so an idle UART costs nothing.
+//
+// Every path between threads is an SPSC ring:
+//
+//   firmware --TX FIFO--> clock thread --host TX--> bridge
+//   firmware <--RX FIFO-- clock thread <--host RX-- bridge
+//
+// The firmware side is reached from several threads - bus accesses from
+// the core and the CLI, and the stand-in handler - so its pushes and pops
+// take a lock; the clock thread's side stays lock-free. The bridge is
+// either a pseudo-terminal serviced by the UART's own thread, or the caller
+// draining and feeding the host rings directly, in batches, for the
+// display terminal. The host side changes hands under a lock, and only
+// once the PTY thread has exited.
+
+class Uart
+{
+    public:
+        // Register offsets within the UART's 16-byte window
+        enum Register : uint32_t {
+            DR = 0x00,      // read pops the RX FIFO, write pushes the TX FIFO
+            SR = 0x04,      // status, read-only
+            CR = 0x08,      // control
+            BRR = 0x0C      // baud rate in bits per second
+        };
+        static const uint32_t REGISTER_WINDOW = 0x10;
+
+        // SR bits
+        static const uint32_t SR_RXNE = 1u << 0;    // RX FIFO not empty
+        static const uint32_t SR_TXE = 1u << 1;     // TX FIFO empty
+        static const uint32_t SR_TC = 1u << 2;      // TX FIFO empty and last character sent
+        static const uint32_t SR_TXNF = 1u << 3;    // TX FIFO not full
+        static const uint32_t SR_ORE = 1u << 4;     // RX overrun since last cleared
+
+        // CR bits
+        static const uint32_t CR_RXIE = 1u << 0;    // interrupt when RXNE sets
+        static const uint32_t CR_TXIE = 1u << 1;    // interrupt when TXE sets
+        static const uint32_t CR_ORECLR = 1u << 8;  // write 1 to clear ORE
+
+        static const size_t FIFO_DEPTH = 64;
+        static const size_t HOST_BUFFER = 1 << 16;
+
+        Uart();
+        Uart(const std::string& name);
+        ~Uart();
+
+        Uart(const Uart&) = delete;
+        Uart& operator=(const Uart&) = delete;
+
+        const std::string& getName() const {return name; }
+
+        // Characters are timed against this clock's simulated time
+        void attach(Clock& clock);
+        void setBaudRate(uint32_t baud);
+        uint32_t getBaudRate() const {return baudRate.load(); }
+        void setInterruptLine(InterruptController* controller, IrqNumber irq);
+
+        // Register access, from any thread
+        uint32_t readRegister(uint32_t offset);
+        void writeRegister(uint32_t offset, uint32_t value);
+
+        // Firmware-side fast paths; both return how many bytes moved
+        size_t write(const char* data, size_t length);
+        size_t read(char* data, size_t length);
+
+        // Host side, for a caller-serviced bridge. Both move nothing while
+        // a PTY is open.
+        size_t drainHost(char* data, size_t length);
+        size_t feedHost(const char* data, size_t length);
+
+        // Pseudo-terminal bridge; the slave path is what a terminal opens.
+        // Output the terminal had not taken by closePty() goes back to
+        // drainHost().
+        bool openPty(std::string& slavePath, std::string& error);
+        void closePty();
+        bool isPtyOpen() const {return ptyOpen.load(); }
+        const std::string& getPtyPath() const {return ptyPath; }
+
+        uint64_t getTxCount() const {return txCount.load(); }
+        uint64_t getRxCount() const {return rxCount.load(); }
+        uint64_t getOverruns() const {return overruns.load(); }
+        uint64_t getHostDrops() const {return hostDrops.load(); }
+
+    private:
+        std::string name;
+        Clock* clock = nullptr;
+        std::atomic<uint32_t> baudRate{115200};
+        std::atomic<uint32_t> control{0};
+        InterruptController* interrupts = nullptr;
+        IrqNumber irq = -1;
+
+        // firmwareMutex makes the firmware side a single producer of
+        // txFifo and a single consumer of rxFifo
+        SpscRing<char> txFifo{FIFO_DEPTH};
+        SpscRing<char> rxFifo{FIFO_DEPTH};
+        std::mutex firmwareMutex;
+        SpscRing<char> hostTx{HOST_BUFFER};
+        SpscRing<char> hostRx{HOST_BUFFER};
+
+        // Transmitter, clock thread only apart from the busy flag
+        std::atomic<bool> txBusy{false};
+        bool txShifting = false;
+        char txShift = 0;
+        uint64_t txDoneNs = 0;
+        std::atomic<bool> txComplete{true};
+
+        // Receiver, likewise
+        std::atomic<bool> rxBusy{false};
+        bool rxShifting = false;
+        char rxShift = 0;
+        uint64_t rxDoneNs = 0;
+        std::atomic<bool> overrun{false};
+
+        std::atomic<uint64_t> txCount{0};
+        std::atomic<uint64_t> rxCount{0};
+        std::atomic<uint64_t> overruns{0};
+        std::atomic<uint64_t> hostDrops{0};
+
+        int ptyMaster = -1;
+        std::string ptyPath;
+        std::thread ptyThread;
+        std::atomic<bool> ptyRunning{false};
+
+        // Who consumes hostTx and produces hostRx: the PTY thread while
+        // ptyOpen is set, drainHost() and feedHost() callers otherwise.
+        // heldTx is output the PTY thread took but never wrote.
+        std::mutex hostMutex;
+        std::atomic<bool> ptyOpen{false};
+        std::string heldTx;
+
+        uint64_t characterNs() const;
+        void kickTransmitter();
+        void kickReceiver();
+        void serviceTransmitter();
+        void serviceReceiver();
+        void raiseIf(uint32_t enableBit);
+        size_t pushHostRx(const char* data, size_t length);
+        void ptyLoop();
+};
+
+#endif
@@ -0,0 +1,347 @@
+#include "vcd_writer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+const VcdWriter::SignalId VcdWriter::INVALID_SIGNAL;
+const size_t VcdWriter::BUFFER_SIZE;
+const size_t VcdWriter::MAX_ENTRY;
+
+VcdWriter::VcdWriter() {}
+
+VcdWriter::~VcdWriter()
+{
+    close();
+}
+
+VcdWriter::SignalId VcdWriter::addSignal(const std::string& name, int width)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (active.load() || width < 1 || width > 64) {
+        return INVALID_SIGNAL;
+    }
+
+    Signal signal;
+    signal.name = name;
+    for (char& c : signal.name) {
+        if (c == ' ' || c == '\t') {
+            c = '_';
+        }
+    }
+    signal.code = makeCode(static_cast<int>(signals.size()));
+    signal.width = width;
+    signals.push_back(signal);
+    return static_cast<SignalId>(signals.size() - 1);
+}
+
+bool VcdWriter::open(const std::string& filePath, uint64_t startTimeNs, std::string& error)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (active.load()) {
+        error = path + " is already being traced";
+        return false;
+    }
+
+    file.open(filePath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        error = filePath + ": cannot open for writing";
+        return false;
+    }
+
+    path = filePath;
+    buffer.resize(BUFFER_SIZE);
+    flushBuffer.resize(BUFFER_SIZE);
+    used = 0;
+    flushUsed = 0;
+    flushPending = false;
+    flushStopping = false;
+    bytesWritten = 0;
+    flushThread = std::thread(&VcdWriter::flushLoop, this);
+
+    std::string header = "$version embedsim $end\n$timescale 1ns $end\n$scope module embedsim $end\n";
+    for (const Signal& signal : signals) {
+        header += "$var wire " + std::to_string(signal.width) + " " + signal.code + " " + signal.name + " $end\n";
+    }
+    header += "$upscope $end\n$enddefinitions $end\n";
+    append(header.data(), header.size());
+
+    timeWritten = false;
+    lastTimeNs = startTimeNs;
+    reserve();
+    appendTime(startTimeNs);
+    append("$dumpvars\n", 10);
+    for (const Signal& signal : signals) {
+        reserve();
+        appendValue(signal);
+    }
+    append("$end\n", 5);
+
+    active.store(true, std::memory_order_release);
+    return true;
+}
+
+void VcdWriter::close()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!active.load()) {
+        return;
+    }
+    active = false;
+
+    if (used > 0) {
+        handOff();
+    }
+    {
+        std::lock_guard<std::mutex> flushLock(flushMutex);
+        flushStopping = true;
+    }
+    flushCondition.notify_all();
+    flushThread.join();
+    file.close();
+
+    std::vector<char>().swap(buffer);
+    std::vector<char>().swap(flushBuffer);
+}
+
+std::string VcdWriter::getPath() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return path;
+}
+
+void VcdWriter::change(SignalId id, uint64_t value, uint64_t timeNs)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (id < 0 || id >= static_cast<SignalId>(signals.size())) {
+        return;
+    }
+
+    Signal& signal = signals[id];
+    if (signal.width < 64) {
+        value &= (1ULL << signal.width) - 1;
+    }
+    if (value == signal.value) {
+        return;
+    }
+    signal.value = value;
+
+    if (active.load()) {
+        reserve();
+        appendTime(timeNs);
+        appendValue(signal);
+    }
+}
+
+void VcdWriter::clockEdges(SignalId id, uint64_t firstEdgeNs, uint64_t halfPeriodNs, long long edges, bool firstValue)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (id < 0 || id >= static_cast<SignalId>(signals.size()) || edges <= 0) {
+        return;
+    }
+
+    Signal& signal = signals[id];
+    bool lastValue = firstValue != (((edges - 1) & 1) != 0);
+    if (!active.load()) {
+        signal.value = lastValue;
+        return;
+    }
+
+    // Skip an edge that repeats the current value, then every one left is a change
+    if (signal.value == static_cast<uint64_t>(firstValue)) {
+        firstEdgeNs += halfPeriodNs;
+        firstValue = !firstValue;
+        edges--;
+    }
+    if (firstEdgeNs < lastTimeNs || (timeWritten && firstEdgeNs == lastTimeNs) || halfPeriodNs == 0) {
+        // Out of order with what is already written; take the general path
+        for (long long edge = 0; edge < edges; ++edge, firstEdgeNs += halfPeriodNs, firstValue = !firstValue) {
+            reserve();
+            appendTime(firstEdgeNs);
+            signal.value = firstValue;
+            appendValue(signal);
+        }
+        return;
+    }
+
+    // Timestamps advance by a fixed step, so keep them as decimal text and
+    // add the step digit by digit instead of formatting every one
+    char digits[20];
+    size_t timeLength = static_cast<size_t>(writeDecimal(digits, firstEdgeNs) - digits);
+    char time[24];
+    char* timeEnd = time + sizeof(time);
+    char* timeStart = timeEnd - timeLength;
+    std::memset(time, '0', sizeof(time));
+    std::memcpy(timeStart, digits, timeLength);
+
+    char step[20];
+    size_t stepLength = static_cast<size_t>(writeDecimal(step, halfPeriodNs) - step);
+    size_t stepZeros = 0;
+    while (step[stepLength - 1 - stepZeros] == '0') {
+        stepZeros++;
+    }
+
+    const size_t codeLength = signal.code.size();
+    bool value = firstValue;
+    for (long long edge = 0; edge < edges; ++edge, value = !value) {
+        reserve();
+        char* out = buffer.data() + used;
+        *out++ = '#';
+        std::memcpy(out, timeStart, static_cast<size_t>(timeEnd - timeStart));
+        out += timeEnd - timeStart;
+        *out++ = '\n';
+        *out++ = value ? '1' : '0';
+        std::memcpy(out, signal.code.data(), codeLength);
+        out += codeLength;
+        *out++ = '\n';
+        used = static_cast<size_t>(out - buffer.data());
+
+        // Add the step, skipping its trailing zeros
+        char* digit = timeEnd - 1 - stepZeros;
+        int carry = 0;
+        for (size_t i = stepZeros; i < stepLength || carry; ++i, --digit) {
+            if (digit < timeStart) {
+                timeStart = digit;
+            }
+            int sum = (*digit - '0') + carry + (i < stepLength ? step[stepLength - 1 - i] - '0' : 0);
+            carry = sum >= 10;
+            *digit = static_cast<char>('0' + (sum - (carry ? 10 : 0)));
+        }
+    }
+
+    if (edges > 0) {
+        lastTimeNs = firstEdgeNs + static_cast<uint64_t>(edges - 1) * halfPeriodNs;
+        timeWritten = true;
+    }
+    signal.value = lastValue;
+}
+
+void VcdWriter::flushLoop()
+{
+    std::unique_lock<std::mutex> lock(flushMutex);
+    while (true) {
+        flushCondition.wait(lock, [this]() {return flushPending || flushStopping; });
+
+        if (flushPending) {
+            // The producer leaves flushBuffer alone until flushPending clears
+            size_t length = flushUsed;
+            lock.unlock();
+            file.write(flushBuffer.data(), static_cast<std::streamsize>(length));
+            bytesWritten += length;
+            lock.lock();
+            flushPending = false;
+            flushCondition.notify_all();
+            continue;
+        }
+
+        break;
+    }
+    file.flush();
+}
+
+void VcdWriter::handOff()
+{
+    // Blocks only if the previous buffer is still being written
+    std::unique_lock<std::mutex> lock(flushMutex);
+    flushCondition.wait(lock, [this]() {return !flushPending; });
+
+    buffer.swap(flushBuffer);
+    flushUsed = used;
+    used = 0;
+    flushPending = true;
+    flushCondition.notify_all();
+}
+
+void VcdWriter::append(const char* text, size_t length)
+{
+    while (length > 0) {
+        if (used == buffer.size()) {
+            handOff();
+        }
+        size_t chunk = std::min(length, buffer.size() - used);
+        std::memcpy(buffer.data() + used, text, chunk);
+        used += chunk;
+        text += chunk;
+        length -= chunk;
+    }
+}
+
+void VcdWriter::appendTime(uint64_t timeNs)
+{
+    if (timeNs < lastTimeNs) {
+        timeNs = lastTimeNs;
+    }
+    if (timeWritten && timeNs == lastTimeNs) {
+        return;
+    }
+
+    char* out = buffer.data() + used;
+    *out++ = '#';
+    out = writeDecimal(out, timeNs);
+    *out++ = '\n';
+    used = static_cast<size_t>(out - buffer.data());
+    lastTimeNs = timeNs;
+    timeWritten = true;
+}
+
+void VcdWriter::appendValue(const Signal& signal)
+{
+    char* out = buffer.data() + used;
+    if (signal.width == 1) {
+        *out++ = signal.value ? '1' : '0';
+    } else {
+        *out++ = 'b';
+        int bit = 63;
+        while (bit > 0 && ((signal.value >> bit) & 1) == 0) {
+            bit--;
+        }
+        for (; bit >= 0; --bit) {
+            *out++ = ((signal.value >> bit) & 1) ? '1' : '0';
+        }
+        *out++ = ' ';
+    }
+    std::memcpy(out, signal.code.data(), signal.code.size());
+    out += signal.code.size();
+    *out++ = '\n';
+    used = static_cast<size_t>(out - buffer.data());
+}
+
+char* VcdWriter::writeDecimal(char* out, uint64_t value)
+{
+    // Two digits per division; timestamps are the bulk of a trace
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+    char digits[20];
+    char* end = digits + sizeof(digits);
+    char* p = end;
+    while (value >= 100) {
+        unsigned pair = static_cast<unsigned>(value % 100) * 2;
+        value /= 100;
+        *--p = pairs[pair + 1];
+        *--p = pairs[pair];
+    }
+    if (value >= 10) {
+        unsigned pair = static_cast<unsigned>(value) * 2;
+        *--p = pairs[pair + 1];
+        *--p = pairs[pair];
+    } else {
+        *--p = static_cast<char>('0' + value);
+    }
+
+    size_t length = static_cast<size_t>(end - p);
+    std::memcpy(out, p, length);
+    return out + length;
+}
+
+std::string VcdWriter::makeCode(int index)
+{
+    // Identifiers use the printable ASCII range '!' to '~'
+    std::string code;
+    do {
+        code += static_cast<char>('!' + index % 94);
+        index /= 94;
+    } while (index > 0);
+    return code;
+}
@@ -0,0 +1,95 @@
+#ifndef VCD_WRITER_HPP
+#define VCD_WRITER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streaming Value Change Dump (IEEE 1364) writer, readable by GTKWave.
+//
+// Signals are declared once, then traces can be opened and closed any
+// number of times. Only real changes are written. Output is formatted into
+// a large buffer and handed to a background thread for the file write, so
+// callers never wait on the disk unless it falls a whole buffer behind.
+//
+// Any thread may record changes. Times are simulated nanoseconds (the
+// timescale is 1 ns); VCD needs them in order, so a change stamped before
+// the last one written is moved forward to it.
+
+class VcdWriter
+{
+    public:
+        typedef int SignalId;
+        static const SignalId INVALID_SIGNAL = -1;
+
+        VcdWriter();
+        ~VcdWriter();
+
+        VcdWriter(const VcdWriter&) = delete;
+        VcdWriter& operator=(const VcdWriter&) = delete;
+
+        // Declare before the first open(); width is 1 to 64 bits
+        SignalId addSignal(const std::string& name, int width);
+
+        // Starts a trace at startTimeNs, dumping each signal's current value
+        bool open(const std::string& path, uint64_t startTimeNs, std::string& error);
+        void close();
+
+        bool isOpen() const {return active.load(std::memory_order_acquire); }
+        std::string getPath() const;
+        uint64_t getBytesWritten() const {return bytesWritten.load(); }
+
+        // While closed, this only sets the value the next open() dumps
+        void change(SignalId signal, uint64_t value, uint64_t timeNs);
+
+        // Writes edges alternating from firstValue, halfPeriodNs apart
+        void clockEdges(SignalId signal, uint64_t firstEdgeNs, uint64_t halfPeriodNs, long long edges, bool firstValue);
+
+    private:
+        struct Signal {
+            std::string name;
+            std::string code;
+            int width = 1;
+            uint64_t value = 0;
+        };
+
+        static const size_t BUFFER_SIZE = 4 << 20;
+        static const size_t MAX_ENTRY = 128;
+
+        mutable std::mutex mutex;
+        std::vector<Signal> signals;
+        std::atomic<bool> active{false};
+        std::string path;
+        uint64_t lastTimeNs = 0;
+        bool timeWritten = false;
+
+        // Filled under mutex, swapped with the flush thread when full
+        std::vector<char> buffer;
+        size_t used = 0;
+
+        std::ofstream file;
+        std::thread flushThread;
+        std::mutex flushMutex;
+        std::condition_variable flushCondition;
+        std::vector<char> flushBuffer;
+        size_t flushUsed = 0;
+        bool flushPending = false;
+        bool flushStopping = false;
+        std::atomic<uint64_t> bytesWritten{0};
+
+        void flushLoop();
+        void handOff();
+        void reserve() {if (used + MAX_ENTRY > buffer.size()) handOff(); }
+        void append(const char* text, size_t length);
+        void appendTime(uint64_t timeNs);
+        void appendValue(const Signal& signal);
+        static char* writeDecimal(char* out, uint64_t value);
+        static std::string makeCode(int index);
+};
+
+#endif